@@ -0,0 +1,289 @@
+#include "gst_abr.h"
+#include "gst_encoder_control.h"
+
+#include <common/log.h>
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace caspar { namespace gstreamer {
+
+namespace {
+
+// Seconds between two decreases, so the queue can show whether the last one was enough
+const int decrease_interval = 2;
+
+// Seconds at the minimum bitrate and still congested before the resolution is lowered
+const int rung_down_after = 5;
+
+// Seconds below the low mark before the bitrate is raised, and between two increases
+const int increase_after = 10;
+
+std::string scaled_caps(int width, int height)
+{
+    return "video/x-raw,width=" + std::to_string(width) + ",height=" + std::to_string(height);
+}
+
+} // namespace
+
+GstAbr::GstAbr(Settings settings)
+    : settings_(std::move(settings))
+    , min_kbps_(settings_.min_kbps)
+    , max_kbps_(settings_.max_kbps)
+    , last_update_(std::chrono::steady_clock::now())
+    , throttle_kbps_(settings_.throttle_kbps)
+{
+    stats_.bitrate = std::clamp(settings_.start_kbps, settings_.min_kbps, settings_.max_kbps);
+    stats_.width   = settings_.width;
+    stats_.height  = settings_.height;
+}
+
+bool GstAbr::supports(const std::string& codec)
+{
+    return codec == "x264" || codec == "libx264" || codec == "nvenc" || codec == "nvh264" || codec == "openh264" ||
+           codec == "vp8" || codec == "vp9";
+}
+
+std::string GstAbr::scale_description() const
+{
+    return "videoscale ! capsfilter name=abr_caps caps=\"" + scaled_caps(settings_.width, settings_.height) + "\" ! ";
+}
+
+std::string GstAbr::queue_description() const
+{
+    // Bounded by time only, the controller keeps it far shorter. The identity paces the sink for testing.
+    return "queue name=abr_queue max-size-buffers=0 max-size-bytes=0 max-size-time=30000000000 ! "
+           "identity name=abr_throttle signal-handoffs=true ! ";
+}
+
+void GstAbr::attach(GstElement* pipeline)
+{
+    caps_ = make_gst_ptr<GstElement>(gst_bin_get_by_name(GST_BIN(pipeline), "abr_caps"));
+    watch_output(pipeline);
+
+    GstIterator* it   = gst_bin_iterate_recurse(GST_BIN(pipeline));
+    GValue       item = G_VALUE_INIT;
+    while (!encoder_ && gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+        auto element = GST_ELEMENT(g_value_get_object(&item));
+        auto factory = gst_element_get_factory(element);
+        auto klass   = factory ? gst_element_factory_get_metadata(factory, GST_ELEMENT_METADATA_KLASS) : nullptr;
+        if (klass && std::strstr(klass, "Encoder") && std::strstr(klass, "Video")) {
+            encoder_ = make_gst_ptr<GstElement>(GST_ELEMENT(gst_object_ref(element)));
+        }
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+
+    // The queue of an output with a pipeline of its own comes once it connected
+    if (!encoder_ || !caps_) {
+        CASPAR_LOG(warning) << "[gstreamer] Adaptive bitrate is missing its elements and stays off.";
+        return;
+    }
+    apply_bitrate(stats().bitrate);
+}
+
+void GstAbr::set_encoder(GstElement* encoder)
+{
+    encoder_ = make_gst_ptr<GstElement>(GST_ELEMENT(gst_object_ref(encoder)));
+    apply_bitrate(stats().bitrate);
+}
+
+void GstAbr::watch_output(GstElement* bin)
+{
+    queue_ = make_gst_ptr<GstElement>(gst_bin_get_by_name(GST_BIN(bin), "abr_queue"));
+    if (queue_) {
+        GstPad* pad = gst_element_get_static_pad(queue_.get(), "src");
+        if (pad) {
+            gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, &GstAbr::queue_output, this, nullptr);
+            gst_object_unref(pad);
+        }
+    }
+
+    auto identity = make_gst_ptr<GstElement>(gst_bin_get_by_name(GST_BIN(bin), "abr_throttle"));
+    if (identity) {
+        g_signal_connect(identity.get(), "handoff", G_CALLBACK(&GstAbr::throttle), this);
+    }
+
+    // The new sink starts without a backlog
+    last_push_         = {};
+    congested_seconds_ = 0;
+}
+
+void GstAbr::set_max_bitrate(int kbps)
+{
+    max_kbps_ = kbps;
+    min_kbps_ = std::min(settings_.min_kbps, kbps);
+    set_bitrate(kbps);
+}
+
+GstPadProbeReturn GstAbr::queue_output(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    auto self   = static_cast<GstAbr*>(user_data);
+    auto buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!buffer) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    // The queue pushes the next buffer as soon as the sink returns from the previous one, so
+    // while data is waiting the time between pushes is what the sink took to send
+    const auto now     = std::chrono::steady_clock::now();
+    guint      waiting = 0;
+    g_object_get(GST_PAD_PARENT(pad), "current-level-buffers", &waiting, nullptr);
+    if (waiting > 0 && self->last_push_.time_since_epoch().count() > 0) {
+        self->send_time_us_ += std::chrono::duration_cast<std::chrono::microseconds>(now - self->last_push_).count();
+        self->send_count_++;
+    }
+    self->last_push_ = now;
+    self->sent_bytes_ += gst_buffer_get_size(buffer);
+    return GST_PAD_PROBE_OK;
+}
+
+void GstAbr::throttle(GstElement* identity, GstBuffer* buffer, gpointer user_data)
+{
+    auto       self = static_cast<GstAbr*>(user_data);
+    const auto kbps = self->throttle_kbps_.load();
+    if (kbps <= 0) {
+        return;
+    }
+
+    // Each buffer takes as long as the throttled link needs for it
+    const auto now  = std::chrono::steady_clock::now();
+    const auto cost = std::chrono::microseconds(static_cast<int64_t>(gst_buffer_get_size(buffer)) * 8000 / kbps);
+    self->throttle_next_ = std::max(self->throttle_next_, now) + cost;
+    std::this_thread::sleep_until(self->throttle_next_);
+}
+
+void GstAbr::update()
+{
+    if (!encoder_ || !caps_ || !queue_) {
+        return;
+    }
+
+    const auto now     = std::chrono::steady_clock::now();
+    const auto elapsed = std::chrono::duration<double>(now - last_update_).count();
+    if (elapsed < 1.0) {
+        return;
+    }
+    last_update_ = now;
+
+    guint64 level_ns = 0;
+    g_object_get(queue_.get(), "current-level-time", &level_ns, nullptr);
+
+    const auto bytes   = sent_bytes_.exchange(0);
+    const auto sends   = send_count_.exchange(0);
+    const auto send_us = send_time_us_.exchange(0);
+
+    abr_stats stats = this->stats();
+    stats.queue_ms    = level_ns / 1e6;
+    stats.output_kbps = bytes * 8 / 1000.0 / elapsed;
+    stats.send_ms     = sends > 0 ? send_us / 1000.0 / sends : 0.0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.queue_ms    = stats.queue_ms;
+        stats_.output_kbps = stats.output_kbps;
+        stats_.send_ms     = stats.send_ms;
+    }
+
+    ++since_change_;
+    if (stats.queue_ms > settings_.high_ms) {
+        ++congested_seconds_;
+        calm_seconds_ = 0;
+        set_state("congested");
+
+        if (since_change_ < decrease_interval) {
+            return;
+        }
+        if (stats.bitrate > min_kbps_) {
+            // Below what actually got through, or a quarter less when the sink stalled completely
+            auto target = stats.bitrate * 3 / 4;
+            if (stats.output_kbps > 0) {
+                target = std::min(target, static_cast<int>(stats.output_kbps * 0.85));
+            }
+            set_bitrate(std::max(target, min_kbps_));
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.decreases++;
+        } else if (stats.rung == 0 && congested_seconds_ >= rung_down_after) {
+            set_rung(1);
+        }
+    } else if (stats.queue_ms < settings_.low_ms) {
+        ++calm_seconds_;
+        congested_seconds_ = 0;
+        set_state(stats.bitrate < max_kbps_ || stats.rung > 0 ? "recovering" : "steady");
+
+        if (calm_seconds_ < increase_after || since_change_ < increase_after) {
+            return;
+        }
+        if (stats.bitrate < max_kbps_) {
+            set_bitrate(std::min(max_kbps_, stats.bitrate + std::max(stats.bitrate / 10, 50)));
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.increases++;
+        } else if (stats.rung > 0) {
+            set_rung(0);
+        }
+    } else {
+        // Between the marks, the last change is still draining the queue or it settled
+        congested_seconds_ = 0;
+        calm_seconds_      = 0;
+    }
+}
+
+// The encoders take the bitrate while playing
+void GstAbr::apply_bitrate(int kbps)
+{
+    const auto property = encoder_bitrate_property(settings_.codec, kbps);
+    gst_util_set_object_arg(G_OBJECT(encoder_.get()), property.first.c_str(), property.second.c_str());
+}
+
+void GstAbr::set_bitrate(int kbps)
+{
+    apply_bitrate(kbps);
+    since_change_ = 0;
+
+    int    previous;
+    double queued;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        previous       = stats_.bitrate;
+        queued         = stats_.queue_ms;
+        stats_.bitrate = kbps;
+    }
+    CASPAR_LOG(info) << "[gstreamer] Adaptive bitrate " << previous << " -> " << kbps << " kbps, " << queued
+                     << " ms queued for the sink.";
+}
+
+void GstAbr::set_rung(int rung)
+{
+    // Half size, kept even for 4:2:0
+    const auto width  = rung > 0 ? settings_.width / 4 * 2 : settings_.width;
+    const auto height = rung > 0 ? settings_.height / 4 * 2 : settings_.height;
+
+    GstCaps* caps = gst_caps_from_string(scaled_caps(width, height).c_str());
+    g_object_set(caps_.get(), "caps", caps, nullptr);
+    gst_caps_unref(caps);
+    since_change_ = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.rung   = rung;
+        stats_.width  = width;
+        stats_.height = height;
+        stats_.rung_changes++;
+    }
+    CASPAR_LOG(info) << "[gstreamer] Adaptive bitrate switched to " << width << "x" << height << ".";
+}
+
+void GstAbr::set_state(const std::string& state)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.state = state;
+}
+
+abr_stats GstAbr::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "../util/gst_util.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace caspar { namespace gstreamer {
+
+struct abr_stats
+{
+    std::string state        = "steady"; // "steady", "congested" or "recovering"
+    int         bitrate      = 0;        // kbps the encoder is set to
+    int         rung         = 0;        // 0 at full resolution, 1 at half
+    int         width        = 0;
+    int         height       = 0;
+    double      queue_ms     = 0; // muxed stream waiting for the sink
+    double      send_ms      = 0; // average time the sink took per buffer while data was waiting
+    double      output_kbps  = 0; // what the sink actually sent
+    int64_t     decreases    = 0;
+    int64_t     increases    = 0;
+    int64_t     rung_changes = 0;
+};
+
+// Adapts the bitrate of a streaming output to what its uplink carries. A queue in front of the
+// sink holds whatever the sink can't send yet, so its level is the latency congestion adds.
+// Once a second the level is checked: above the high mark the encoder's bitrate is lowered to
+// below what the sink managed to send, and once it has been calm below the low mark for a while
+// it is raised again in small steps. When the minimum bitrate still doesn't get through, the
+// frames are scaled to half size in front of the encoder, and back once the maximum fits again.
+class GstAbr
+{
+  public:
+    struct Settings
+    {
+        std::string codec; // as given to the consumer, only H.264, VP8 and VP9 encoders
+        int         min_kbps      = 0;
+        int         max_kbps      = 0;
+        int         start_kbps    = 0;
+        int         width         = 0; // of the channel
+        int         height        = 0;
+        int         high_ms       = 1000;
+        int         low_ms        = 200;
+        int         throttle_kbps = 0; // sends no faster than this, for testing without a slow uplink
+    };
+
+    explicit GstAbr(Settings settings);
+
+    GstAbr(const GstAbr&)            = delete;
+    GstAbr& operator=(const GstAbr&) = delete;
+
+    static bool supports(const std::string& codec);
+
+    // Scaler in front of the encoder, and the queue (and throttle) in front of the sink
+    std::string scale_description() const;
+    std::string queue_description() const;
+
+    // Finds the elements of the descriptions and the encoder once the pipeline exists
+    void attach(GstElement* pipeline);
+
+    // After the encoder was replaced, or the output with the queue by another one
+    void set_encoder(GstElement* encoder);
+    void watch_output(GstElement* bin);
+
+    // A bitrate given while running, which becomes the maximum
+    void set_max_bitrate(int kbps);
+
+    // Runs the control loop, at most once a second
+    void update();
+
+    void      set_throttle(int kbps) { throttle_kbps_ = kbps; }
+    abr_stats stats() const;
+
+  private:
+    static GstPadProbeReturn queue_output(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    static void              throttle(GstElement* identity, GstBuffer* buffer, gpointer user_data);
+
+    void apply_bitrate(int kbps);
+    void set_bitrate(int kbps);
+    void set_rung(int rung);
+    void set_state(const std::string& state);
+
+    const Settings settings_;
+    int            min_kbps_;
+    int            max_kbps_;
+
+    gst_ptr<GstElement> encoder_;
+    gst_ptr<GstElement> caps_;
+    gst_ptr<GstElement> queue_;
+
+    std::chrono::steady_clock::time_point last_update_;
+    int                                   congested_seconds_ = 0;
+    int                                   calm_seconds_      = 0;
+    int                                   since_change_      = 0;
+
+    // Counted by the sink's streaming thread
+    std::atomic<int64_t>                  sent_bytes_{0};
+    std::atomic<int64_t>                  send_time_us_{0};
+    std::atomic<int64_t>                  send_count_{0};
+    std::chrono::steady_clock::time_point last_push_;
+
+    std::atomic<int>                      throttle_kbps_{0};
+    std::chrono::steady_clock::time_point throttle_next_;
+
+    mutable std::mutex mutex_;
+    abr_stats          stats_;
+};
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,202 @@
+#include "gst_conversion_cache.h"
+
+#include "../util/gst_allocator.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/scope_exit.h>
+
+#include <algorithm>
+
+namespace caspar { namespace gstreamer {
+
+namespace {
+
+std::mutex                                       registry_mutex;
+std::map<int, std::weak_ptr<GstConversionCache>> registry;
+
+// Frames kept converted, enough for consumers a few frames apart to find them. Consumers further
+// behind, such as a file consumer catching up, convert on their own.
+const size_t max_entries = 8;
+
+void unref_sample(GstSample* sample)
+{
+    if (sample) {
+        gst_sample_unref(sample);
+    }
+}
+
+} // namespace
+
+std::shared_ptr<GstConversionCache> GstConversionCache::for_channel(int channel_index, int threads)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    auto                        cache = registry[channel_index].lock();
+    if (!cache) {
+        cache                   = std::make_shared<GstConversionCache>(threads);
+        registry[channel_index] = cache;
+    }
+    return cache;
+}
+
+GstConversionCache::GstConversionCache(int threads)
+    : threads_(std::max(threads, 1))
+{
+}
+
+GstConversionCache::~GstConversionCache()
+{
+    for (auto& converter : converters_) {
+        gst_video_converter_free(converter.second->converter);
+    }
+}
+
+GstSample* GstConversionCache::convert(const core::const_frame&       frame,
+                                       const core::video_format_desc& format_desc,
+                                       GstVideoFormat                 format)
+{
+    const auto key = frame.image_data(0).begin();
+
+    std::shared_future<std::shared_ptr<GstSample>> result;
+    std::promise<std::shared_ptr<GstSample>>       promise;
+    bool                                           first = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = std::find_if(entries_.begin(), entries_.end(), [&](const entry& e) {
+            return e.format == format && e.frame.image_data(0).begin() == key;
+        });
+        if (it != entries_.end()) {
+            result = it->sample;
+            hits_++;
+        } else {
+            first  = true;
+            result = promise.get_future().share();
+            entries_.push_back(entry{frame, format, result});
+            if (entries_.size() > max_entries) {
+                entries_.pop_front();
+            }
+        }
+    }
+
+    // Converted outside the lock, consumers asking for the same frame meanwhile wait for it
+    if (first) {
+        try {
+            promise.set_value(std::shared_ptr<GstSample>(do_convert(frame, format_desc, format), &unref_sample));
+            conversions_++;
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+    }
+
+    auto converted = result.get();
+    if (!converted) {
+        return nullptr;
+    }
+
+    // The memory is shared, the buffer isn't, each consumer sets its own timestamps
+    GstBuffer* buffer = gst_buffer_copy(gst_sample_get_buffer(converted.get()));
+    GstSample* sample = gst_sample_new(buffer, gst_sample_get_caps(converted.get()), nullptr, nullptr);
+    gst_buffer_unref(buffer);
+    return sample;
+}
+
+GstSample* GstConversionCache::do_convert(const core::const_frame&       frame,
+                                          const core::video_format_desc& format_desc,
+                                          GstVideoFormat                 format)
+{
+    const auto&  pix_desc  = frame.pixel_format_desc();
+    const auto   in_format = pixel_format_to_gst(pix_desc.format, pix_desc.planes[0].depth);
+    GstVideoInfo in_info;
+    gst_video_info_init(&in_info);
+    if (in_format != GST_VIDEO_FORMAT_UNKNOWN) {
+        gst_video_info_set_format(&in_info, in_format, format_desc.width, format_desc.height);
+    }
+
+    // Packed frames are read where they are, others are copied into a buffer first
+    gst_ptr<GstSample> copied;
+    GstBuffer*         in_buffer = nullptr;
+    if (in_format != GST_VIDEO_FORMAT_UNKNOWN && pix_desc.planes.size() == 1 &&
+        pix_desc.planes[0].linesize == in_info.stride[0] && frame.image_data(0).size() >= in_info.size) {
+        in_buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY,
+                                                const_cast<uint8_t*>(frame.image_data(0).begin()),
+                                                in_info.size, 0, in_info.size, nullptr, nullptr);
+    } else {
+        auto sample = make_gst_sample(frame, format_desc);
+        if (!sample) {
+            return nullptr;
+        }
+        copied = make_gst_ptr<GstSample>(sample);
+        gst_video_info_from_caps(&in_info, gst_sample_get_caps(sample));
+        in_buffer = gst_buffer_ref(gst_sample_get_buffer(sample));
+    }
+    CASPAR_SCOPE_EXIT { gst_buffer_unref(in_buffer); };
+
+    GstVideoInfo out_info;
+    gst_video_info_set_format(&out_info, format, format_desc.width, format_desc.height);
+    auto conv = find_converter(in_info, out_info);
+
+    GstAllocator* allocator  = frame_allocator();
+    GstBuffer*    out_buffer = gst_buffer_new_allocate(allocator, out_info.size, nullptr);
+    if (allocator) {
+        gst_object_unref(allocator);
+    }
+    if (!out_buffer) {
+        CASPAR_LOG(error) << "Failed to allocate GstBuffer";
+        return nullptr;
+    }
+
+    GstVideoFrame in_frame;
+    GstVideoFrame out_frame;
+    if (!gst_video_frame_map(&in_frame, &in_info, in_buffer, GST_MAP_READ)) {
+        gst_buffer_unref(out_buffer);
+        return nullptr;
+    }
+    if (!gst_video_frame_map(&out_frame, &out_info, out_buffer, GST_MAP_WRITE)) {
+        gst_video_frame_unmap(&in_frame);
+        gst_buffer_unref(out_buffer);
+        return nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(conv->mutex);
+        gst_video_converter_frame(conv->converter, &in_frame, &out_frame);
+    }
+    gst_video_frame_unmap(&out_frame);
+    gst_video_frame_unmap(&in_frame);
+
+    GstCaps*   caps   = gst_video_info_to_caps(&out_info);
+    GstSample* sample = gst_sample_new(out_buffer, caps, nullptr, nullptr);
+    gst_buffer_unref(out_buffer);
+    gst_caps_unref(caps);
+    return sample;
+}
+
+std::shared_ptr<GstConversionCache::converter> GstConversionCache::find_converter(const GstVideoInfo& in,
+                                                                                   const GstVideoInfo& out)
+{
+    const auto key = std::make_tuple(static_cast<int>(GST_VIDEO_INFO_FORMAT(&in)),
+                                     static_cast<int>(GST_VIDEO_INFO_FORMAT(&out)),
+                                     GST_VIDEO_INFO_WIDTH(&in),
+                                     GST_VIDEO_INFO_HEIGHT(&in));
+
+    std::lock_guard<std::mutex> lock(converters_mutex_);
+    auto&                       conv = converters_[key];
+    if (!conv) {
+        // Sliced over the threads like videoconvert's n-threads, with its default matrix and dither
+        auto config = gst_structure_new("GstVideoConverter",
+                                        GST_VIDEO_CONVERTER_OPT_THREADS, G_TYPE_UINT, static_cast<guint>(threads_),
+                                        nullptr);
+        auto created = std::make_shared<converter>();
+        created->converter = gst_video_converter_new(const_cast<GstVideoInfo*>(&in), const_cast<GstVideoInfo*>(&out),
+                                                     config);
+        if (!created->converter) {
+            converters_.erase(key);
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(std::string("No conversion to ") +
+                                                                  gst_video_format_to_string(
+                                                                      GST_VIDEO_INFO_FORMAT(&out))));
+        }
+        conv = created;
+    }
+    return conv;
+}
+
+}} // namespace caspar::gstreamer
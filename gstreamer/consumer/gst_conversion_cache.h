@@ -0,0 +1,78 @@
+#pragma once
+
+#include "../util/gst_util.h"
+
+#include <core/frame/frame.h>
+#include <core/video_format.h>
+
+#include <gst/video/video.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+namespace caspar { namespace gstreamer {
+
+// Colour conversion of a channel's frames shared by its consumers. The first consumer asking for
+// a frame in a format converts it, the others get the same memory in a buffer of their own, so a
+// channel recorded and streamed at once converts each frame once per format. Entries are keyed on
+// the frame's image data and hold the frame, so the key isn't reused while they are cached.
+class GstConversionCache
+{
+  public:
+    // The cache of a channel, shared while any of its consumers holds it
+    static std::shared_ptr<GstConversionCache> for_channel(int channel_index, int threads);
+
+    explicit GstConversionCache(int threads);
+    ~GstConversionCache();
+
+    GstConversionCache(const GstConversionCache&)            = delete;
+    GstConversionCache& operator=(const GstConversionCache&) = delete;
+
+    // The frame in the format, a sample owned by the caller with a buffer of its own for the
+    // timestamps. Null when the frame can't be converted.
+    GstSample* convert(const core::const_frame&       frame,
+                       const core::video_format_desc& format_desc,
+                       GstVideoFormat                 format);
+
+    int64_t conversions() const { return conversions_; }
+    int64_t hits() const { return hits_; }
+
+  private:
+    struct entry
+    {
+        core::const_frame                              frame;
+        GstVideoFormat                                 format;
+        std::shared_future<std::shared_ptr<GstSample>> sample;
+    };
+
+    struct converter
+    {
+        std::mutex         mutex;
+        GstVideoConverter* converter = nullptr;
+    };
+
+    GstSample* do_convert(const core::const_frame&       frame,
+                          const core::video_format_desc& format_desc,
+                          GstVideoFormat                 format);
+
+    std::shared_ptr<converter> find_converter(const GstVideoInfo& in, const GstVideoInfo& out);
+
+    const int threads_;
+
+    std::mutex        mutex_;
+    std::deque<entry> entries_;
+
+    std::mutex                                                           converters_mutex_;
+    std::map<std::tuple<int, int, int, int>, std::shared_ptr<converter>> converters_;
+
+    std::atomic<int64_t> conversions_{0};
+    std::atomic<int64_t> hits_{0};
+};
+
+}} // namespace caspar::gstreamer
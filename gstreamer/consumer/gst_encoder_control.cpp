@@ -0,0 +1,219 @@
+#include "gst_encoder_control.h"
+
+#include <common/except.h>
+#include <common/log.h>
+
+namespace caspar { namespace gstreamer {
+
+namespace {
+
+GstPadProbeReturn drop_eos(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    auto event = GST_PAD_PROBE_INFO_EVENT(info);
+    return event && GST_EVENT_TYPE(event) == GST_EVENT_EOS ? GST_PAD_PROBE_DROP : GST_PAD_PROBE_OK;
+}
+
+// A new encoder of the same kind with all the settings of the running one
+gst_ptr<GstElement> copy_encoder(GstElement* encoder)
+{
+    auto factory = gst_element_get_factory(encoder);
+    auto copy    = factory ? gst_element_factory_create(factory, nullptr) : nullptr;
+    if (!copy) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to create a copy of the encoder"));
+    }
+    gst_object_ref_sink(copy);
+
+    guint       count  = 0;
+    GParamSpec** specs = g_object_class_list_properties(G_OBJECT_GET_CLASS(encoder), &count);
+    for (guint n = 0; n < count; ++n) {
+        const auto spec = specs[n];
+        if ((spec->flags & G_PARAM_READWRITE) != G_PARAM_READWRITE || (spec->flags & G_PARAM_CONSTRUCT_ONLY) ||
+            g_str_equal(spec->name, "name") || g_str_equal(spec->name, "parent")) {
+            continue;
+        }
+        GValue value = G_VALUE_INIT;
+        g_value_init(&value, spec->value_type);
+        g_object_get_property(G_OBJECT(encoder), spec->name, &value);
+        g_object_set_property(G_OBJECT(copy), spec->name, &value);
+        g_value_unset(&value);
+    }
+    g_free(specs);
+
+    return make_gst_ptr<GstElement>(copy);
+}
+
+} // namespace
+
+std::pair<std::string, std::string> encoder_bitrate_property(const std::string& codec, int kbps)
+{
+    if (codec == "openh264") {
+        return {"bitrate", std::to_string(kbps * 1000)};
+    }
+    if (codec == "vp8" || codec == "vp9") {
+        return {"target-bitrate", std::to_string(kbps * 1000)};
+    }
+    return {"bitrate", std::to_string(kbps)};
+}
+
+std::string encoder_keyint_property(const std::string& codec)
+{
+    if (codec == "x264" || codec == "libx264") {
+        return "key-int-max";
+    }
+    if (codec == "openh264" || codec == "nvenc" || codec == "nvh264") {
+        return "gop-size";
+    }
+    if (codec == "vp8" || codec == "vp9") {
+        return "keyframe-max-dist";
+    }
+    return "";
+}
+
+GstEncoderControl::GstEncoderControl(GstElement* encoder)
+    : encoder_(make_gst_ptr<GstElement>(GST_ELEMENT(gst_object_ref(encoder))))
+{
+}
+
+GstEncoderControl::~GstEncoderControl()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (probe_ != 0 && probe_pad_) {
+        gst_pad_remove_probe(probe_pad_.get(), probe_);
+    }
+}
+
+bool GstEncoderControl::set(const std::vector<std::pair<std::string, std::string>>& properties)
+{
+    GstPad* upstream = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto live = !replacement_;
+        for (const auto& property : properties) {
+            auto spec = g_object_class_find_property(G_OBJECT_GET_CLASS(encoder_.get()), property.first.c_str());
+            if (!spec || !(spec->flags & G_PARAM_WRITABLE)) {
+                CASPAR_THROW_EXCEPTION(invalid_argument()
+                                       << msg_info("The encoder has no property " + property.first));
+            }
+            live = live && (spec->flags & GST_PARAM_MUTABLE_PLAYING);
+        }
+
+        if (live) {
+            for (const auto& property : properties) {
+                gst_util_set_object_arg(G_OBJECT(encoder_.get()), property.first.c_str(), property.second.c_str());
+            }
+            return true;
+        }
+
+        // A replacement already waiting takes these too
+        const bool waiting = static_cast<bool>(replacement_);
+        if (!waiting) {
+            replacement_ = copy_encoder(encoder_.get());
+        }
+        for (const auto& property : properties) {
+            gst_util_set_object_arg(G_OBJECT(replacement_.get()), property.first.c_str(), property.second.c_str());
+        }
+        if (waiting) {
+            return false;
+        }
+
+        GstPad* sink = gst_element_get_static_pad(encoder_.get(), "sink");
+        upstream     = sink ? gst_pad_get_peer(sink) : nullptr;
+        if (sink) {
+            gst_object_unref(sink);
+        }
+        if (!upstream) {
+            replacement_.reset();
+            CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info("The encoder isn't linked"));
+        }
+        probe_pad_ = make_gst_ptr<GstPad>(upstream);
+    }
+
+    // Called right away when the pad is idle, so outside the lock
+    const auto probe = gst_pad_add_probe(upstream, GST_PAD_PROBE_TYPE_IDLE, &GstEncoderControl::replace, this, nullptr);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (replacement_) {
+        probe_ = probe;
+    }
+    return false;
+}
+
+GstPadProbeReturn GstEncoderControl::replace(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    auto                        self = static_cast<GstEncoderControl*>(user_data);
+    std::lock_guard<std::mutex> lock(self->mutex_);
+    if (!self->replacement_) {
+        return GST_PAD_PROBE_REMOVE;
+    }
+
+    auto previous = self->encoder_;
+    auto old      = previous.get();
+    auto next     = self->replacement_.get();
+    auto bin      = GST_BIN(GST_ELEMENT_PARENT(old));
+
+    GstPad* old_sink   = gst_element_get_static_pad(old, "sink");
+    GstPad* old_src    = gst_element_get_static_pad(old, "src");
+    GstPad* downstream = gst_pad_get_peer(old_src);
+
+    // The frames the old encoder still holds go out ahead of the new one's, its EOS stops here
+    gst_pad_unlink(pad, old_sink);
+    gst_pad_add_probe(old_src, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, &drop_eos, nullptr, nullptr);
+    gst_pad_send_event(old_sink, gst_event_new_eos());
+    gst_pad_unlink(old_src, downstream);
+
+    gst_element_set_state(old, GST_STATE_NULL);
+    gst_bin_remove(bin, old);
+    gst_bin_add(bin, next);
+
+    GstPad* next_sink = gst_element_get_static_pad(next, "sink");
+    GstPad* next_src  = gst_element_get_static_pad(next, "src");
+    if (gst_pad_link(pad, next_sink) != GST_PAD_LINK_OK || gst_pad_link(next_src, downstream) != GST_PAD_LINK_OK) {
+        CASPAR_LOG(error) << "[gstreamer] Failed to link the replacement encoder.";
+    }
+    gst_element_sync_state_with_parent(next);
+
+    gst_object_unref(next_src);
+    gst_object_unref(next_sink);
+    gst_object_unref(downstream);
+    gst_object_unref(old_src);
+    gst_object_unref(old_sink);
+
+    self->encoder_  = self->replacement_;
+    self->replaced_ = self->replacement_;
+    self->replacement_.reset();
+    self->probe_ = 0;
+    self->probe_pad_.reset();
+    self->replacements_++;
+
+    CASPAR_LOG(info) << "[gstreamer] Replaced the encoder " << GST_ELEMENT_NAME(old) << " with "
+                     << GST_ELEMENT_NAME(next) << ".";
+    return GST_PAD_PROBE_REMOVE;
+}
+
+void GstEncoderControl::force_keyframe()
+{
+    gst_ptr<GstElement> encoder;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        encoder = encoder_;
+    }
+    // Upstream into the encoder from its source pad, all_headers repeats the parameter sets
+    gst_element_send_event(encoder.get(), gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+}
+
+gst_ptr<GstElement> GstEncoderControl::take_replacement()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto                        replaced = std::move(replaced_);
+    replaced_.reset();
+    return replaced;
+}
+
+int64_t GstEncoderControl::replacements() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return replacements_;
+}
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../util/gst_util.h"
+
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace caspar { namespace gstreamer {
+
+// Property of the codec's encoder for a bitrate in kbps, and its value. openh264 and libvpx take
+// bits per second.
+std::pair<std::string, std::string> encoder_bitrate_property(const std::string& codec, int kbps);
+
+// Property of the codec's encoder for the keyframe interval in frames, empty when it has none
+std::string encoder_keyint_property(const std::string& codec);
+
+// Changes the properties of a consumer's running encoder. Properties the encoder takes while
+// playing are set right away. For the others a copy of the encoder with the new values replaces
+// it between two frames: once the pad in front of it is idle the old encoder is drained, so no
+// frame is lost, and the copy is linked in its place, starting on a keyframe.
+class GstEncoderControl
+{
+  public:
+    explicit GstEncoderControl(GstElement* encoder);
+    ~GstEncoderControl();
+
+    GstEncoderControl(const GstEncoderControl&)            = delete;
+    GstEncoderControl& operator=(const GstEncoderControl&) = delete;
+
+    // Name and value pairs, as in a pipeline description. True when they were set on the
+    // running encoder, false when it is being replaced.
+    bool set(const std::vector<std::pair<std::string, std::string>>& properties);
+
+    // The next frame is encoded as a keyframe, with parameter sets for H.264
+    void force_keyframe();
+
+    // The encoder that took over since the last call, once, so it can be watched
+    gst_ptr<GstElement> take_replacement();
+
+    int64_t replacements() const;
+
+  private:
+    static GstPadProbeReturn replace(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+
+    mutable std::mutex  mutex_;
+    gst_ptr<GstElement> encoder_;
+    gst_ptr<GstElement> replacement_; // linked in once the pad in front of the encoder is idle
+    gst_ptr<GstElement> replaced_;    // for take_replacement
+    gulong              probe_        = 0;
+    gst_ptr<GstPad>     probe_pad_;
+    int64_t             replacements_ = 0;
+};
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,189 @@
+#include "gst_output_branches.h"
+
+#include "../util/gst_assert.h"
+
+#include <common/log.h>
+
+#include <algorithm>
+
+namespace caspar { namespace gstreamer {
+
+namespace {
+
+// A removed output whose EOS hasn't reached the sink by then is taken out anyway
+const auto drain_timeout = std::chrono::seconds(5);
+
+GstPadProbeReturn sink_eos(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    auto event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (event && GST_EVENT_TYPE(event) == GST_EVENT_EOS) {
+        (*static_cast<std::shared_ptr<std::atomic<bool>>*>(user_data))->store(true);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+void delete_flag(gpointer user_data) { delete static_cast<std::shared_ptr<std::atomic<bool>>*>(user_data); }
+
+} // namespace
+
+GstOutputBranches::GstOutputBranches(GstElement* pipeline, GstElement* tee)
+    : pipeline_(pipeline)
+    , tee_(make_gst_ptr<GstElement>(GST_ELEMENT(gst_object_ref(tee))))
+{
+    g_object_set(tee_.get(), "allow-not-linked", TRUE, nullptr);
+}
+
+GstOutputBranches::~GstOutputBranches()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& branch : draining_) {
+        release(branch);
+    }
+}
+
+GstElement* GstOutputBranches::add(const std::string& path, const std::string& description)
+{
+    GError* error = nullptr;
+    auto    bin   = gst_parse_bin_from_description(description.c_str(), TRUE, &error);
+    if (error) {
+        const std::string message = error->message;
+        g_error_free(error);
+        CASPAR_THROW_EXCEPTION(gstreamer_error_t() << gstreamer_error_info("Failed to create output: " + message)
+                                                   << boost::errinfo_api_function("gst_parse_bin_from_description"));
+    }
+    gst_object_ref_sink(bin);
+
+    branch added;
+    added.path = path;
+    added.bin  = make_gst_ptr<GstElement>(bin);
+    added.done = std::make_shared<std::atomic<bool>>(false);
+
+#if GST_CHECK_VERSION(1, 20, 0)
+    added.tee_pad = make_gst_ptr<GstPad>(gst_element_request_pad_simple(tee_.get(), "src_%u"));
+#else
+    added.tee_pad = make_gst_ptr<GstPad>(gst_element_get_request_pad(tee_.get(), "src_%u"));
+#endif
+
+    gst_bin_add(GST_BIN(pipeline_), bin);
+    gst_element_sync_state_with_parent(bin);
+
+    GstPad* sink = gst_element_get_static_pad(bin, "sink");
+    gst_pad_add_probe(added.tee_pad.get(), GST_PAD_PROBE_TYPE_BUFFER, &GstOutputBranches::skip_to_keyframe, nullptr,
+                      nullptr);
+    const bool linked = sink && gst_pad_link(added.tee_pad.get(), sink) == GST_PAD_LINK_OK;
+    if (sink) {
+        gst_object_unref(sink);
+    }
+    if (!linked) {
+        gst_element_set_state(bin, GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(pipeline_), bin);
+        gst_element_release_request_pad(tee_.get(), added.tee_pad.get());
+        CASPAR_THROW_EXCEPTION(gstreamer_error_t() << gstreamer_error_info("Failed to link output " + path));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    branches_.push_back(std::move(added));
+    return bin;
+}
+
+GstPadProbeReturn GstOutputBranches::skip_to_keyframe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    auto buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (buffer && GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        return GST_PAD_PROBE_DROP;
+    }
+    return GST_PAD_PROBE_REMOVE;
+}
+
+void GstOutputBranches::remove(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::find_if(branches_.begin(), branches_.end(), [&](const branch& b) { return b.path == path; });
+    if (it == branches_.end()) {
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("No output " + path));
+    }
+
+    // Sinks report the EOS they got, the bin is finished then
+    GstIterator* sinks = gst_bin_iterate_sinks(GST_BIN(it->bin.get()));
+    GValue       item  = G_VALUE_INIT;
+    while (gst_iterator_next(sinks, &item) == GST_ITERATOR_OK) {
+        GstPad* pad = gst_element_get_static_pad(GST_ELEMENT(g_value_get_object(&item)), "sink");
+        if (pad) {
+            gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, &sink_eos,
+                              new std::shared_ptr<std::atomic<bool>>(it->done), &delete_flag);
+            gst_object_unref(pad);
+        }
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(sinks);
+
+    it->removed = std::chrono::steady_clock::now();
+    draining_.push_back(*it);
+    branches_.erase(it);
+
+    // Between two buffers, so the output ends on a whole one
+    gst_pad_add_probe(draining_.back().tee_pad.get(), GST_PAD_PROBE_TYPE_IDLE, &GstOutputBranches::cut,
+                      gst_object_ref(draining_.back().bin.get()), gst_object_unref);
+}
+
+GstPadProbeReturn GstOutputBranches::cut(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    GstPad* sink = gst_element_get_static_pad(GST_ELEMENT(user_data), "sink");
+    if (sink) {
+        gst_pad_unlink(pad, sink);
+        gst_pad_send_event(sink, gst_event_new_eos());
+        gst_object_unref(sink);
+    }
+    return GST_PAD_PROBE_REMOVE;
+}
+
+bool GstOutputBranches::contains(const std::string& path) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::any_of(branches_.begin(), branches_.end(), [&](const branch& b) { return b.path == path; });
+}
+
+std::vector<std::string> GstOutputBranches::paths() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string>    paths;
+    for (const auto& branch : branches_) {
+        paths.push_back(branch.path);
+    }
+    return paths;
+}
+
+size_t GstOutputBranches::draining() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return draining_.size();
+}
+
+void GstOutputBranches::reap()
+{
+    const auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = draining_.begin(); it != draining_.end();) {
+        if (!it->done->load() && now - it->removed < drain_timeout) {
+            ++it;
+            continue;
+        }
+        if (!it->done->load()) {
+            CASPAR_LOG(warning) << "[gstreamer] Output " << it->path << " didn't finish in time, removing it anyway.";
+        }
+        release(*it);
+        it = draining_.erase(it);
+    }
+}
+
+void GstOutputBranches::release(branch& branch)
+{
+    gst_element_set_state(branch.bin.get(), GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(pipeline_), branch.bin.get());
+    gst_element_release_request_pad(tee_.get(), branch.tee_pad.get());
+    CASPAR_LOG(info) << "[gstreamer] Removed output " << branch.path << ".";
+}
+
+}} // namespace caspar::gstreamer
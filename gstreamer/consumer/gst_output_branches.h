@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../util/gst_util.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace gstreamer {
+
+// Outputs of a consumer fed from a tee after its encoder, each a bin of queue, parser, muxer and
+// sink that can be added to and removed from the running pipeline. An added output skips the
+// stream up to its next keyframe. A removed one is cut off at the tee while the pad is idle and
+// gets EOS, so its file is finished, and it leaves the pipeline once that got through.
+class GstOutputBranches
+{
+  public:
+    GstOutputBranches(GstElement* pipeline, GstElement* tee);
+    ~GstOutputBranches();
+
+    GstOutputBranches(const GstOutputBranches&)            = delete;
+    GstOutputBranches& operator=(const GstOutputBranches&) = delete;
+
+    // The bin of the description, linked to the tee
+    GstElement* add(const std::string& path, const std::string& description);
+    void        remove(const std::string& path);
+
+    bool                     contains(const std::string& path) const;
+    std::vector<std::string> paths() const;
+    size_t                   draining() const;
+
+    // Takes out the removed outputs that finished, or gave up waiting for their EOS
+    void reap();
+
+  private:
+    struct branch
+    {
+        std::string         path;
+        gst_ptr<GstElement> bin;
+        gst_ptr<GstPad>     tee_pad;
+
+        std::shared_ptr<std::atomic<bool>>    done;
+        std::chrono::steady_clock::time_point removed;
+    };
+
+    static GstPadProbeReturn skip_to_keyframe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    static GstPadProbeReturn cut(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+
+    void release(branch& branch);
+
+    GstElement* const   pipeline_;
+    gst_ptr<GstElement> tee_;
+
+    mutable std::mutex  mutex_;
+    std::vector<branch> branches_;
+    std::vector<branch> draining_;
+};
+
+}} // namespace caspar::gstreamer
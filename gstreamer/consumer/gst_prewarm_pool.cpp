@@ -0,0 +1,311 @@
+#include "gst_prewarm_pool.h"
+
+#include "gstreamer_consumer.h"
+
+#include "../util/gst_thread.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace caspar { namespace gstreamer {
+
+namespace {
+
+struct profile_state
+{
+    int                                   count    = 1;
+    bool                                  declared = false;
+    bool                                  failed   = false; // not built again once it didn't
+    int                                   building = 0;
+    std::deque<gst_ptr<GstElement>>       ready;
+    std::chrono::steady_clock::time_point used;
+};
+
+using profile_key = std::pair<int, std::string>;
+
+void stop_pipelines(std::deque<gst_ptr<GstElement>>& pipelines)
+{
+    for (auto& pipeline : pipelines) {
+        gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+    }
+    pipelines.clear();
+}
+
+class prewarm_pool
+{
+  public:
+    prewarm_pool(std::vector<prewarm_profile> profiles, int learned_count, int max_profiles)
+        : declared_(std::move(profiles))
+        , learned_count_(learned_count)
+        , max_profiles_(static_cast<size_t>(std::max(max_profiles, 0)))
+    {
+        thread_ = boost::thread([this] {
+            try {
+                set_thread_name(L"[gstreamer::prewarm]");
+                thread_placement placement;
+                placement.background = true;
+                apply_thread_placement(placement);
+                run();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+    }
+
+    ~prewarm_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_request_ = true;
+            cond_.notify_all();
+        }
+        thread_.join();
+
+        for (auto& profile : profiles_) {
+            stop_pipelines(profile.second.ready);
+        }
+    }
+
+    void prime(int channel_index, const core::video_format_desc& format_desc)
+    {
+        const auto placement = channel_placement(channel_index);
+        const int  threads   = placement.cpus.empty() ? static_cast<int>(std::thread::hardware_concurrency())
+                                                      : static_cast<int>(placement.cpus.size());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // Pipelines for a format the channel no longer has are left to the least recently used
+        std::vector<std::string> descriptions;
+        for (const auto& declared : declared_) {
+            if (declared.channel == channel_index) {
+                descriptions.push_back(
+                    encoder_pipeline_description(parse_consumer_options(declared.args), declared.path, format_desc, threads));
+            }
+        }
+        for (auto& profile : profiles_) {
+            if (profile.first.first == channel_index &&
+                std::find(descriptions.begin(), descriptions.end(), profile.first.second) == descriptions.end()) {
+                profile.second.declared = false;
+            }
+        }
+
+        size_t n = 0;
+        for (const auto& declared : declared_) {
+            if (declared.channel != channel_index) {
+                continue;
+            }
+
+            const auto& description = descriptions[n++];
+            if (description.empty()) {
+                continue;
+            }
+
+            auto& profile = profiles_[{channel_index, description}];
+            if (!profile.declared) {
+                profile.declared = true;
+                profile.count    = std::max(declared.count, 1);
+                profile.used     = std::chrono::steady_clock::now();
+                CASPAR_LOG(info) << "[gstreamer] Keeping " << profile.count << " pipeline(s) ready on channel "
+                                 << channel_index << " for \"" << declared.args << "\".";
+            }
+        }
+        cond_.notify_all();
+    }
+
+    gst_ptr<GstElement> take(int channel_index, const std::string& description)
+    {
+        std::deque<gst_ptr<GstElement>> evicted;
+        gst_ptr<GstElement>             pipeline;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        it = profiles_.find({channel_index, description});
+            if (it == profiles_.end() && learned_count_ > 0) {
+                it               = profiles_.emplace(profile_key{channel_index, description}, profile_state{}).first;
+                it->second.count = learned_count_;
+                evict(it->first, evicted);
+            }
+            if (it != profiles_.end()) {
+                it->second.used = std::chrono::steady_clock::now();
+                if (!it->second.ready.empty()) {
+                    pipeline = std::move(it->second.ready.front());
+                    it->second.ready.pop_front();
+                }
+            }
+            if (pipeline) {
+                stats_.hits++;
+            } else {
+                stats_.misses++;
+            }
+            cond_.notify_all();
+        }
+        stop_pipelines(evicted);
+        return pipeline;
+    }
+
+    prewarm_stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        stats = stats_;
+        stats.profiles                    = static_cast<int>(profiles_.size());
+        for (const auto& profile : profiles_) {
+            stats.ready += static_cast<int>(profile.second.ready.size());
+        }
+        return stats;
+    }
+
+  private:
+    // The least recently used learned profiles beyond the maximum, the configured ones stay
+    void evict(const profile_key& keep, std::deque<gst_ptr<GstElement>>& evicted)
+    {
+        while (true) {
+            size_t learned = 0;
+            auto   oldest  = profiles_.end();
+            for (auto it = profiles_.begin(); it != profiles_.end(); ++it) {
+                if (it->second.declared) {
+                    continue;
+                }
+                learned++;
+                if (it->first != keep && it->second.building == 0 &&
+                    (oldest == profiles_.end() || it->second.used < oldest->second.used)) {
+                    oldest = it;
+                }
+            }
+            if (learned <= max_profiles_ || oldest == profiles_.end()) {
+                return;
+            }
+            for (auto& pipeline : oldest->second.ready) {
+                evicted.push_back(std::move(pipeline));
+            }
+            profiles_.erase(oldest);
+        }
+    }
+
+    void run()
+    {
+        while (true) {
+            profile_key key;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                auto                         next = profiles_.end();
+                cond_.wait(lock, [&] {
+                    next = std::find_if(profiles_.begin(), profiles_.end(), [](const auto& profile) {
+                        return !profile.second.failed &&
+                               static_cast<int>(profile.second.ready.size()) + profile.second.building <
+                                   profile.second.count;
+                    });
+                    return abort_request_ || next != profiles_.end();
+                });
+                if (abort_request_) {
+                    return;
+                }
+                key = next->first;
+                next->second.building++;
+            }
+
+            gst_ptr<GstElement> pipeline;
+            try {
+                pipeline = create_pipeline(key.second);
+                if (gst_element_set_state(pipeline.get(), GST_STATE_READY) == GST_STATE_CHANGE_FAILURE) {
+                    gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+                    pipeline.reset();
+                }
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                pipeline.reset();
+            }
+
+            std::deque<gst_ptr<GstElement>> unused;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto                        it = profiles_.find(key);
+                if (it != profiles_.end()) {
+                    it->second.building--;
+                    if (!pipeline) {
+                        it->second.failed = true;
+                        CASPAR_LOG(warning) << "[gstreamer] Failed to build a pipeline ahead on channel " << key.first
+                                            << ", consumers with its options build their own.";
+                    } else {
+                        it->second.ready.push_back(pipeline);
+                        stats_.built++;
+                    }
+                } else if (pipeline) {
+                    unused.push_back(pipeline);
+                }
+            }
+            stop_pipelines(unused);
+        }
+    }
+
+    const std::vector<prewarm_profile> declared_;
+    const int                          learned_count_;
+    const size_t                       max_profiles_;
+
+    mutable std::mutex                   mutex_;
+    std::condition_variable              cond_;
+    std::map<profile_key, profile_state> profiles_;
+    prewarm_stats                        stats_;
+    bool                                 abort_request_ = false;
+    boost::thread                        thread_;
+};
+
+std::mutex                    pool_mutex;
+std::shared_ptr<prewarm_pool> pool;
+
+std::shared_ptr<prewarm_pool> get_pool()
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    return pool;
+}
+
+} // namespace
+
+void init_prewarm_pool(std::vector<prewarm_profile> profiles, int learned_count, int max_profiles)
+{
+    auto created = std::make_shared<prewarm_pool>(std::move(profiles), learned_count, max_profiles);
+
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    pool = std::move(created);
+}
+
+void uninit_prewarm_pool()
+{
+    // Stopped outside the lock, consumers still starting see no pool meanwhile
+    std::shared_ptr<prewarm_pool> stopped;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        stopped.swap(pool);
+    }
+}
+
+void prime_prewarm_pool(int channel_index, const core::video_format_desc& format_desc)
+{
+    if (auto p = get_pool()) {
+        p->prime(channel_index, format_desc);
+    }
+}
+
+gst_ptr<GstElement> take_prewarmed_pipeline(int channel_index, const std::string& description)
+{
+    auto p = get_pool();
+    return p ? p->take(channel_index, description) : nullptr;
+}
+
+prewarm_stats get_prewarm_stats()
+{
+    auto p = get_pool();
+    return p ? p->stats() : prewarm_stats{};
+}
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "../util/gst_util.h"
+
+#include <core/video_format.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace gstreamer {
+
+// Consumer options whose pipelines are kept ready for a channel
+struct prewarm_profile
+{
+    int         channel = 0;
+    std::string args;      // consumer options, e.g. "-vcodec x264 -vbitrate 8000"
+    std::string path;      // output path or protocol, e.g. "rtmp://", for the options it implies
+    int         count = 1; // pipelines kept ready
+};
+
+struct prewarm_stats
+{
+    int     profiles = 0;
+    int     ready    = 0; // pipelines waiting in READY
+    int64_t built    = 0;
+    int64_t hits     = 0; // consumers that started on a ready pipeline
+    int64_t misses   = 0;
+};
+
+// Consumer pipelines built ahead of time, from the source to the output tee, and kept in READY,
+// so a consumer added with the same options attaches its outputs to one instead of parsing the
+// description and instantiating its elements while the channel runs. The outputs' muxers and
+// sinks are still built when the consumer starts, and caps negotiation and the encoder's own
+// setup happen with the first frame. Pipelines are keyed by channel and their description. The
+// configured profiles are built once the channel's format is known. With a learned_count above
+// 0, every description a consumer asked for is also kept ready for the next one, the least
+// recently used going first beyond max_profiles. Each ready pipeline holds an encoder, for
+// hardware encoders a session, so learning is off by default. A background thread builds them
+// and refills after each take.
+void init_prewarm_pool(std::vector<prewarm_profile> profiles, int learned_count, int max_profiles);
+void uninit_prewarm_pool();
+
+// Starts building the configured profiles of the channel for its format
+void prime_prewarm_pool(int channel_index, const core::video_format_desc& format_desc);
+
+// A ready pipeline of the description, or null when none was built. The description is kept
+// ready for the next consumer either way.
+gst_ptr<GstElement> take_prewarmed_pipeline(int channel_index, const std::string& description);
+
+prewarm_stats get_prewarm_stats();
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,407 @@
+#include "gst_raw_writer.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef CASPAR_GST_IO_URING
+#include <liburing.h>
+#endif
+
+namespace caspar { namespace gstreamer {
+
+namespace {
+
+// Direct I/O needs buffers, sizes and file offsets aligned to the device's block size
+const size_t io_alignment = 4096;
+
+// Frames converted ahead of the disk, about a third of a second at 50 fps
+const size_t buffer_count = 16;
+
+uint8_t* aligned_alloc_frame(size_t size)
+{
+#ifdef _WIN32
+    return static_cast<uint8_t*>(_aligned_malloc(size, io_alignment));
+#else
+    void* data = nullptr;
+    return posix_memalign(&data, io_alignment, size) == 0 ? static_cast<uint8_t*>(data) : nullptr;
+#endif
+}
+
+void aligned_free_frame(uint8_t* data)
+{
+#ifdef _WIN32
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+}
+
+} // namespace
+
+#ifdef CASPAR_GST_IO_URING
+struct GstRawWriter::io_uring_state
+{
+    io_uring ring;
+};
+#endif
+
+GstRawWriter::format GstRawWriter::parse_format(const std::string& name)
+{
+    if (boost::iequals(name, "v210")) {
+        return format::v210;
+    }
+    if (boost::iequals(name, "uyvy")) {
+        return format::uyvy;
+    }
+    if (boost::iequals(name, "bgra")) {
+        return format::bgra;
+    }
+    CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Raw capture supports v210, uyvy and bgra, not " + name));
+}
+
+GstRawWriter::GstRawWriter(const std::string&             path,
+                           format                         video_format,
+                           const core::video_format_desc& format_desc,
+                           const thread_placement&        placement)
+    : format_(video_format)
+    , format_desc_(format_desc)
+    , base_path_(boost::filesystem::path(path).replace_extension("").string())
+{
+    const char* extension  = "bgra";
+    auto        gst_format = GST_VIDEO_FORMAT_BGRA;
+    if (format_ == format::v210) {
+        extension  = "v210";
+        gst_format = GST_VIDEO_FORMAT_v210;
+    } else if (format_ == format::uyvy) {
+        extension  = "uyvy";
+        gst_format = GST_VIDEO_FORMAT_UYVY;
+    }
+
+    gst_video_info_set_format(&in_info_, GST_VIDEO_FORMAT_BGRA, format_desc_.width, format_desc_.height);
+    gst_video_info_set_format(&out_info_, gst_format, format_desc_.width, format_desc_.height);
+
+    if (format_ != format::bgra) {
+        // The channel is BT.709 limited range like the rest of the consumer's output
+        const auto threads = placement.cpus.empty() ? std::thread::hardware_concurrency()
+                                                    : static_cast<unsigned>(placement.cpus.size());
+        converter_ = gst_video_converter_new(&in_info_, &out_info_,
+                                             gst_structure_new("GstVideoConverter",
+                                                               GST_VIDEO_CONVERTER_OPT_THREADS, G_TYPE_UINT,
+                                                               std::max(threads, 1u),
+                                                               nullptr));
+        if (!converter_) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(std::string("No conversion to ") + extension));
+        }
+    }
+
+    slot_size_ = (out_info_.size + io_alignment - 1) / io_alignment * io_alignment;
+    slots_.resize(buffer_count);
+    for (auto& s : slots_) {
+        s.data = aligned_alloc_frame(slot_size_);
+        if (!s.data) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to allocate raw capture buffers"));
+        }
+        // Padding after the frame is written too, keep it zero
+        std::memset(s.data, 0, slot_size_);
+        free_.push_back(&s);
+    }
+
+    const auto video_path = base_path_ + "." + extension;
+#ifdef _WIN32
+    auto handle = CreateFileA(video_path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to open " + video_path));
+    }
+    video_file_ = reinterpret_cast<intptr_t>(handle);
+#else
+    int fd = open(video_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (fd < 0 && errno == EINVAL) {
+        // tmpfs and some network file systems have no direct I/O
+        CASPAR_LOG(warning) << video_path << " doesn't support direct I/O, writing through the page cache.";
+        fd = open(video_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd < 0) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to open " + video_path));
+    }
+    video_file_ = fd;
+#endif
+
+    // Audio is a few hundred kilobytes a second, the page cache is fine for it
+    audio_file_.open(base_path_ + ".pcm", std::ios::binary | std::ios::trunc);
+    index_file_.open(base_path_ + ".idx", std::ios::trunc);
+    if (!audio_file_ || !index_file_) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to open " + base_path_ + ".pcm/.idx"));
+    }
+
+    index_file_ << "# CasparCG raw capture\n"
+                << "video=" << boost::filesystem::path(video_path).filename().string() << " format=" << extension
+                << " width=" << format_desc_.width << " height=" << format_desc_.height
+                << " fps=" << format_desc_.framerate.numerator() << "/" << format_desc_.framerate.denominator()
+                << " frame-size=" << out_info_.size << " frame-stride=" << slot_size_ << "\n"
+                << "audio=" << boost::filesystem::path(base_path_ + ".pcm").filename().string()
+                << " format=s32le channels=" << format_desc_.audio_channels
+                << " rate=" << format_desc_.audio_sample_rate << "\n"
+                << "# frame video-offset audio-offset audio-samples\n";
+
+#ifdef CASPAR_GST_IO_URING
+    ring_ = std::make_unique<io_uring_state>();
+    if (io_uring_queue_init(static_cast<unsigned>(buffer_count), &ring_->ring, 0) < 0) {
+        CASPAR_LOG(warning) << "io_uring is unavailable, raw capture writes one frame at a time.";
+        ring_.reset();
+    }
+#endif
+
+    CASPAR_LOG(info) << "Capturing raw " << extension << " to " << video_path << ", " << slot_size_
+                     << " bytes a frame.";
+
+    thread_ = boost::thread([this, placement] {
+        try {
+            set_thread_name(L"[gstreamer::raw_writer]");
+            apply_thread_placement(placement);
+            run();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    });
+}
+
+GstRawWriter::~GstRawWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        abort_request_ = true;
+    }
+    ready_cond_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+#ifdef CASPAR_GST_IO_URING
+    if (ring_) {
+        io_uring_queue_exit(&ring_->ring);
+    }
+#endif
+
+#ifdef _WIN32
+    CloseHandle(reinterpret_cast<HANDLE>(video_file_));
+#else
+    close(static_cast<int>(video_file_));
+#endif
+
+    for (auto& s : slots_) {
+        aligned_free_frame(s.data);
+    }
+    if (converter_) {
+        gst_video_converter_free(converter_);
+    }
+
+    CASPAR_LOG(info) << "Raw capture to " << base_path_ << " stopped after " << frames_ << " frames, " << dropped_
+                     << " dropped.";
+}
+
+bool GstRawWriter::push(const core::const_frame& frame)
+{
+    slot* s = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_.empty()) {
+            s = free_.front();
+            free_.pop_front();
+        }
+    }
+    if (!s) {
+        ++dropped_;
+        return false;
+    }
+
+    const auto& image = frame.image_data(0);
+    if (converter_) {
+        GstBuffer* in  = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, const_cast<uint8_t*>(image.begin()),
+                                                     in_info_.size, 0, std::min<size_t>(image.size(), in_info_.size),
+                                                     nullptr, nullptr);
+        GstBuffer* out = gst_buffer_new_wrapped_full(static_cast<GstMemoryFlags>(0), s->data, slot_size_, 0,
+                                                     out_info_.size, nullptr, nullptr);
+        GstVideoFrame in_frame;
+        GstVideoFrame out_frame;
+        if (gst_video_frame_map(&in_frame, &in_info_, in, GST_MAP_READ)) {
+            if (gst_video_frame_map(&out_frame, &out_info_, out, GST_MAP_WRITE)) {
+                gst_video_converter_frame(converter_, &in_frame, &out_frame);
+                gst_video_frame_unmap(&out_frame);
+            }
+            gst_video_frame_unmap(&in_frame);
+        }
+        gst_buffer_unref(in);
+        gst_buffer_unref(out);
+    } else {
+        std::memcpy(s->data, image.begin(), std::min<size_t>(image.size(), out_info_.size));
+    }
+
+    const auto& audio   = frame.audio_data();
+    const auto  samples = format_desc_.audio_channels > 0 ? audio.size() / format_desc_.audio_channels : 0;
+    audio_file_.write(reinterpret_cast<const char*>(audio.data()), audio.size() * sizeof(int32_t));
+
+    s->frame = frame_count_++;
+    index_file_ << s->frame << " " << s->frame * static_cast<int64_t>(slot_size_) << " " << audio_offset_ << " "
+                << samples << "\n";
+    audio_offset_ += audio.size() * sizeof(int32_t);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready_.push_back(s);
+        ++queued_;
+    }
+    ready_cond_.notify_one();
+    return true;
+}
+
+void GstRawWriter::run()
+{
+    while (true) {
+        std::deque<slot*> ready;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            // With writes in flight only wait briefly, their completions have to be reaped
+            ready_cond_.wait_for(lock, std::chrono::milliseconds(in_flight_ > 0 ? 1 : 100), [this] {
+                return abort_request_ || !ready_.empty();
+            });
+            ready.swap(ready_);
+            if (abort_request_ && ready.empty() && in_flight_ == 0) {
+                break;
+            }
+        }
+
+        for (auto s : ready) {
+            write(s);
+        }
+
+#ifdef CASPAR_GST_IO_URING
+        if (ring_) {
+            if (!ready.empty()) {
+                io_uring_submit(&ring_->ring);
+            }
+
+            // Reap what has finished, waiting only when every buffer is in flight
+            io_uring_cqe* cqe = nullptr;
+            while (in_flight_ > 0) {
+                const bool full = in_flight_ >= buffer_count;
+                if ((full ? io_uring_wait_cqe(&ring_->ring, &cqe) : io_uring_peek_cqe(&ring_->ring, &cqe)) != 0) {
+                    break;
+                }
+                auto s = static_cast<slot*>(io_uring_cqe_get_data(cqe));
+                const auto result = cqe->res;
+                io_uring_cqe_seen(&ring_->ring, cqe);
+                --in_flight_;
+                completed(s, result);
+            }
+        }
+#endif
+    }
+}
+
+void GstRawWriter::write(slot* s)
+{
+    s->submitted      = std::chrono::steady_clock::now();
+    const auto offset = s->frame * static_cast<int64_t>(slot_size_);
+
+#ifdef CASPAR_GST_IO_URING
+    if (ring_) {
+        auto sqe = io_uring_get_sqe(&ring_->ring);
+        if (!sqe) {
+            io_uring_submit(&ring_->ring);
+            sqe = io_uring_get_sqe(&ring_->ring);
+        }
+        if (sqe) {
+            io_uring_prep_write(sqe, static_cast<int>(video_file_), s->data, static_cast<unsigned>(slot_size_),
+                                offset);
+            io_uring_sqe_set_data(sqe, s);
+            ++in_flight_;
+            return;
+        }
+    }
+#endif
+
+#ifdef _WIN32
+    OVERLAPPED overlapped = {};
+    overlapped.Offset     = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD written         = 0;
+    const auto result     = WriteFile(reinterpret_cast<HANDLE>(video_file_), s->data, static_cast<DWORD>(slot_size_),
+                                  &written, &overlapped)
+                                ? static_cast<int64_t>(written)
+                                : -1;
+#else
+    int64_t result = 0;
+    while (result < static_cast<int64_t>(slot_size_)) {
+        const auto n = pwrite(static_cast<int>(video_file_), s->data + result, slot_size_ - result, offset + result);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            result = -errno;
+            break;
+        }
+        result += n;
+    }
+#endif
+    completed(s, result);
+}
+
+void GstRawWriter::completed(slot* s, int64_t result)
+{
+    const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                               s->submitted)
+                             .count();
+    latency_sum_ += latency;
+    ++latency_count_;
+    if (latency > latency_max_) {
+        latency_max_ = latency;
+    }
+
+    if (result == static_cast<int64_t>(slot_size_)) {
+        ++frames_;
+        written_ += result;
+    } else {
+        ++dropped_;
+        CASPAR_LOG(error) << "Raw capture to " << base_path_ << " failed to write frame " << s->frame << " ("
+                          << result << ").";
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(s);
+    --queued_;
+}
+
+raw_writer_stats GstRawWriter::stats()
+{
+    raw_writer_stats stats;
+    stats.frames     = frames_;
+    stats.dropped    = dropped_;
+    stats.queued     = queued_;
+    stats.written_mb = written_ / (1024 * 1024);
+
+    const auto count     = latency_count_.exchange(0);
+    const auto sum       = latency_sum_.exchange(0);
+    stats.latency_avg_us = count > 0 ? sum / count : 0;
+    stats.latency_max_us = latency_max_.exchange(0);
+    return stats;
+}
+
+}} // namespace caspar::gstreamer
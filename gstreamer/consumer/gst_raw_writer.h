@@ -0,0 +1,119 @@
+#pragma once
+
+#include "../util/gst_thread.h"
+#include "../util/gst_util.h"
+
+#include <core/frame/frame.h>
+#include <core/video_format.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+namespace caspar { namespace gstreamer {
+
+struct raw_writer_stats
+{
+    int64_t frames         = 0; // written to disk
+    int64_t dropped        = 0; // no free buffer because the disk fell behind
+    int64_t queued         = 0; // converted frames waiting for or in a write
+    int64_t latency_avg_us = 0; // from submitting a frame's write to its completion
+    int64_t latency_max_us = 0; // largest since the previous call
+    int64_t written_mb     = 0;
+};
+
+// Writes the channel uncompressed, without encoding: video as v210, UYVY or BGRA into
+// <path>.<format>, audio as interleaved 32 bit PCM into <path>.pcm and a text index of
+// both into <path>.idx. Frames are converted into page aligned buffers and written by a
+// dedicated thread with direct I/O, bypassing the page cache, several at once through
+// io_uring where available and one pwrite at a time otherwise. Every frame starts on a
+// 4096 byte boundary of the video file, padded when the frame size isn't a multiple of it.
+class GstRawWriter
+{
+  public:
+    enum class format
+    {
+        v210,
+        uyvy,
+        bgra
+    };
+
+    GstRawWriter(const std::string&             path,
+                 format                         video_format,
+                 const core::video_format_desc& format_desc,
+                 const thread_placement&        placement);
+    ~GstRawWriter();
+
+    GstRawWriter(const GstRawWriter&)            = delete;
+    GstRawWriter& operator=(const GstRawWriter&) = delete;
+
+    // Converts the frame into a free buffer and queues its write, false when it was dropped
+    bool push(const core::const_frame& frame);
+
+    // Also resets the maximum latency
+    raw_writer_stats stats();
+
+    // "v210", "uyvy" or "bgra"
+    static format parse_format(const std::string& name);
+
+  private:
+    struct slot
+    {
+        uint8_t*                              data  = nullptr;
+        int64_t                               frame = 0;
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    void run();
+    void write(slot* s);
+    void completed(slot* s, int64_t result);
+
+    const format                  format_;
+    const core::video_format_desc format_desc_;
+    const std::string             base_path_;
+
+    GstVideoInfo        in_info_;
+    GstVideoInfo        out_info_;
+    GstVideoConverter*  converter_ = nullptr;
+    size_t              slot_size_ = 0;
+    std::vector<slot>   slots_;
+
+    intptr_t      video_file_ = -1;
+    std::ofstream audio_file_;
+    std::ofstream index_file_;
+    int64_t       frame_count_  = 0;
+    int64_t       audio_offset_ = 0;
+
+    std::mutex              mutex_;
+    std::condition_variable ready_cond_;
+    std::deque<slot*>       free_;
+    std::deque<slot*>       ready_;
+
+#ifdef CASPAR_GST_IO_URING
+    struct io_uring_state;
+    std::unique_ptr<io_uring_state> ring_;
+#endif
+    unsigned in_flight_ = 0;
+
+    std::atomic<int64_t> frames_{0};
+    std::atomic<int64_t> dropped_{0};
+    std::atomic<int64_t> queued_{0};
+    std::atomic<int64_t> latency_sum_{0};
+    std::atomic<int64_t> latency_count_{0};
+    std::atomic<int64_t> latency_max_{0};
+    std::atomic<int64_t> written_{0};
+
+    std::atomic<bool> abort_request_{false};
+    boost::thread     thread_;
+};
+
+}} // namespace caspar::gstreamer
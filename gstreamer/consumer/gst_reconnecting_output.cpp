@@ -0,0 +1,335 @@
+#include "gst_reconnecting_output.h"
+
+#include "../util/gst_task_pool.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <gst/app/gstappsrc.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace caspar { namespace gstreamer {
+
+namespace {
+
+// Connected this long, the output counts as working again and the backoff starts over
+const auto stable_connection = std::chrono::seconds(10);
+
+// Encoded data the appsrc holds before the buffer keeps the rest
+const guint64 max_appsrc_bytes = 4 * 1024 * 1024;
+
+bool is_keyframe(GstSample* sample)
+{
+    auto buffer = gst_sample_get_buffer(sample);
+    return buffer && !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+}
+
+// Decode time, which never goes backwards
+GstClockTime sample_time(GstSample* sample)
+{
+    auto buffer = gst_sample_get_buffer(sample);
+    if (!buffer) {
+        return GST_CLOCK_TIME_NONE;
+    }
+    return GST_BUFFER_DTS_IS_VALID(buffer) ? GST_BUFFER_DTS(buffer) : GST_BUFFER_PTS(buffer);
+}
+
+std::string message_error(GstMessage* message)
+{
+    if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS) {
+        return "end of stream";
+    }
+    GError* err      = nullptr;
+    gchar*  dbg_info = nullptr;
+    gst_message_parse_error(message, &err, &dbg_info);
+    std::string error = err ? err->message : "unknown";
+    if (err) {
+        g_error_free(err);
+    }
+    g_free(dbg_info);
+    return error;
+}
+
+} // namespace
+
+GstReconnectingOutput::GstReconnectingOutput(Settings settings, const thread_placement& placement)
+    : settings_(std::move(settings))
+    , placement_(placement)
+{
+    thread_ = boost::thread([this] {
+        try {
+            set_thread_name(L"[gstreamer::reconnect]");
+            apply_thread_placement(placement_);
+            run();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    });
+}
+
+GstReconnectingOutput::~GstReconnectingOutput()
+{
+    stop();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void GstReconnectingOutput::stop()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    abort_request_ = true;
+    cond_.notify_all();
+}
+
+void GstReconnectingOutput::attach(GstElement* appsink)
+{
+    GstAppSinkCallbacks callbacks;
+    memset(&callbacks, 0, sizeof(GstAppSinkCallbacks));
+    callbacks.new_sample = &GstReconnectingOutput::new_sample;
+
+    // The appsink keeps the output alive, it may still get frames while its branch drains
+    gst_app_sink_set_callbacks(GST_APP_SINK(appsink), &callbacks,
+                               new std::shared_ptr<GstReconnectingOutput>(shared_from_this()), [](gpointer data) {
+                                   delete static_cast<std::shared_ptr<GstReconnectingOutput>*>(data);
+                               });
+}
+
+GstFlowReturn GstReconnectingOutput::new_sample(GstAppSink* sink, gpointer user_data)
+{
+    auto sample = gst_app_sink_pull_sample(sink);
+    if (!sample) {
+        return GST_FLOW_EOS;
+    }
+    (*static_cast<std::shared_ptr<GstReconnectingOutput>*>(user_data))->push(sample);
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+void GstReconnectingOutput::push(GstSample* sample)
+{
+    bool request_keyframe = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!caps_ && gst_sample_get_caps(sample)) {
+            caps_ = make_gst_ptr<GstCaps>(gst_caps_ref(gst_sample_get_caps(sample)));
+        }
+        if (keyframe_wait_) {
+            if (!is_keyframe(sample)) {
+                stats_.dropped++;
+                return;
+            }
+            keyframe_wait_ = false;
+        }
+        buffer_.push_back(make_gst_ptr<GstSample>(gst_sample_ref(sample)));
+
+        // Bounded by time, the oldest whole GOPs go first, so the next frame sent is always a
+        // keyframe and never a delta frame whose references were dropped
+        const auto limit = static_cast<GstClockTime>(settings_.buffer_ms) * GST_MSECOND;
+        if (buffer_.size() > 1 && sample_time(buffer_.back().get()) - sample_time(buffer_.front().get()) > limit) {
+            do {
+                buffer_.pop_front();
+                stats_.dropped++;
+            } while (!buffer_.empty() && !is_keyframe(buffer_.front().get()));
+
+            // A GOP longer than the buffer leaves nothing to resume on, the encoder is asked for one
+            if (buffer_.empty()) {
+                keyframe_wait_   = true;
+                request_keyframe = true;
+            }
+        }
+        cond_.notify_one();
+    }
+    if (request_keyframe && settings_.force_keyframe) {
+        settings_.force_keyframe();
+    }
+}
+
+void GstReconnectingOutput::run()
+{
+    auto backoff = settings_.min_backoff_ms;
+    bool first   = true;
+
+    while (!abort_request_) {
+        {
+            // The appsrc needs the caps of the encoded stream
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [&] { return abort_request_ || caps_; });
+        }
+        if (abort_request_) {
+            break;
+        }
+
+        if (!first) {
+            resume();
+        }
+        first = false;
+
+        gst_ptr<GstElement> pipeline;
+        const auto          started = std::chrono::steady_clock::now();
+        std::string         error;
+        try {
+            pipeline = create_pipeline("appsrc name=src format=time is-live=true do-timestamp=false ! " +
+                                       settings_.description);
+            install_task_pool(pipeline.get(), placement_);
+
+            auto appsrc = make_gst_ptr<GstElement>(gst_bin_get_by_name(GST_BIN(pipeline.get()), "src"));
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                gst_app_src_set_caps(GST_APP_SRC(appsrc.get()), caps_.get());
+            }
+
+            // Frames buffered while disconnected go out as fast as the link takes them
+            GstIterator* sinks = gst_bin_iterate_sinks(GST_BIN(pipeline.get()));
+            GValue       item  = G_VALUE_INIT;
+            while (gst_iterator_next(sinks, &item) == GST_ITERATOR_OK) {
+                g_object_set(g_value_get_object(&item), "sync", FALSE, nullptr);
+                g_value_reset(&item);
+            }
+            g_value_unset(&item);
+            gst_iterator_free(sinks);
+
+            if (gst_element_set_state(pipeline.get(), GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+                error = "failed to start";
+            } else {
+                error = send(pipeline.get(), appsrc.get());
+            }
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            error = "failed to create the output";
+        }
+        if (pipeline) {
+            gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+        }
+        if (abort_request_) {
+            break;
+        }
+
+        if (std::chrono::steady_clock::now() - started > stable_connection) {
+            backoff = settings_.min_backoff_ms;
+        }
+        CASPAR_LOG(warning) << "[gstreamer] Output " << settings_.path << " failed (" << error << "), reconnecting in "
+                            << backoff << " ms.";
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            stats_.state      = "reconnecting";
+            stats_.last_error = error;
+            stats_.backoff_s  = backoff / 1000.0;
+            stats_.disconnects++;
+            cond_.wait_for(lock, std::chrono::milliseconds(backoff), [&] { return abort_request_.load(); });
+            stats_.backoff_s = 0;
+        }
+        backoff = std::min(backoff * 2, settings_.max_backoff_ms);
+    }
+}
+
+std::string GstReconnectingOutput::send(GstElement* pipeline, GstElement* appsrc)
+{
+    auto         bus     = make_gst_ptr<GstBus>(gst_element_get_bus(pipeline));
+    const auto   types   = static_cast<GstMessageType>(GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+    GstClockTime base    = GST_CLOCK_TIME_NONE;
+    bool         flowing = false;
+
+    while (!abort_request_) {
+        // An error of the sink ends the connection
+        if (auto message = gst_bus_pop_filtered(bus.get(), types)) {
+            const auto error = message_error(message);
+            gst_message_unref(message);
+            return error;
+        }
+
+        // A slow link holds the frames back in the buffer, where they are bounded by time
+        if (gst_app_src_get_current_level_bytes(GST_APP_SRC(appsrc)) > max_appsrc_bytes) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        gst_ptr<GstSample> sample;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait_for(lock, std::chrono::milliseconds(100), [&] { return abort_request_ || !buffer_.empty(); });
+            if (buffer_.empty()) {
+                continue;
+            }
+            sample = buffer_.front();
+            buffer_.pop_front();
+        }
+
+        // Each connection starts its timestamps at zero
+        GstBuffer* buffer = gst_buffer_copy(gst_sample_get_buffer(sample.get()));
+        if (!GST_CLOCK_TIME_IS_VALID(base)) {
+            base = sample_time(sample.get());
+        }
+        if (GST_CLOCK_TIME_IS_VALID(base)) {
+            if (GST_BUFFER_PTS_IS_VALID(buffer)) {
+                GST_BUFFER_PTS(buffer) = GST_BUFFER_PTS(buffer) > base ? GST_BUFFER_PTS(buffer) - base : 0;
+            }
+            if (GST_BUFFER_DTS_IS_VALID(buffer)) {
+                GST_BUFFER_DTS(buffer) = GST_BUFFER_DTS(buffer) > base ? GST_BUFFER_DTS(buffer) - base : 0;
+            }
+        }
+
+        const auto ret = gst_app_src_push_buffer(GST_APP_SRC(appsrc), buffer);
+        if (ret != GST_FLOW_OK) {
+            return gst_flow_get_name(ret);
+        }
+
+        if (!flowing) {
+            flowing = true;
+            CASPAR_LOG(info) << "[gstreamer] Output " << settings_.path << " connected.";
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.state = "connected";
+            stats_.connects++;
+            connected_ = make_gst_ptr<GstElement>(GST_ELEMENT(gst_object_ref(pipeline)));
+        }
+    }
+    return "stopped";
+}
+
+void GstReconnectingOutput::resume()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (settings_.replay) {
+            // From the first keyframe buffered
+            while (!buffer_.empty() && !is_keyframe(buffer_.front().get())) {
+                buffer_.pop_front();
+                stats_.dropped++;
+            }
+        } else {
+            // Live from the next keyframe, which the encoder is asked for right away
+            stats_.dropped += buffer_.size();
+            buffer_.clear();
+        }
+        keyframe_wait_ = buffer_.empty();
+    }
+    if (!settings_.replay && settings_.force_keyframe) {
+        settings_.force_keyframe();
+    }
+}
+
+gst_ptr<GstElement> GstReconnectingOutput::take_connected()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto                        connected = std::move(connected_);
+    connected_.reset();
+    return connected;
+}
+
+reconnect_stats GstReconnectingOutput::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto                        stats = stats_;
+    if (buffer_.size() > 1) {
+        stats.buffered_ms = (sample_time(buffer_.back().get()) - sample_time(buffer_.front().get())) / 1e6;
+    }
+    return stats;
+}
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "../util/gst_thread.h"
+#include "../util/gst_util.h"
+
+#include <gst/app/gstappsink.h>
+
+#include <boost/thread.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace caspar { namespace gstreamer {
+
+struct reconnect_stats
+{
+    std::string state       = "connecting"; // "connecting", "connected" or "reconnecting"
+    int64_t     connects    = 0;
+    int64_t     disconnects = 0;
+    double      buffered_ms = 0;  // encoded stream waiting to be sent
+    int64_t     dropped     = 0;  // frames that didn't fit the buffer or were skipped to live
+    double      backoff_s   = 0;  // before the next attempt
+    std::string last_error;
+};
+
+// Sends a stream output from a pipeline of its own, fed with the encoded frames of the consumer's
+// pipeline, so an output that fails doesn't stop the encoder. When it fails the output is torn
+// down and built again after a backoff that doubles up to a maximum. Meanwhile the frames go into
+// a buffer bounded by time, which drops whole GOPs so a slow link also skips on a keyframe. Once
+// connected again it resumes on a keyframe: the first one buffered to replay what was missed, or
+// the next one the encoder makes to skip to live.
+class GstReconnectingOutput : public std::enable_shared_from_this<GstReconnectingOutput>
+{
+  public:
+    struct Settings
+    {
+        std::string path;
+        std::string description;             // after the appsrc, ending in the sink
+        int         buffer_ms      = 10000;
+        bool        replay         = false;
+        int         min_backoff_ms = 1000;
+        int         max_backoff_ms = 30000;
+        std::function<void()> force_keyframe; // asks the encoder for a keyframe to resume on
+    };
+
+    GstReconnectingOutput(Settings settings, const thread_placement& placement);
+    ~GstReconnectingOutput();
+
+    GstReconnectingOutput(const GstReconnectingOutput&)            = delete;
+    GstReconnectingOutput& operator=(const GstReconnectingOutput&) = delete;
+
+    // Takes the encoded frames of an appsink in the consumer's pipeline
+    void attach(GstElement* appsink);
+
+    // The output's pipeline each time it connected, once, so elements in it can be watched
+    gst_ptr<GstElement> take_connected();
+
+    void            stop();
+    reconnect_stats stats() const;
+
+  private:
+    static GstFlowReturn new_sample(GstAppSink* sink, gpointer user_data);
+
+    void        push(GstSample* sample);
+    void        run();
+    std::string send(GstElement* pipeline, GstElement* appsrc); // until it fails, with the error
+    void        resume();
+
+    const Settings         settings_;
+    const thread_placement placement_;
+
+    mutable std::mutex              mutex_;
+    std::condition_variable         cond_;
+    std::deque<gst_ptr<GstSample>>  buffer_;
+    bool                            keyframe_wait_ = false; // drops frames up to the next keyframe
+    gst_ptr<GstCaps>                caps_;
+    gst_ptr<GstElement>             connected_;
+    reconnect_stats                 stats_;
+
+    std::atomic<bool> abort_request_{false};
+    boost::thread     thread_;
+};
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,295 @@
+#include "gst_ts_multiplex.h"
+
+#include "../util/gst_task_pool.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <gst/app/gstappsrc.h>
+
+namespace caspar { namespace gstreamer {
+
+namespace {
+
+std::mutex                                           registry_mutex;
+std::map<std::string, std::weak_ptr<GstTsMultiplex>> registry;
+
+// Encoded frames a program may queue before the multiplex, about 4 seconds of a 20 Mbit/s stream
+const guint64 max_program_bytes = 10 * 1024 * 1024;
+
+// Headroom between the multiplex clock and the first timestamp of a joining program,
+// so its first packets aren't already late when they reach the muxer
+const GstClockTime join_latency = 100 * GST_MSECOND;
+
+// Elementary streams take PIDs below the PMTs, which are 0x1000 + program up to 0x1FFE. 0x1FFF
+// carries the null packets of a constant bitrate multiplex.
+const int max_elementary_pid = 0x0FFF;
+const int max_program        = 0x1FFE - 0x1000;
+
+int pmt_pid(int program) { return 0x1000 + program; }
+
+} // namespace
+
+GstTsMultiplex::GstTsMultiplex(const Settings& settings, const thread_placement& placement)
+    : settings_(settings)
+{
+    // Packets are sent 7 to a datagram. PCR interval is in 90 kHz ticks.
+    std::string desc = "mpegtsmux name=mux alignment=7 pcr-interval=" + std::to_string(settings_.pcr_interval * 90);
+    if (settings_.bitrate > 0) {
+        // Constant bitrate, the gaps between programs' packets are filled with null packets,
+        // and sent on a fixed packet schedule
+        desc += " bitrate=" + std::to_string(static_cast<uint64_t>(settings_.bitrate) * 1000);
+        desc += " ! appsink name=ts_sink sync=true async=false emit-signals=false";
+    } else {
+        desc += " ! udpsink sync=true async=false host=" + settings_.host + " port=" + std::to_string(settings_.port);
+    }
+
+    CASPAR_LOG(info) << "Creating MPEG-TS multiplex: " << desc;
+
+    pipeline_ = create_pipeline(desc);
+    mux_      = make_gst_ptr<GstElement>(gst_bin_get_by_name(GST_BIN(pipeline_.get()), "mux"));
+
+    install_task_pool(pipeline_.get(), placement);
+
+    if (settings_.bitrate > 0) {
+        pacer_ = std::make_shared<GstUdpPacer>(settings_.host, settings_.port,
+                                               static_cast<uint64_t>(settings_.bitrate) * 1000, false, settings_.ttl,
+                                               placement);
+        auto ts_sink = make_gst_ptr<GstElement>(gst_bin_get_by_name(GST_BIN(pipeline_.get()), "ts_sink"));
+        pacer_->attach(ts_sink.get());
+    }
+
+    if (gst_element_set_state(pipeline_.get(), GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to start MPEG-TS multiplex to " + settings_.host));
+    }
+
+    thread_ = boost::thread([this, placement] {
+        try {
+            set_thread_name(L"[gstreamer::ts_multiplex]");
+            apply_thread_placement(placement);
+            run();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    });
+}
+
+GstTsMultiplex::~GstTsMultiplex()
+{
+    abort_request_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    gst_element_set_state(pipeline_.get(), GST_STATE_NULL);
+    pacer_.reset();
+
+    CASPAR_LOG(info) << "Stopped MPEG-TS multiplex to " << settings_.host << ":" << settings_.port;
+}
+
+std::shared_ptr<GstTsMultiplex::Program>
+GstTsMultiplex::join(const Settings& settings, int number, int pid, const thread_placement& placement)
+{
+    if (number < 1 || number > max_program) {
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("MPEG-TS program number must be 1 to " +
+                                                              std::to_string(max_program)));
+    }
+    if (pid == 0) {
+        pid = 0x100 + 0x10 * number;
+        if (pid > max_elementary_pid) {
+            CASPAR_THROW_EXCEPTION(invalid_argument()
+                                   << msg_info("MPEG-TS program " + std::to_string(number) +
+                                               " has no default PID, programs above 239 need a PID of their own"));
+        }
+    }
+    if (pid < 0x20 || pid > max_elementary_pid) {
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("MPEG-TS PID must be 0x20 to 0xFFF"));
+    }
+
+    const auto key = settings.host + ":" + std::to_string(settings.port);
+
+    std::shared_ptr<GstTsMultiplex> mux;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        mux = registry[key].lock();
+        if (!mux) {
+            mux           = std::make_shared<GstTsMultiplex>(settings, placement);
+            registry[key] = mux;
+        } else if (mux->settings_.bitrate != settings.bitrate) {
+            CASPAR_LOG(warning) << "MPEG-TS multiplex to " << key << " already runs at " << mux->settings_.bitrate
+                                << " kbit/s, ignoring " << settings.bitrate << " kbit/s.";
+        }
+    }
+
+    return std::make_shared<Program>(std::move(mux), number, pid);
+}
+
+void GstTsMultiplex::run()
+{
+    GstBus* bus = gst_element_get_bus(pipeline_.get());
+
+    while (!abort_request_) {
+        GstMessage* msg = gst_bus_timed_pop(bus, 100 * GST_MSECOND);
+        if (!msg) {
+            continue;
+        }
+
+        if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR || GST_MESSAGE_TYPE(msg) == GST_MESSAGE_WARNING) {
+            GError* err      = nullptr;
+            gchar*  dbg_info = nullptr;
+            if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+                gst_message_parse_error(msg, &err, &dbg_info);
+                CASPAR_LOG(error) << "MPEG-TS multiplex error: " << (err ? err->message : "unknown");
+            } else {
+                gst_message_parse_warning(msg, &err, &dbg_info);
+                CASPAR_LOG(warning) << "MPEG-TS multiplex warning: " << (err ? err->message : "unknown");
+            }
+            if (err) {
+                g_error_free(err);
+            }
+            g_free(dbg_info);
+        }
+
+        gst_message_unref(msg);
+    }
+
+    gst_object_unref(bus);
+}
+
+GstTsMultiplex::Program::Program(std::shared_ptr<GstTsMultiplex> mux, int number, int pid)
+    : mux_(std::move(mux))
+    , number_(number)
+    , pid_(pid)
+{
+    {
+        std::lock_guard<std::mutex> lock(mux_->programs_mutex_);
+        for (const auto& program : mux_->programs_) {
+            if (program.first == number_ || program.second == pid_) {
+                CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("MPEG-TS program " + std::to_string(number_) +
+                                                                      " or PID " + std::to_string(pid_) +
+                                                                      " is already in the multiplex"));
+            }
+        }
+        mux_->programs_[number_] = pid_;
+
+        // The muxer looks a pad's program up in prog-map when the pad is requested
+        GstStructure* prog_map = gst_structure_new_empty("prog-map");
+        for (const auto& program : mux_->programs_) {
+            gst_structure_set(prog_map,
+                              ("sink_" + std::to_string(program.second)).c_str(), G_TYPE_INT, program.first,
+                              ("PMT_" + std::to_string(program.first)).c_str(), G_TYPE_INT, pmt_pid(program.first),
+                              nullptr);
+        }
+        g_object_set(mux_->mux_.get(), "prog-map", prog_map, nullptr);
+        gst_structure_free(prog_map);
+    }
+
+    auto appsrc = gst_element_factory_make("appsrc", nullptr);
+    g_object_set(appsrc,
+                 "format", GST_FORMAT_TIME,
+                 "is-live", TRUE,
+                 "block", FALSE,
+                 "max-bytes", max_program_bytes,
+                 nullptr);
+    gst_bin_add(GST_BIN(mux_->pipeline_.get()), appsrc);
+    appsrc_ = make_gst_ptr<GstElement>(GST_ELEMENT(gst_object_ref(appsrc)));
+
+    const auto pad_name = "sink_" + std::to_string(pid_);
+#if GST_CHECK_VERSION(1, 20, 0)
+    mux_pad_ = gst_element_request_pad_simple(mux_->mux_.get(), pad_name.c_str());
+#else
+    mux_pad_ = gst_element_get_request_pad(mux_->mux_.get(), pad_name.c_str());
+#endif
+    GstPad* src = gst_element_get_static_pad(appsrc, "src");
+    const bool linked = mux_pad_ && gst_pad_link(src, mux_pad_) == GST_PAD_LINK_OK;
+    gst_object_unref(src);
+    if (!linked) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to add program " + std::to_string(number_) +
+                                                              " to the MPEG-TS multiplex"));
+    }
+
+    gst_element_sync_state_with_parent(appsrc);
+
+    CASPAR_LOG(info) << "Program " << number_ << " joined the MPEG-TS multiplex to " << mux_->settings_.host << ":"
+                     << mux_->settings_.port << " on PID " << pid_;
+}
+
+GstTsMultiplex::Program::~Program()
+{
+    if (appsrc_) {
+        gst_element_set_state(appsrc_.get(), GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(mux_->pipeline_.get()), appsrc_.get());
+    }
+    if (mux_pad_) {
+        gst_element_release_request_pad(mux_->mux_.get(), mux_pad_);
+        gst_object_unref(mux_pad_);
+    }
+
+    std::lock_guard<std::mutex> lock(mux_->programs_mutex_);
+    auto it = mux_->programs_.find(number_);
+    if (it != mux_->programs_.end() && it->second == pid_) {
+        mux_->programs_.erase(it);
+    }
+}
+
+void GstTsMultiplex::Program::push(GstSample* sample)
+{
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    if (!buffer) {
+        return;
+    }
+
+    auto appsrc = GST_APP_SRC(appsrc_.get());
+    if (gst_app_src_get_current_level_bytes(appsrc) > max_program_bytes) {
+        // The multiplex is not keeping up, e.g. its bitrate is below what the programs send
+        ++dropped_;
+        return;
+    }
+
+    GstCaps* caps    = gst_sample_get_caps(sample);
+    GstCaps* current = gst_app_src_get_caps(appsrc);
+    if (caps && (!current || !gst_caps_is_equal(caps, current))) {
+        gst_app_src_set_caps(appsrc, caps);
+    }
+    if (current) {
+        gst_caps_unref(current);
+    }
+
+    // Programs are timestamped from their own start, the multiplex runs on its own clock
+    if (!offset_valid_) {
+        const auto timestamp = GST_BUFFER_DTS_OR_PTS(buffer);
+        GstClock*  clock     = gst_element_get_clock(mux_->pipeline_.get());
+        if (!clock || !GST_CLOCK_TIME_IS_VALID(timestamp)) {
+            if (clock) {
+                gst_object_unref(clock);
+            }
+            return;
+        }
+        const auto running_time = gst_clock_get_time(clock) - gst_element_get_base_time(mux_->pipeline_.get());
+        gst_object_unref(clock);
+
+        offset_       = GST_CLOCK_DIFF(timestamp, running_time + join_latency);
+        offset_valid_ = true;
+    }
+
+    buffer = gst_buffer_make_writable(gst_buffer_ref(buffer));
+    if (GST_BUFFER_PTS_IS_VALID(buffer)) {
+        GST_BUFFER_PTS(buffer) = static_cast<GstClockTime>(static_cast<GstClockTimeDiff>(GST_BUFFER_PTS(buffer)) + offset_);
+    }
+    if (GST_BUFFER_DTS_IS_VALID(buffer)) {
+        GST_BUFFER_DTS(buffer) = static_cast<GstClockTime>(static_cast<GstClockTimeDiff>(GST_BUFFER_DTS(buffer)) + offset_);
+    }
+
+    gst_app_src_push_buffer(appsrc, buffer);
+}
+
+int GstTsMultiplex::Program::program_count() const
+{
+    std::lock_guard<std::mutex> lock(mux_->programs_mutex_);
+    return static_cast<int>(mux_->programs_.size());
+}
+
+int GstTsMultiplex::Program::bitrate() const { return mux_->settings_.bitrate; }
+
+}} // namespace caspar::gstreamer
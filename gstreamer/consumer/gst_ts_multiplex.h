@@ -0,0 +1,95 @@
+#pragma once
+
+#include "gst_udp_pacer.h"
+
+#include "../util/gst_thread.h"
+#include "../util/gst_util.h"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <boost/thread.hpp>
+
+namespace caspar { namespace gstreamer {
+
+// One MPEG-TS multiplex per UDP destination, shared by every channel sending to
+// it. Each channel is a program with its own PIDs and encodes in its own pipeline,
+// only the encoded stream is handed to the multiplex. The multiplex runs at a
+// constant bitrate, stuffed with null packets, and carries the PCR of each program
+// at a fixed interval so the stream is paced the same whatever the programs send.
+class GstTsMultiplex
+{
+  public:
+    struct Settings
+    {
+        std::string host;
+        int         port         = 5000;
+        int         bitrate      = 0;  // Total kbit/s, 0 for variable bitrate
+        int         pcr_interval = 20; // Milliseconds
+        int         ttl          = 16;
+    };
+
+    class Program
+    {
+      public:
+        Program(std::shared_ptr<GstTsMultiplex> mux, int number, int pid);
+        ~Program();
+
+        Program(const Program&)            = delete;
+        Program& operator=(const Program&) = delete;
+
+        // Queues an encoded sample, timestamps are moved onto the multiplex clock
+        void push(GstSample* sample);
+
+        int number() const { return number_; }
+        int pid() const { return pid_; }
+
+        int     program_count() const;
+        int     bitrate() const;
+        int64_t dropped() const { return dropped_; }
+
+        // Sender of a constant bitrate multiplex, null for variable bitrate
+        std::shared_ptr<GstUdpPacer> pacer() const { return mux_->pacer_; }
+
+      private:
+        std::shared_ptr<GstTsMultiplex> mux_;
+        const int                       number_;
+        const int                       pid_;
+        gst_ptr<GstElement>             appsrc_;
+        GstPad*                         mux_pad_ = nullptr;
+        bool                            offset_valid_ = false;
+        GstClockTimeDiff                offset_       = 0;
+        std::atomic<int64_t>            dropped_{0};
+    };
+
+    explicit GstTsMultiplex(const Settings& settings, const thread_placement& placement);
+    ~GstTsMultiplex();
+
+    // Adds a program to the multiplex sending to settings.host:port, starting it on first use.
+    // The first program decides the bitrate and PCR interval of the multiplex. Programs are
+    // numbered 1 to 0xFFE, their PMTs are 0x1000 + number. The video PID is 0x20 to 0xFFF, a pid
+    // of 0 picks 0x100 + 0x10 * number, which only programs up to 239 have.
+    static std::shared_ptr<Program>
+    join(const Settings& settings, int number, int pid, const thread_placement& placement = {});
+
+  private:
+    void run();
+
+    const Settings               settings_;
+    gst_ptr<GstElement>          pipeline_;
+    gst_ptr<GstElement>          mux_;
+    std::shared_ptr<GstUdpPacer> pacer_;
+
+    // Program number -> elementary stream PID, kept in the muxer's prog-map
+    mutable std::mutex           programs_mutex_;
+    std::map<int, int>           programs_;
+
+    std::atomic<bool> abort_request_{false};
+    boost::thread     thread_;
+};
+
+}} // namespace caspar::gstreamer
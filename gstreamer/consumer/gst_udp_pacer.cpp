@@ -0,0 +1,339 @@
+#include "gst_udp_pacer.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <thread>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace caspar { namespace gstreamer {
+
+namespace {
+
+const size_t rtp_header_size = 12;
+
+// Packets sent with one call at most, only reached when the sender catches up after a delay
+const size_t max_batch = 32;
+
+// Falling further behind than this restarts the schedule instead of bursting to catch up
+const std::chrono::milliseconds max_lag(50);
+
+// Jitter is reported for the last complete window of this length
+const std::chrono::seconds jitter_window(1);
+
+void close_socket(intptr_t socket)
+{
+#ifdef _WIN32
+    closesocket(static_cast<SOCKET>(socket));
+#else
+    close(static_cast<int>(socket));
+#endif
+}
+
+// Sleeps to just before the deadline and spins the rest, a plain sleep overshoots by up to a millisecond
+void wait_until(std::chrono::steady_clock::time_point deadline)
+{
+    const auto spin = std::chrono::microseconds(200);
+    if (deadline - std::chrono::steady_clock::now() > spin) {
+        std::this_thread::sleep_until(deadline - spin);
+    }
+    while (std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+}
+
+} // namespace
+
+GstUdpPacer::GstUdpPacer(const std::string&      host,
+                         int                     port,
+                         uint64_t                bitrate,
+                         bool                    rtp,
+                         int                     ttl,
+                         const thread_placement& placement)
+    : host_(host)
+    , port_(port)
+    , bitrate_(bitrate)
+    , rtp_(rtp)
+    , interval_(static_cast<int64_t>(datagram_size * 8 * 1000000000ULL / std::max<uint64_t>(bitrate, 1)))
+{
+    if (bitrate_ == 0) {
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Paced UDP output needs a bitrate"));
+    }
+
+#ifdef _WIN32
+    WSADATA wsa_data;
+    WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#endif
+
+    addrinfo hints = {};
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* result  = nullptr;
+    if (getaddrinfo(host_.c_str(), std::to_string(port_).c_str(), &hints, &result) != 0 || !result) {
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Cannot resolve " + host_));
+    }
+    address_.assign(reinterpret_cast<const uint8_t*>(result->ai_addr),
+                    reinterpret_cast<const uint8_t*>(result->ai_addr) + result->ai_addrlen);
+    socket_ = static_cast<intptr_t>(::socket(result->ai_family, SOCK_DGRAM, IPPROTO_UDP));
+    const auto family = result->ai_family;
+    freeaddrinfo(result);
+
+    if (socket_ < 0) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to create UDP socket for " + host_));
+    }
+
+    // Room for a few frames in the kernel in case the sender is descheduled
+    int send_buffer = 4 * 1024 * 1024;
+    setsockopt(static_cast<int>(socket_), SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&send_buffer),
+               sizeof(send_buffer));
+    if (family == AF_INET) {
+        setsockopt(static_cast<int>(socket_), IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char*>(&ttl),
+                   sizeof(ttl));
+    } else {
+        setsockopt(static_cast<int>(socket_), IPPROTO_IPV6, IPV6_MULTICAST_HOPS, reinterpret_cast<const char*>(&ttl),
+                   sizeof(ttl));
+    }
+
+    // A second of packets
+    ring_.resize(std::max<size_t>(256, bitrate_ / (datagram_size * 8)));
+
+    rtp_ssrc_     = std::random_device{}();
+    rtp_sequence_ = static_cast<uint16_t>(std::random_device{}());
+
+    CASPAR_LOG(info) << "Pacing " << (rtp_ ? "RTP" : "UDP") << " output to " << host_ << ":" << port_ << " at "
+                     << bitrate_ / 1000 << " kbit/s, a datagram every "
+                     << std::chrono::duration_cast<std::chrono::microseconds>(interval_).count() << " us.";
+
+    thread_ = boost::thread([this, placement] {
+        try {
+            set_thread_name(L"[gstreamer::udp_pacer]");
+            apply_thread_placement(placement);
+            run();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    });
+}
+
+GstUdpPacer::~GstUdpPacer()
+{
+    abort_request_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    close_socket(socket_);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+void GstUdpPacer::attach(GstElement* appsink)
+{
+    GstAppSinkCallbacks callbacks;
+    memset(&callbacks, 0, sizeof(GstAppSinkCallbacks));
+    callbacks.new_sample = &GstUdpPacer::new_sample;
+    gst_app_sink_set_callbacks(GST_APP_SINK(appsink), &callbacks, this, nullptr);
+}
+
+GstFlowReturn GstUdpPacer::new_sample(GstAppSink* sink, gpointer user_data)
+{
+    auto sample = gst_app_sink_pull_sample(sink);
+    if (!sample) {
+        return GST_FLOW_EOS;
+    }
+    static_cast<GstUdpPacer*>(user_data)->push(gst_sample_get_buffer(sample));
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+void GstUdpPacer::push(GstBuffer* buffer)
+{
+    GstMapInfo map;
+    if (!buffer || !gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        return;
+    }
+
+    const uint8_t* data = map.data;
+    size_t         size = map.size;
+    while (size > 0) {
+        const auto count = std::min(size, datagram_size - partial_size_);
+        std::memcpy(partial_.data() + partial_size_, data, count);
+        partial_size_ += count;
+        data += count;
+        size -= count;
+
+        if (partial_size_ == datagram_size) {
+            partial_size_ = 0;
+
+            const auto write = write_.load(std::memory_order_relaxed);
+            if (write - read_.load(std::memory_order_acquire) >= ring_.size()) {
+                ++dropped_;
+                continue;
+            }
+            ring_[write % ring_.size()] = partial_;
+            write_.store(write + 1, std::memory_order_release);
+        }
+    }
+
+    gst_buffer_unmap(buffer, &map);
+}
+
+void GstUdpPacer::run()
+{
+    // Packets queued beyond a couple of frames mean the muxer runs slightly faster than
+    // the schedule, the schedule then catches up gently instead of letting latency grow
+    const auto high_water = std::max<uint64_t>(16, ring_.size() / 10);
+
+    auto next    = std::chrono::steady_clock::now();
+    bool started = false;
+
+    auto    window_start = next;
+    int64_t jitter_sum   = 0;
+    int64_t jitter_count = 0;
+    int64_t jitter_max   = 0;
+
+    while (!abort_request_) {
+        const auto read      = read_.load(std::memory_order_relaxed);
+        const auto available = write_.load(std::memory_order_acquire) - read;
+        if (available == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            continue;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (!started || now - next > max_lag) {
+            if (started) {
+                ++late_;
+            }
+            next    = now;
+            started = true;
+        }
+
+        if (next > now) {
+            wait_until(next);
+            now = std::chrono::steady_clock::now();
+        }
+
+        const auto lag = now - next;
+        const auto due = std::min<uint64_t>({static_cast<uint64_t>(lag / interval_) + 1, available, max_batch});
+
+        const auto jitter = std::chrono::duration_cast<std::chrono::microseconds>(lag).count();
+        jitter_sum += jitter;
+        ++jitter_count;
+        jitter_max = std::max<int64_t>(jitter_max, jitter);
+        if (now - window_start >= jitter_window) {
+            jitter_avg_  = jitter_sum / jitter_count;
+            jitter_max_  = jitter_max;
+            window_start = now;
+            jitter_sum   = 0;
+            jitter_count = 0;
+            jitter_max   = 0;
+        }
+
+        const auto sent = send(read, static_cast<size_t>(due));
+        if (sent < static_cast<int>(due)) {
+            // Kernel buffer full or the network is down, the stream can't wait for it
+            dropped_ += static_cast<int64_t>(due) - std::max(sent, 0);
+        }
+        packets_ += std::max(sent, 0);
+        ++batches_;
+
+        read_.store(read + due, std::memory_order_release);
+        next += interval_ * static_cast<int64_t>(due);
+        if (available - due > high_water) {
+            next -= interval_ / 16;
+        }
+    }
+}
+
+int GstUdpPacer::send(uint64_t first, size_t count)
+{
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    const auto rtp_timestamp =
+        static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count() * 9 / 100);
+
+    uint8_t headers[max_batch][rtp_header_size];
+    for (size_t n = 0; rtp_ && n < count; ++n) {
+        auto header = headers[n];
+        auto seq    = rtp_sequence_++;
+        header[0]   = 0x80; // version 2
+        header[1]   = 33;   // MP2T
+        header[2]   = static_cast<uint8_t>(seq >> 8);
+        header[3]   = static_cast<uint8_t>(seq);
+        header[4]   = static_cast<uint8_t>(rtp_timestamp >> 24);
+        header[5]   = static_cast<uint8_t>(rtp_timestamp >> 16);
+        header[6]   = static_cast<uint8_t>(rtp_timestamp >> 8);
+        header[7]   = static_cast<uint8_t>(rtp_timestamp);
+        header[8]   = static_cast<uint8_t>(rtp_ssrc_ >> 24);
+        header[9]   = static_cast<uint8_t>(rtp_ssrc_ >> 16);
+        header[10]  = static_cast<uint8_t>(rtp_ssrc_ >> 8);
+        header[11]  = static_cast<uint8_t>(rtp_ssrc_);
+    }
+
+#ifdef _WIN32
+    int     sent = 0;
+    uint8_t packet[rtp_header_size + datagram_size];
+    for (size_t n = 0; n < count; ++n) {
+        const auto& payload = ring_[(first + n) % ring_.size()];
+        size_t      size    = 0;
+        if (rtp_) {
+            std::memcpy(packet, headers[n], rtp_header_size);
+            size = rtp_header_size;
+        }
+        std::memcpy(packet + size, payload.data(), datagram_size);
+        size += datagram_size;
+        if (sendto(static_cast<SOCKET>(socket_), reinterpret_cast<const char*>(packet), static_cast<int>(size), 0,
+                   reinterpret_cast<const sockaddr*>(address_.data()), static_cast<int>(address_.size())) < 0) {
+            break;
+        }
+        ++sent;
+    }
+    return sent;
+#else
+    mmsghdr messages[max_batch] = {};
+    iovec   iov[max_batch][2];
+    for (size_t n = 0; n < count; ++n) {
+        auto& payload = ring_[(first + n) % ring_.size()];
+        int   parts   = 0;
+        if (rtp_) {
+            iov[n][parts++] = {headers[n], rtp_header_size};
+        }
+        iov[n][parts++] = {payload.data(), datagram_size};
+
+        messages[n].msg_hdr.msg_name    = address_.data();
+        messages[n].msg_hdr.msg_namelen = static_cast<socklen_t>(address_.size());
+        messages[n].msg_hdr.msg_iov     = iov[n];
+        messages[n].msg_hdr.msg_iovlen  = parts;
+    }
+    return sendmmsg(static_cast<int>(socket_), messages, static_cast<unsigned int>(count), 0);
+#endif
+}
+
+udp_pacer_stats GstUdpPacer::stats() const
+{
+    udp_pacer_stats stats;
+    stats.packets = packets_;
+    stats.batches = batches_;
+    stats.late    = late_;
+    stats.dropped = dropped_;
+    stats.queued  = static_cast<int64_t>(write_.load() - read_.load());
+    stats.jitter_avg = jitter_avg_;
+    stats.jitter_max = jitter_max_;
+    return stats;
+}
+
+}} // namespace caspar::gstreamer
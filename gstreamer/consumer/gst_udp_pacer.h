@@ -0,0 +1,98 @@
+#pragma once
+
+#include "../util/gst_thread.h"
+#include "../util/gst_util.h"
+
+#include <gst/app/gstappsink.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+namespace caspar { namespace gstreamer {
+
+struct udp_pacer_stats
+{
+    int64_t packets    = 0;
+    int64_t batches    = 0; // sendmmsg calls, several packets each when the sender fell behind
+    int64_t late       = 0; // schedule restarted after falling more than a frame behind
+    int64_t dropped    = 0; // packets discarded because the queue was full
+    int64_t jitter_avg = 0; // microseconds between the scheduled and actual send time, over the last second
+    int64_t jitter_max = 0; // largest in the last second
+    int64_t queued     = 0; // packets waiting
+};
+
+// Sends a constant bitrate MPEG-TS stream as 7 * 188 byte datagrams, one every
+// 1316 * 8 / bitrate seconds, from a dedicated thread instead of bursting each
+// frame's packets as soon as the muxer produces them. Packets that are due
+// together are sent with one sendmmsg call. With rtp set every datagram gets an
+// RTP header (RFC 2250, payload type 33).
+class GstUdpPacer
+{
+  public:
+    static const size_t datagram_size = 7 * 188;
+
+    GstUdpPacer(const std::string&      host,
+                int                     port,
+                uint64_t                bitrate,
+                bool                    rtp,
+                int                     ttl,
+                const thread_placement& placement);
+    ~GstUdpPacer();
+
+    GstUdpPacer(const GstUdpPacer&)            = delete;
+    GstUdpPacer& operator=(const GstUdpPacer&) = delete;
+
+    // Feeds the pacer from an appsink after an mpegtsmux with alignment=7
+    void attach(GstElement* appsink);
+
+    // Queues transport stream data, split into datagrams
+    void push(GstBuffer* buffer);
+
+    udp_pacer_stats stats() const;
+
+  private:
+    static GstFlowReturn new_sample(GstAppSink* sink, gpointer user_data);
+
+    void run();
+    int  send(uint64_t first, size_t count);
+
+    using datagram = std::array<uint8_t, datagram_size>;
+
+    const std::string              host_;
+    const int                      port_;
+    const uint64_t                 bitrate_;
+    const bool                     rtp_;
+    const std::chrono::nanoseconds interval_;
+
+    intptr_t                 socket_ = -1;
+    std::vector<uint8_t>     address_;
+
+    // Single producer (the appsink's streaming thread), single consumer (the sender thread)
+    std::vector<datagram>    ring_;
+    std::atomic<uint64_t>    write_{0};
+    std::atomic<uint64_t>    read_{0};
+    datagram                 partial_{};
+    size_t                   partial_size_ = 0;
+
+    uint16_t                 rtp_sequence_ = 0;
+    uint32_t                 rtp_ssrc_     = 0;
+
+    std::atomic<int64_t>     packets_{0};
+    std::atomic<int64_t>     batches_{0};
+    std::atomic<int64_t>     late_{0};
+    std::atomic<int64_t>     dropped_{0};
+    std::atomic<int64_t>     jitter_avg_{0}; // of the last complete window, kept by the sender thread
+    std::atomic<int64_t>     jitter_max_{0};
+
+    std::atomic<bool>        abort_request_{false};
+    boost::thread            thread_;
+};
+
+}} // namespace caspar::gstreamer
@@ -17,8 +17,21 @@
 
 #include "gstreamer_consumer.h"
 
+#include "gst_abr.h"
+#include "gst_conversion_cache.h"
+#include "gst_encoder_control.h"
+#include "gst_output_branches.h"
+#include "gst_prewarm_pool.h"
+#include "gst_raw_writer.h"
+#include "gst_reconnecting_output.h"
+#include "gst_ts_multiplex.h"
+#include "gst_udp_pacer.h"
+
 #include "../util/gst_util.h"
 #include "../util/gst_assert.h"
+#include "../util/gst_module_stats.h"
+#include "../util/gst_task_pool.h"
+#include "../util/gst_thread.h"
 
 #include <common/bit_depth.h>
 #include <common/diagnostics/graph.h>
@@ -35,6 +48,7 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/regex.hpp>
 
@@ -42,13 +56,564 @@
 #include <tbb/parallel_for.h>
 #include <tbb/parallel_invoke.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <future>
 #include <memory>
 #include <thread>
 #include <map>
 #include <set>
+#include <tuple>
+#include <utility>
 
 namespace caspar { namespace gstreamer {
 
+// Share of the frame period an encoder may spend on a frame before the consumer warns
+static const double encode_warning_load = 0.8;
+
+// Splits "host:port" of udp:// and rtp:// outputs, 5000 when no port is given
+static std::pair<std::string, int> split_host_port(const std::string& address)
+{
+    size_t port_pos = address.find(":");
+    if (port_pos != std::string::npos) {
+        try {
+            return {address.substr(0, port_pos), std::stoi(address.substr(port_pos + 1))};
+        } catch (...) {
+            // Use defaults if conversion fails
+        }
+    }
+    return {address.substr(0, port_pos), 5000};
+}
+
+std::map<std::string, std::string> parse_consumer_options(const std::string& args)
+{
+    std::map<std::string, std::string> options;
+    
+    // Parse arguments in FFmpeg-style format
+    // Example: -codec:v x264 -bitrate:v 5000 -codec:a aac -bitrate:a 128
+    static boost::regex opt_exp("-([^:\\s]+):?([^\\s=]*)\\s+([^-\\s][^\\s]*)");
+    
+    for (auto it = boost::sregex_iterator(args.begin(), args.end(), opt_exp);
+         it != boost::sregex_iterator();
+         ++it) {
+        std::string param = (*it)[1].str();
+        std::string stream = (*it)[2].str();
+        std::string value = (*it)[3].str();
+        
+        // Store as param or param:stream depending on what was provided
+        std::string key = param + (stream.empty() ? "" : ":" + stream);
+        options[key] = value;
+        
+        // Map some FFmpeg-style parameters to GStreamer ones
+        if (key == "codec:v") {
+            options["vcodec"] = value;
+        } else if (key == "codec:a") {
+            options["acodec"] = value;
+        } else if (key == "bitrate:v") {
+            options["vbitrate"] = value;
+        } else if (key == "bitrate:a") {
+            options["abitrate"] = value;
+        }
+    }
+    
+    return options;
+}
+
+static std::string get_option(const std::map<std::string, std::string>& options,
+                              const std::string&                        key,
+                              const std::string&                        default_value)
+{
+    auto it = options.find(key);
+    return (it != options.end()) ? it->second : default_value;
+}
+
+std::string video_codec_option(const std::map<std::string, std::string>& options)
+{
+    return get_option(options, "codec:v", get_option(options, "vcodec", "x264"));
+}
+
+// -bitrate:v (FFmpeg style) or -vbitrate in kbps, 3000 when neither is given
+static int video_bitrate_option(const std::map<std::string, std::string>& options)
+{
+    int video_bitrate = 3000;
+    try {
+        video_bitrate = std::stoi(get_option(options, "vbitrate", std::to_string(video_bitrate)));
+        // Also check bitrate:v (FFmpeg style)
+        if (options.find("bitrate:v") != options.end()) {
+            video_bitrate = std::stoi(options.at("bitrate:v"));
+        }
+    } catch (...) {
+        // Use default if conversion fails
+    }
+    return video_bitrate;
+}
+
+std::string video_encode_description(const std::map<std::string, std::string>& options,
+                                     int                                       threads,
+                                     bool                                      repeat_headers)
+{
+    std::string pipeline_desc;
+    
+    const auto video_codec   = video_codec_option(options);
+    const auto video_bitrate = video_bitrate_option(options);
+    const auto video_filter  = get_option(options, "filter:v", "");
+    
+    // Add video filter if specified
+    if (!video_filter.empty()) {
+        // Map FFmpeg filters to GStreamer equivalents
+        if (video_filter.find("scale=") != std::string::npos) {
+            // Convert scale filter to GStreamer's videoscale
+            boost::regex scale_regex("scale=width=(\\d+):height=(\\d+)");
+            boost::smatch matches;
+            if (boost::regex_search(video_filter, matches, scale_regex)) {
+                std::string width = matches[1];
+                std::string height = matches[2];
+                pipeline_desc += "videoscale ! video/x-raw,width=" + width + ",height=" + height + " ! ";
+            } else {
+                // Try simpler format scale=WxH
+                boost::regex simple_scale_regex("scale=(\\d+):(\\d+)");
+                if (boost::regex_search(video_filter, matches, simple_scale_regex)) {
+                    std::string width = matches[1];
+                    std::string height = matches[2];
+                    pipeline_desc += "videoscale ! video/x-raw,width=" + width + ",height=" + height + " ! ";
+                } else {
+                    // Default scaling
+                    pipeline_desc += "videoscale ! ";
+                }
+            }
+        }
+        
+        // Support for format conversion
+        if (video_filter.find("format=yuv420p") != std::string::npos) {
+            pipeline_desc += "videoconvert ! video/x-raw,format=I420 ! ";
+        }
+        
+        // Support for framerate conversion
+        boost::regex fps_regex("fps=(\\d+)");
+        boost::smatch fps_matches;
+        if (boost::regex_search(video_filter, fps_matches, fps_regex)) {
+            std::string fps = fps_matches[1];
+            pipeline_desc += "videorate ! video/x-raw,framerate=" + fps + "/1 ! ";
+        }
+    }
+    
+    // Intra-only mezzanine codecs encode the slices of a frame in parallel, so each frame's encode
+    // time is what the encoder guard compares against the frame period
+    int intra_thread_count = threads;
+    try {
+        intra_thread_count = std::stoi(get_option(options, "threads", std::to_string(intra_thread_count)));
+    } catch (...) {
+        // Use default if conversion fails
+    }
+    intra_thread_count = std::max(intra_thread_count, 1);
+    const auto intra_threads = " threads=" + std::to_string(intra_thread_count) + " thread-type=slice";
+    
+    // FFV1 takes a few slice counts only, the smallest that gives every thread a slice
+    int ffv1_slices = 4;
+    for (int slices : {4, 6, 9, 12, 16, 24, 30}) {
+        ffv1_slices = slices;
+        if (slices >= intra_thread_count) {
+            break;
+        }
+    }
+    try {
+        ffv1_slices = std::stoi(get_option(options, "slices", std::to_string(ffv1_slices)));
+    } catch (...) {
+        // Use default if conversion fails
+    }
+    
+    // -g sets a fixed keyframe interval in frames, scene cuts don't start a new one
+    int gop = 0;
+    try {
+        gop = std::stoi(get_option(options, "g", "0"));
+    } catch (...) {
+        // Use default if conversion fails
+    }
+    const auto gop_size = std::to_string(gop);
+    
+    // Add video conversion (needed before encoding)
+    pipeline_desc += "videoconvert ! ";
+    
+    // Add video encoding based on codec
+    if (video_codec == "x264" || video_codec == "libx264") {
+        // H.264 encoding, check for specific x264 parameters (similar to FFmpeg)
+        std::string preset = get_option(options, "preset:v", "veryfast");
+        if (preset != "ultrafast" && preset != "superfast" && preset != "veryfast" && preset != "faster" &&
+            preset != "fast" && preset != "medium" && preset != "slow" && preset != "slower" &&
+            preset != "veryslow") {
+            preset = "veryfast";
+        }
+        pipeline_desc += "x264enc bitrate=" + std::to_string(video_bitrate) + " speed-preset=" + preset +
+                         " tune=zerolatency" +
+                         (gop > 0 ? " key-int-max=" + gop_size + " option-string=\"scenecut=0\"" : "") + " ! ";
+    } else if (video_codec == "openh264") {
+        // OpenH264 encoding (uses bitrate in bits/s rather than kbits/s)
+        pipeline_desc += "openh264enc bitrate=" + std::to_string(video_bitrate*1000) +
+                         (gop > 0 ? " gop-size=" + gop_size + " scene-change-detection=false" : "") + " ! ";
+    } else if (video_codec == "nvenc" || video_codec == "nvh264") {
+        // NVIDIA H.264 encoding
+        pipeline_desc += "nvh264enc bitrate=" + std::to_string(video_bitrate) +
+                         (gop > 0 ? " gop-size=" + gop_size : "") + " ! ";
+    } else if (video_codec == "vp8" || video_codec == "vp9") {
+        // VP8 and VP9 encoding
+        pipeline_desc += video_codec + "enc target-bitrate=" + std::to_string(video_bitrate*1000) +
+                         (gop > 0 ? " keyframe-max-dist=" + gop_size : "") + " ! ";
+    } else if (video_codec == "jpeg" || video_codec == "mjpeg") {
+        // JPEG encoding
+        pipeline_desc += "jpegenc quality=85 ! ";
+    } else if (video_codec == "prores") {
+        // ProRes, 4444 (the default) and 4444xq keep the channel's alpha, the others are 10 bit 4:2:2
+        const auto profile = get_option(options, "profile:v", "4444");
+        const bool alpha   = profile == "4444" || profile == "4444xq";
+        pipeline_desc += std::string("video/x-raw,format=") + (alpha ? "A444_10LE" : "I422_10LE") +
+                         " ! avenc_prores_ks profile=" + profile + intra_threads + " ! ";
+    } else if (video_codec == "dnxhr") {
+        // DNxHR, hq (the default), sq and lb are 8 bit 4:2:2, hqx 10 bit 4:2:2 and 444 10 bit 4:4:4
+        const auto  profile = get_option(options, "profile:v", "hq");
+        const char* format  = profile == "444" ? "Y444_10LE" : profile == "hqx" ? "I422_10LE" : "Y42B";
+        pipeline_desc += std::string("video/x-raw,format=") + format + " ! avenc_dnxhd profile=dnxhr_" + profile +
+                         intra_threads + " ! ";
+    } else if (video_codec == "ffv1") {
+        // Lossless FFV1 version 3, coded in slices that are encoded in parallel. BGRA keeps the alpha.
+        pipeline_desc += "video/x-raw,format=BGRA ! avenc_ffv1 level=3 slicecrc=1 slices=" +
+                         std::to_string(ffv1_slices) + intra_threads + " ! ";
+    } else if (video_codec == "qtrle") {
+        // QuickTime Animation, lossless RGB with alpha
+        pipeline_desc += "video/x-raw,format=ARGB ! avenc_qtrle ! ";
+    } else {
+        // Default to H.264 if codec not recognized
+        CASPAR_LOG(warning) << "Unrecognized video codec '" << video_codec << "', using x264 instead";
+        pipeline_desc += "x264enc bitrate=" + std::to_string(video_bitrate) +
+                         " speed-preset=veryfast tune=zerolatency" +
+                         (gop > 0 ? " key-int-max=" + gop_size + " option-string=\"scenecut=0\"" : "") + " ! ";
+    }
+    
+    // Add necessary parser
+    if (video_codec == "x264" || video_codec == "libx264" || video_codec == "nvenc" || video_codec == "nvh264" || video_codec == "openh264") {
+        // Receivers joining a transport stream mid-stream need the parameter sets with every keyframe
+        pipeline_desc += repeat_headers ? "h264parse config-interval=-1 ! " : "h264parse ! ";
+    } else if (video_codec == "vp8") {
+        pipeline_desc += "vp8parse ! ";
+    } else if (video_codec == "vp9") {
+        pipeline_desc += "vp9parse ! ";
+    }
+    
+    return pipeline_desc;
+}
+
+std::string output_description(const std::string&                        path,
+                               const std::map<std::string, std::string>& options,
+                               const std::string&                        before_sink)
+{
+    const auto video_codec = video_codec_option(options);
+    const auto format      = get_option(options, "format", "");
+    
+    std::string pipeline_desc;
+    
+    // Determine output format based on path and options
+    bool path_is_stream = path.find("://") != std::string::npos;
+    std::string container_format;
+
+    // Override format if specified in options
+    if (!format.empty()) {
+        container_format = format;
+    } else if (path_is_stream) {
+        // For streaming, determine protocol
+        if (path.substr(0, 7) == "rtmp://") {
+            container_format = "flv";
+        } else if (path.substr(0, 7) == "rtsp://") {
+            container_format = "rtp";
+        } else if (path.substr(0, 6) == "udp://") {
+            container_format = "ts";
+        } else if (path.substr(0, 7) == "http://") {
+            container_format = "hls";
+        }
+    } else {
+        // For files, use extension
+        std::string ext = boost::filesystem::path(path).extension().string();
+        boost::to_lower(ext);
+    
+        if (ext == ".mp4") {
+            container_format = "mp4";
+        } else if (ext == ".mov") {
+            container_format = "mov";
+        } else if (ext == ".flv") {
+            container_format = "flv";
+        } else if (ext == ".mkv") {
+            container_format = "matroska";
+        } else if (ext == ".ts") {
+            container_format = "ts";
+        } else if (ext == ".webm") {
+            container_format = "webm";
+        } else if (ext == ".avi") {
+            container_format = "avi";
+        } else if (ext == ".mxf") {
+            container_format = "mxf";
+        } else {
+            // Default to MP4 if unknown extension
+            container_format = "mp4";
+            CASPAR_LOG(warning) << "Unknown file extension, defaulting to mp4 container format";
+        }
+    }
+
+    // Configure container/muxer and output
+    if (path_is_stream) {
+        if (path.substr(0, 7) == "rtmp://") {
+            pipeline_desc += "flvmux streamable=true ! rtmpsink location=\"" + path + "\" ";
+        } else if (path.substr(0, 7) == "rtsp://") {
+            pipeline_desc += "rtph264pay ! udpsink host=" + path.substr(7) + " port=5000 ";
+        } else if (path.substr(0, 6) == "udp://") {
+            // Extract host and port if specified
+            auto address = split_host_port(path.substr(6));
+            std::string host = address.first;
+            int port = address.second;
+        
+            pipeline_desc += "mpegtsmux ! udpsink host=" + host + " port=" + std::to_string(port) + " ";
+        } else if (path.substr(0, 7) == "http://") {
+            pipeline_desc += "mpegtsmux ! hlssink location=" + path.substr(7) + " ";
+        } else {
+            // Default streaming output
+            pipeline_desc += "mpegtsmux ! filesink location=\"" + path + "\" ";
+        }
+    } else {
+        // File output with container format
+        const auto mov_path = boost::filesystem::path(path).replace_extension(".mov").string();
+        if (video_codec == "qtrle") {
+            // qtmux has no QuickTime Animation, libav's muxer does
+            pipeline_desc += "avmux_mov ! filesink location=\"" + mov_path + "\" ";
+        } else if ((video_codec == "prores" || video_codec == "dnxhr") && container_format != "mov" &&
+                   container_format != "matroska" && container_format != "mkv" &&
+                   !(video_codec == "dnxhr" && container_format == "mxf")) {
+            CASPAR_LOG(warning) << video_codec
+                                << " requires a MOV or MKV container. Switching to MOV container.";
+            pipeline_desc += "qtmux ! filesink location=\"" + mov_path + "\" ";
+        } else if (video_codec == "ffv1" && container_format != "matroska" && container_format != "mkv" &&
+                   container_format != "avi") {
+            CASPAR_LOG(warning) << "FFV1 requires an MKV or AVI container. Switching to MKV container.";
+            pipeline_desc += "matroskamux ! filesink location=\"" +
+                             boost::filesystem::path(path).replace_extension(".mkv").string() + "\" ";
+        } else if (container_format == "mp4") {
+            pipeline_desc += "mp4mux ! filesink location=\"" + path + "\" ";
+        } else if (container_format == "mov") {
+            pipeline_desc += "qtmux ! filesink location=\"" + path + "\" ";
+        } else if (container_format == "flv") {
+            pipeline_desc += "flvmux ! filesink location=\"" + path + "\" ";
+        } else if (container_format == "matroska" || container_format == "mkv") {
+            pipeline_desc += "matroskamux ! filesink location=\"" + path + "\" ";
+        } else if (container_format == "ts") {
+            pipeline_desc += "mpegtsmux ! filesink location=\"" + path + "\" ";
+        } else if (container_format == "webm") {
+            if (video_codec == "vp8" || video_codec == "vp9") {
+                pipeline_desc += "webmmux ! filesink location=\"" + path + "\" ";
+            } else {
+                // Can't use webm container with non-VP8/VP9 codecs
+                CASPAR_LOG(warning) << "WebM container requires VP8 or VP9 codec. Switching to MKV container.";
+                pipeline_desc += "matroskamux ! filesink location=\"" + 
+                                boost::filesystem::path(path).replace_extension(".mkv").string() + "\" ";
+            }
+        } else if (container_format == "avi") {
+            pipeline_desc += "avimux ! filesink location=\"" + path + "\" ";
+        } else if (container_format == "mxf") {
+            pipeline_desc += "mxfmux ! filesink location=\"" + path + "\" ";
+        } else {
+            // Default to MP4
+            pipeline_desc += "mp4mux ! filesink location=\"" + path + "\" ";
+        }
+    }
+    
+    // Every output above ends in its sink
+    if (!before_sink.empty()) {
+        pipeline_desc.insert(pipeline_desc.rfind(" ! ") + 3, before_sink);
+    }
+    return pipeline_desc;
+}
+
+// Branch of a -proxy output, fed from a tee in front of the master's encoder. The frame rate is
+// reduced before scaling so only the frames kept are scaled, then the proxy has its own encoder and
+// file. The master's keyframe interval becomes a whole number of proxy intervals, so both files
+// have keyframes at the same times.
+static std::string proxy_description(const std::map<std::string, std::string>& options,
+                                     const core::video_format_desc&            format_desc,
+                                     int                                       threads,
+                                     std::map<std::string, std::string>&       master_options)
+{
+    // -proxy_size WxH, half the channel's by default
+    int        width  = format_desc.width / 2 & ~1;
+    int        height = format_desc.height / 2 & ~1;
+    const auto size   = get_option(options, "proxy_size", "");
+    if (!size.empty()) {
+        boost::smatch matches;
+        if (!boost::regex_match(size, matches, boost::regex("(\\d+)x(\\d+)"))) {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Proxy size must be WIDTHxHEIGHT"));
+        }
+        width  = std::stoi(matches[1]);
+        height = std::stoi(matches[2]);
+    }
+    
+    // -proxy_rate as 25 or 30000/1001 has to divide the channel's rate, which is halved above 30 fps by default
+    const int64_t num  = format_desc.framerate.numerator();
+    const int64_t den  = format_desc.framerate.denominator();
+    int64_t       step = format_desc.fps > 30.0 ? 2 : 1;
+    const auto    rate = get_option(options, "proxy_rate", "");
+    if (!rate.empty()) {
+        int64_t rate_num = 0;
+        int64_t rate_den = 1;
+        try {
+            const auto slash = rate.find('/');
+            rate_num         = std::stoll(rate.substr(0, slash));
+            rate_den         = slash == std::string::npos ? 1 : std::stoll(rate.substr(slash + 1));
+        } catch (...) {
+            // Rejected below
+        }
+        if (rate_num <= 0 || rate_den <= 0 || (num * rate_den) % (den * rate_num) != 0) {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("The proxy frame rate must divide the channel's"));
+        }
+        step = num * rate_den / (den * rate_num);
+    }
+    
+    // A keyframe every 2 seconds unless -g is given, rounded up to whole proxy intervals
+    int64_t gop = std::llround(format_desc.fps * 2);
+    try {
+        gop = std::stoll(get_option(master_options, "g", std::to_string(gop)));
+    } catch (...) {
+        // Use default if conversion fails
+    }
+    gop                 = (std::max<int64_t>(gop, 1) + step - 1) / step * step;
+    master_options["g"] = std::to_string(gop);
+    
+    std::map<std::string, std::string> proxy_options;
+    proxy_options["vcodec"]   = get_option(options, "proxy_codec", "x264");
+    proxy_options["vbitrate"] = get_option(options, "proxy_bitrate", "1500");
+    proxy_options["g"]        = std::to_string(gop / step);
+    
+    return "videorate drop-only=true ! video/x-raw,framerate=" + std::to_string(num) + "/" +
+           std::to_string(den * step) + " ! videoscale ! video/x-raw,width=" + std::to_string(width) +
+           ",height=" + std::to_string(height) + " ! " + video_encode_description(proxy_options, threads, false) +
+           output_description(get_option(options, "proxy", ""), proxy_options);
+}
+
+// Source of frames in the format, at the channel's size and rate
+static std::string video_source_description(const std::string&             name,
+                                            const std::string&             format,
+                                            const core::video_format_desc& format_desc)
+{
+    return "appsrc name=" + name + " format=time do-timestamp=true is-live=true caps=video/x-raw,format=" + format +
+           ",width=" + std::to_string(format_desc.width) + ",height=" + std::to_string(format_desc.height) +
+           ",framerate=" + std::to_string(format_desc.framerate.numerator()) + "/" +
+           std::to_string(format_desc.framerate.denominator()) + " ! ";
+}
+
+// The 8 bit 4:2:0 encoders take frames converted once for all consumers of the channel, their
+// videoconvert then has nothing left to do. A separate key is split from the frames as they are.
+static bool shared_conversion(const std::map<std::string, std::string>& options)
+{
+    const auto video_codec = video_codec_option(options);
+    return get_option(options, "key", "").empty() && get_option(options, "shared_convert", "1") != "0" &&
+           env::properties().get(L"configuration.gstreamer.conversion-cache.enabled", true) &&
+           (video_codec == "x264" || video_codec == "libx264" || video_codec == "openh264" ||
+            video_codec == "nvenc" || video_codec == "nvh264" || video_codec == "vp8" || video_codec == "vp9" ||
+            video_codec == "jpeg" || video_codec == "mjpeg");
+}
+
+// Codecs that keep alpha store it straight, as the producer's ALPHA AUTO plays it back. The
+// channel's premultiplied colors are divided by alpha while the frame is copied, unless the file
+// is asked to keep them with -alpha premultiplied.
+static alpha_mode recorded_alpha(const std::map<std::string, std::string>& options)
+{
+    const auto video_codec = video_codec_option(options);
+    const auto profile     = get_option(options, "profile:v", "4444");
+    const bool keeps_alpha = video_codec == "qtrle" || video_codec == "ffv1" ||
+                             (video_codec == "prores" && (profile == "4444" || profile == "4444xq"));
+    const auto alpha       = get_option(options, "alpha", "straight");
+    if (alpha != "straight" && alpha != "premultiplied") {
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("-alpha must be straight or premultiplied"));
+    }
+    return keeps_alpha && get_option(options, "key", "").empty() && alpha == "straight" ? alpha_mode::straight
+                                                                                       : alpha_mode::premultiplied;
+}
+
+// A program number sends the channel as one program of a multiplex shared with other channels
+static bool multiplexed_output(const std::map<std::string, std::string>& options, const std::string& path)
+{
+    return options.find("program") != options.end() && path.substr(0, 6) == "udp://";
+}
+
+// Paced output sends a constant bitrate stream on a fixed packet schedule instead of in bursts
+static bool paced_output(const std::map<std::string, std::string>& options, const std::string& path)
+{
+    const auto pacing = get_option(options, "pacing", "0");
+    return !multiplexed_output(options, path) &&
+           (path.substr(0, 6) == "rtp://" || (path.substr(0, 6) == "udp://" && pacing != "0" && pacing != "off"));
+}
+
+// Streams adapt to their uplink, by default RTMP between a quarter of the bitrate and the bitrate.
+// Null when the output doesn't adapt.
+static std::unique_ptr<GstAbr> create_abr(const std::map<std::string, std::string>& options,
+                                          const std::string&                        path,
+                                          const core::video_format_desc&            format_desc)
+{
+    const auto video_codec   = video_codec_option(options);
+    const auto video_bitrate = video_bitrate_option(options);
+    const auto abr           = get_option(options, "abr", path.substr(0, 7) == "rtmp://" ? "auto" : "off");
+    if (abr == "off") {
+        return nullptr;
+    }
+    if (multiplexed_output(options, path) || paced_output(options, path) || !get_option(options, "key", "").empty() ||
+        !get_option(options, "proxy", "").empty() || !GstAbr::supports(video_codec)) {
+        if (abr != "auto") {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info(
+                                       "Adaptive bitrate needs an H.264, VP8 or VP9 stream without "
+                                       "multiplexing, pacing, separate key or proxy"));
+        }
+        return nullptr;
+    }
+
+    GstAbr::Settings settings;
+    settings.codec      = video_codec;
+    settings.min_kbps   = std::max(video_bitrate / 4, 100);
+    settings.max_kbps   = video_bitrate;
+    settings.start_kbps = video_bitrate;
+    settings.width      = format_desc.width;
+    settings.height     = format_desc.height;
+    try {
+        boost::smatch bounds;
+        if (boost::regex_match(abr, bounds, boost::regex("(\\d+):(\\d+)"))) {
+            settings.min_kbps = std::stoi(bounds[1]);
+            settings.max_kbps = std::max(std::stoi(bounds[2]), settings.min_kbps);
+        }
+        settings.high_ms       = std::stoi(get_option(options, "abr_high", "1000"));
+        settings.low_ms        = std::stoi(get_option(options, "abr_low", "200"));
+        settings.throttle_kbps = std::stoi(get_option(options, "abr_throttle", "0"));
+    } catch (...) {
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Invalid adaptive bitrate options"));
+    }
+    return std::make_unique<GstAbr>(settings);
+}
+
+std::string encoder_pipeline_description(const std::map<std::string, std::string>& options,
+                                         const std::string&                        path,
+                                         const core::video_format_desc&            format_desc,
+                                         int                                       threads)
+{
+    if (!get_option(options, "key", "").empty() || !get_option(options, "proxy", "").empty() ||
+        multiplexed_output(options, path) || paced_output(options, path)) {
+        return "";
+    }
+    const auto abr = create_abr(options, path, format_desc);
+    return video_source_description("video_src", shared_conversion(options) ? "I420" : "BGRA", format_desc) +
+           (abr ? abr->scale_description() : "") + video_encode_description(options, threads, false) +
+           "tee name=output_tee ";
+}
+
+struct gstreamer_consumer;
+
+// Running consumers, for GSCALL to find by their outputs
+static std::mutex                       consumers_mutex;
+static std::vector<gstreamer_consumer*> consumers;
+
 struct gstreamer_consumer : public core::frame_consumer
 {
     core::monitor::state    state_;
@@ -69,10 +634,62 @@ struct gstreamer_consumer : public core::frame_consumer
     std::thread                                      frame_thread_;
 
     common::bit_depth depth_;
+    thread_placement  placement_;
     
     // GStreamer pipeline
     gst_ptr<GstElement>     pipeline_;
     gst_ptr<GstElement>     appsrc_;
+    gst_ptr<GstElement>     key_src_; // Key of separate fill and key outputs, appsrc_ then carries the fill
+    
+    // Program in a multiplex shared with other channels, fed from the encoded_sink appsink
+    std::shared_ptr<GstTsMultiplex::Program> program_;
+    gst_ptr<GstElement>                      encoded_sink_;
+    
+    // Uncompressed capture to disk, instead of a pipeline
+    std::unique_ptr<GstRawWriter>            raw_writer_;
+    caspar::timer                            raw_timer_;
+    
+    // Paced sender of udp:// and rtp:// transport streams
+    std::shared_ptr<GstUdpPacer>             pacer_;
+    
+    // Bitrate and resolution adapted to the uplink of streams
+    std::unique_ptr<GstAbr>                  abr_;
+    std::string                              abr_output_; // path of the output whose queue it watches
+    
+    // Live reconfiguration. Commands run on the frame thread between two frames, the outputs hang
+    // off a tee after the encoder, except for multiplexed and paced streams.
+    std::string                                   video_codec_;
+    std::map<std::string, std::string>            options_;
+    std::shared_ptr<GstEncoderControl>            encoder_control_;
+    std::unique_ptr<GstOutputBranches>            outputs_;
+    tbb::concurrent_queue<std::function<void()>> control_tasks_;
+    
+    // Colour conversion shared with the channel's other consumers, the frames go in converted
+    std::shared_ptr<GstConversionCache>           conversion_cache_;
+    GstVideoFormat                                conversion_format_ = GST_VIDEO_FORMAT_UNKNOWN;
+    alpha_mode                                    sample_alpha_      = alpha_mode::premultiplied;
+    
+    // Stream outputs sent from pipelines of their own that reconnect, by path
+    std::map<std::string, std::shared_ptr<GstReconnectingOutput>> reconnecting_;
+    
+    // Encode time of each frame, measured between the encoders' sink and source pads
+    using encode_key = std::pair<GstElement*, GstClockTime>;
+    
+    std::mutex                                                 encode_mutex_;
+    std::map<encode_key, std::chrono::steady_clock::time_point> encode_started_;
+    int                                                        encoders_           = 0;
+    int64_t                                                    encoded_frames_     = 0;
+    int64_t                                                    encode_time_sum_us_ = 0;
+    int64_t                                                    encode_time_max_us_ = 0;
+    caspar::timer                                              encode_timer_;
+    caspar::timer                                              encode_warning_timer_;
+    
+    // Time from ADD to the first encoded frame, split at PLAYING, and whether the pipeline was built ahead
+    caspar::timer added_timer_;
+    double        playing_ms_       = -1;
+    double        first_frame_ms_   = -1; // under encode_mutex_
+    bool          startup_reported_ = false;
+    bool          prewarmed_        = false;
     
     // Frame buffer & processing
     std::atomic<bool>       is_running_{false};
@@ -102,12 +719,24 @@ struct gstreamer_consumer : public core::frame_consumer
         graph_->set_color("frame-time", diagnostics::color(0.1f, 1.0f, 0.1f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
         graph_->set_color("input", diagnostics::color(0.7f, 0.4f, 0.4f));
+        graph_->set_color("pacing-jitter", diagnostics::color(0.9f, 0.9f, 0.2f));
+        graph_->set_color("encode-time", diagnostics::color(0.2f, 0.6f, 0.9f));
+        graph_->set_color("encode-slow", diagnostics::color(1.0f, 0.4f, 0.1f));
+        graph_->set_color("write-latency", diagnostics::color(0.6f, 0.3f, 0.9f));
         
         CASPAR_LOG(info) << "Created GStreamer consumer for " << path_;
+        
+        std::lock_guard<std::mutex> lock(consumers_mutex);
+        consumers.push_back(this);
     }
 
     ~gstreamer_consumer()
     {
+        {
+            std::lock_guard<std::mutex> lock(consumers_mutex);
+            consumers.erase(std::remove(consumers.begin(), consumers.end(), this), consumers.end());
+        }
+        
         aborting_ = true;
         
         if (frame_thread_.joinable()) {
@@ -115,9 +744,16 @@ struct gstreamer_consumer : public core::frame_consumer
             frame_thread_.join();
         }
         
+        for (const auto& output : reconnecting_) {
+            output.second->stop();
+        }
+        
         if (pipeline_) {
             gst_element_set_state(pipeline_.get(), GST_STATE_NULL);
         }
+        program_.reset();
+        pacer_.reset();
+        raw_writer_.reset();
     }
 
     // frame consumer
@@ -129,47 +765,38 @@ struct gstreamer_consumer : public core::frame_consumer
 
         format_desc_   = format_desc;
         channel_index_ = channel_index;
+        placement_     = channel_placement(channel_index);
+        
+        prime_prewarm_pool(channel_index, format_desc);
 
         graph_->set_text(print());
 
         frame_thread_ = std::thread([this] {
             try {
-                std::map<std::string, std::string> options;
-                {
-                    // Parse arguments in FFmpeg-style format
-                    // Example: -codec:v x264 -bitrate:v 5000 -codec:a aac -bitrate:a 128
-                    static boost::regex opt_exp("-([^:]+):?([^\\s=]*)\\s+([^-\\s][^\\s]*)");
-                    
-                    for (auto it = boost::sregex_iterator(args_.begin(), args_.end(), opt_exp);
-                         it != boost::sregex_iterator();
-                         ++it) {
-                        std::string param = (*it)[1].str();
-                        std::string stream = (*it)[2].str();
-                        std::string value = (*it)[3].str();
-                        
-                        // Store as param or param:stream depending on what was provided
-                        std::string key = param + (stream.empty() ? "" : ":" + stream);
-                        options[key] = value;
-                        
-                        // Map some FFmpeg-style parameters to GStreamer ones
-                        if (key == "codec:v") {
-                            options["vcodec"] = value;
-                        } else if (key == "codec:a") {
-                            options["acodec"] = value;
-                        } else if (key == "bitrate:v") {
-                            options["vbitrate"] = value;
-                        } else if (key == "bitrate:a") {
-                            options["abitrate"] = value;
-                        }
-                    }
-                }
+                apply_thread_placement(placement_);
 
+                const auto options = parse_consumer_options(args_);
+                
                 // Log the parsed options
                 CASPAR_LOG(info) << "GStreamer consumer options:";
                 for (const auto& pair : options) {
                     CASPAR_LOG(info) << "  " << pair.first << " = " << pair.second;
                 }
 
+                // Raw capture writes the frames as they are, without a pipeline
+                auto format = options.find("format");
+                if (format != options.end() && format->second == "raw") {
+                    auto pix_fmt = options.find("pix_fmt");
+                    raw_writer_  = std::make_unique<GstRawWriter>(
+                        path_, GstRawWriter::parse_format(pix_fmt != options.end() ? pix_fmt->second : "v210"),
+                        format_desc_, placement_);
+                    
+                    is_running_ = true;
+                    
+                    process_frames();
+                    return;
+                }
+                
                 // Create GStreamer pipeline with the extracted options
                 create_pipeline(options);
                 
@@ -184,6 +811,7 @@ struct gstreamer_consumer : public core::frame_consumer
                     CASPAR_LOG(error) << "Failed to start GStreamer pipeline for " << path_;
                     return;
                 }
+                playing_ms_ = added_timer_.elapsed() * 1000.0;
                 
                 is_running_ = true;
                 
@@ -228,296 +856,783 @@ struct gstreamer_consumer : public core::frame_consumer
         return state_;
     }
     
+    // Whether path is one of the outputs, for GSCALL
+    bool has_output(const std::string& path) const
+    {
+        return path == path_ || (is_running_ && outputs_ && outputs_->contains(path));
+    }
+    
+    // A command to the running consumer, run by the frame thread between two frames. The last
+    // one and its result stay in the state for clients that can't wait for the answer.
+    std::future<std::wstring> reconfigure(const std::vector<std::wstring>& params)
+    {
+        {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["control/last-command"] = u8(boost::join(params, L" "));
+            state_["control/status"]       = std::string("pending");
+            state_["control/result"]       = std::string();
+        }
+
+        auto result = std::make_shared<std::promise<std::wstring>>();
+        control_tasks_.push([this, params, result] {
+            std::string status = "done";
+            std::string reply;
+            try {
+                reply = run_command(params);
+                result->set_value(u16(reply));
+            } catch (...) {
+                status = "failed";
+                try {
+                    throw;
+                } catch (const boost::exception& e) {
+                    const auto message = boost::get_error_info<msg_info_t>(e);
+                    reply              = message ? *message : "failed";
+                } catch (const std::exception& e) {
+                    reply = e.what();
+                } catch (...) {
+                    reply = "failed";
+                }
+                CASPAR_LOG(warning) << print() << L" " << u16(boost::join(params, L" ")) << L": " << u16(reply);
+                result->set_exception(std::current_exception());
+            }
+
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["control/status"] = status;
+            state_["control/result"] = reply;
+        });
+        return result->get_future();
+    }
+    
 private:
-    // Create a GStreamer pipeline based on options
-    void create_pipeline(const std::map<std::string, std::string>& options) 
+    static GstFlowReturn new_encoded_sample(GstAppSink* sink, gpointer user_data)
     {
-        std::string pipeline_desc;
-        
-        // Check if we're streaming or writing to a file
-        bool is_stream = path_.find("://") != std::string::npos;
-        
-        // Get format-specific options
-        std::string video_codec = "x264";  // Default codec
-        int video_bitrate = 3000;          // Default bitrate (kbps)
-        int audio_bitrate = 128;           // Default audio bitrate (kbps)
-        // Audio muxing options can be implemented later if needed
-        std::string video_filter;          // Video filter string
-        std::string audio_filter;          // Audio filter string
-        std::string format;                // Container format override
-        
-        // Extract options from the map
-        auto get_option = [&options](const std::string& key, const std::string& default_value) {
-            auto it = options.find(key);
-            return (it != options.end()) ? it->second : default_value;
-        };
+        auto self   = static_cast<gstreamer_consumer*>(user_data);
+        auto sample = gst_app_sink_pull_sample(sink);
+        if (!sample) {
+            return GST_FLOW_EOS;
+        }
+        self->program_->push(sample);
+        gst_sample_unref(sample);
+        return GST_FLOW_OK;
+    }
+
+    static GstPadProbeReturn encoder_input(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+    {
+        auto self   = static_cast<gstreamer_consumer*>(user_data);
+        auto buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        if (buffer && GST_BUFFER_PTS_IS_VALID(buffer)) {
+            std::lock_guard<std::mutex> lock(self->encode_mutex_);
+            self->encode_started_[{GST_PAD_PARENT(pad), GST_BUFFER_PTS(buffer)}] = std::chrono::steady_clock::now();
+        }
+        return GST_PAD_PROBE_OK;
+    }
+    
+    static GstPadProbeReturn encoder_output(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+    {
+        auto self   = static_cast<gstreamer_consumer*>(user_data);
+        auto buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        if (!buffer || !GST_BUFFER_PTS_IS_VALID(buffer)) {
+            return GST_PAD_PROBE_OK;
+        }
         
-        // Get video codec
-        video_codec = get_option("vcodec", video_codec);
-        // Also check codec:v (FFmpeg style)
-        if (options.find("codec:v") != options.end()) {
-            video_codec = options.at("codec:v");
+        std::lock_guard<std::mutex> lock(self->encode_mutex_);
+        if (self->first_frame_ms_ < 0) {
+            self->first_frame_ms_ = self->added_timer_.elapsed() * 1000.0;
         }
         
-        // Get audio codec
-        std::string audio_codec = get_option("acodec", "aac");
-        // Also check codec:a (FFmpeg style)
-        if (options.find("codec:a") != options.end()) {
-            audio_codec = options.at("codec:a");
+        auto it = self->encode_started_.find({GST_PAD_PARENT(pad), GST_BUFFER_PTS(buffer)});
+        if (it != self->encode_started_.end()) {
+            const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                                     std::chrono::steady_clock::now() - it->second)
+                                     .count();
+            self->encode_time_sum_us_ += elapsed;
+            self->encode_time_max_us_ = std::max<int64_t>(self->encode_time_max_us_, elapsed);
+            self->encoded_frames_++;
+            self->encode_started_.erase(it);
         }
         
-        // Get video bitrate
-        try {
-            video_bitrate = std::stoi(get_option("vbitrate", std::to_string(video_bitrate)));
-            // Also check bitrate:v (FFmpeg style)
-            if (options.find("bitrate:v") != options.end()) {
-                video_bitrate = std::stoi(options.at("bitrate:v"));
+        // Frames the encoder dropped never come out
+        while (self->encode_started_.size() > 256) {
+            self->encode_started_.erase(self->encode_started_.begin());
+        }
+        return GST_PAD_PROBE_OK;
+    }
+    
+    static bool is_video_encoder(GstElement* element)
+    {
+        auto factory = gst_element_get_factory(element);
+        auto klass   = factory ? gst_element_factory_get_metadata(factory, GST_ELEMENT_METADATA_KLASS) : nullptr;
+        return klass && std::strstr(klass, "Encoder") && std::strstr(klass, "Video");
+    }
+    
+    // Times every video encoder of the pipeline, the fill's and the key's
+    void watch_encoders()
+    {
+        GstIterator* it   = gst_bin_iterate_recurse(GST_BIN(pipeline_.get()));
+        GValue       item = G_VALUE_INIT;
+        while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+            auto element = GST_ELEMENT(g_value_get_object(&item));
+            if (is_video_encoder(element) && watch_encoder(element)) {
+                encoders_++;
             }
-        } catch (...) {
-            // Use default if conversion fails
+            g_value_reset(&item);
+        }
+        g_value_unset(&item);
+        gst_iterator_free(it);
+    }
+    
+    bool watch_encoder(GstElement* element)
+    {
+        GstPad* sink    = gst_element_get_static_pad(element, "sink");
+        GstPad* src     = gst_element_get_static_pad(element, "src");
+        const bool both = sink && src;
+        if (both) {
+            gst_pad_add_probe(sink, GST_PAD_PROBE_TYPE_BUFFER, &encoder_input, this, nullptr);
+            gst_pad_add_probe(src, GST_PAD_PROBE_TYPE_BUFFER, &encoder_output, this, nullptr);
+        }
+        if (sink) {
+            gst_object_unref(sink);
+        }
+        if (src) {
+            gst_object_unref(src);
+        }
+        return both;
+    }
+    
+    // The fill's encoder, the first one downstream of the frames. Through a proxy's tee the
+    // master's branch is the first.
+    gst_ptr<GstElement> find_main_encoder() const
+    {
+        auto element = appsrc_;
+        while (element && !is_video_encoder(element.get())) {
+            GstIterator* it   = gst_element_iterate_src_pads(element.get());
+            GValue       item = G_VALUE_INIT;
+            GstPad*      peer = nullptr;
+            if (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+                peer = gst_pad_get_peer(GST_PAD(g_value_get_object(&item)));
+                g_value_reset(&item);
+            }
+            g_value_unset(&item);
+            gst_iterator_free(it);
+            
+            element = peer ? make_gst_ptr<GstElement>(gst_pad_get_parent_element(peer)) : nullptr;
+            if (peer) {
+                gst_object_unref(peer);
+            }
+        }
+        return element;
+    }
+    
+    // Publishes encode time and throughput once a second, and warns when encoding a frame takes
+    // most of the frame period, before the encoder falls behind and frames are dropped
+    void update_encode_stats()
+    {
+        if (encoders_ == 0 || encode_timer_.elapsed() < 1.0) {
+            return;
         }
         
-        // Get audio bitrate
-        try {
-            audio_bitrate = std::stoi(get_option("abitrate", std::to_string(audio_bitrate)));
-            // Also check bitrate:a (FFmpeg style)
-            if (options.find("bitrate:a") != options.end()) {
-                audio_bitrate = std::stoi(options.at("bitrate:a"));
+        int64_t frames;
+        int64_t sum_us;
+        int64_t max_us;
+        {
+            std::lock_guard<std::mutex> lock(encode_mutex_);
+            frames              = encoded_frames_;
+            sum_us              = encode_time_sum_us_;
+            max_us              = encode_time_max_us_;
+            encoded_frames_     = 0;
+            encode_time_sum_us_ = 0;
+            encode_time_max_us_ = 0;
+        }
+        const auto elapsed = encode_timer_.elapsed();
+        encode_timer_.restart();
+        
+        const double period_ms = 1000.0 / format_desc_.fps;
+        const double avg_ms    = frames > 0 ? sum_us / 1000.0 / frames : 0.0;
+        const double load      = avg_ms / period_ms;
+        
+        graph_->set_value("encode-time", std::min(load, 1.0));
+        if (load > encode_warning_load) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "encode-slow");
+            if (encode_warning_timer_.elapsed() > 10.0) {
+                encode_warning_timer_.restart();
+                CASPAR_LOG(warning) << print() << " Encoding takes " << avg_ms << " ms of the " << period_ms
+                                    << " ms frame period.";
             }
-        } catch (...) {
-            // Use default if conversion fails
         }
         
-        // Check for filter:v option (FFmpeg style)
-        video_filter = get_option("filter:v", "");
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        state_["encode/time-avg-ms"] = avg_ms;
+        state_["encode/time-max-ms"] = max_us / 1000.0;
+        state_["encode/load"]        = load;
+        state_["encode/fps"]         = frames / elapsed / encoders_;
+    }
+    
+    // Logs and publishes the time from ADD to the first encoded frame, once. Caps negotiation and
+    // the encoder's own setup happen after PLAYING, built ahead or not.
+    void update_startup()
+    {
+        if (startup_reported_) {
+            return;
+        }
         
-        // Check for filter:a option (FFmpeg style)
-        audio_filter = get_option("filter:a", "");
+        double first_frame_ms;
+        {
+            std::lock_guard<std::mutex> lock(encode_mutex_);
+            first_frame_ms = first_frame_ms_;
+        }
+        if (first_frame_ms < 0) {
+            return;
+        }
+        startup_reported_ = true;
         
-        // Check for format option (FFmpeg style)
-        format = get_option("format", "");
+        const auto encode_ms = first_frame_ms - std::max(playing_ms_, 0.0);
+        CASPAR_LOG(info) << print() << " First frame encoded " << first_frame_ms << " ms after it was added, "
+                         << playing_ms_ << " ms to PLAYING" << (prewarmed_ ? " on a pipeline built ahead" : "")
+                         << " and " << encode_ms << " ms to negotiate and encode.";
         
-        // Create video source (appsrc)
-        pipeline_desc += "appsrc name=video_src format=time do-timestamp=true is-live=true ";
-        pipeline_desc += "caps=video/x-raw,format=BGRA,width=" + std::to_string(format_desc_.width) + 
-                        ",height=" + std::to_string(format_desc_.height) + 
-                        ",framerate=" + std::to_string(format_desc_.framerate.numerator()) + "/" + 
-                        std::to_string(format_desc_.framerate.denominator()) + " ! ";
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        state_["startup/first-frame-ms"] = first_frame_ms;
+        state_["startup/playing-ms"]     = playing_ms_;
+        state_["startup/encode-ms"]      = encode_ms;
+    }
+    
+    void update_abr()
+    {
+        if (!abr_) {
+            return;
+        }
+        abr_->update();
         
-        // Add video filter if specified
-        if (!video_filter.empty()) {
-            // Map FFmpeg filters to GStreamer equivalents
-            if (video_filter.find("scale=") != std::string::npos) {
-                // Convert scale filter to GStreamer's videoscale
-                boost::regex scale_regex("scale=width=(\\d+):height=(\\d+)");
-                boost::smatch matches;
-                if (boost::regex_search(video_filter, matches, scale_regex)) {
-                    std::string width = matches[1];
-                    std::string height = matches[2];
-                    pipeline_desc += "videoscale ! video/x-raw,width=" + width + ",height=" + height + " ! ";
-                } else {
-                    // Try simpler format scale=WxH
-                    boost::regex simple_scale_regex("scale=(\\d+):(\\d+)");
-                    if (boost::regex_search(video_filter, matches, simple_scale_regex)) {
-                        std::string width = matches[1];
-                        std::string height = matches[2];
-                        pipeline_desc += "videoscale ! video/x-raw,width=" + width + ",height=" + height + " ! ";
-                    } else {
-                        // Default scaling
-                        pipeline_desc += "videoscale ! ";
-                    }
+        const auto abr = abr_->stats();
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        state_["abr/state"]        = abr.state;
+        state_["abr/bitrate"]      = abr.bitrate;
+        state_["abr/rung"]         = abr.rung;
+        state_["abr/resolution"]   = std::to_string(abr.width) + "x" + std::to_string(abr.height);
+        state_["abr/queue-ms"]     = abr.queue_ms;
+        state_["abr/send-ms"]      = abr.send_ms;
+        state_["abr/output-kbps"]  = abr.output_kbps;
+        state_["abr/decreases"]    = abr.decreases;
+        state_["abr/increases"]    = abr.increases;
+        state_["abr/rung-changes"] = abr.rung_changes;
+    }
+    
+    // Picks up what the commands changed in the streaming threads: the encoder that replaced the
+    // previous one, and removed outputs that finished
+    void update_control()
+    {
+        if (encoder_control_) {
+            if (auto encoder = encoder_control_->take_replacement()) {
+                watch_encoder(encoder.get());
+                if (abr_) {
+                    abr_->set_encoder(encoder.get());
                 }
             }
+        }
+        if (outputs_) {
+            outputs_->reap();
+        }
+        // The adaptive bitrate watches the queue of each new connection
+        for (const auto& output : reconnecting_) {
+            auto pipeline = output.second->take_connected();
+            if (pipeline && abr_ && output.first == abr_output_) {
+                abr_->watch_output(pipeline.get());
+            }
+        }
+        
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        if (encoder_control_) {
+            state_["encode/replacements"] = encoder_control_->replacements();
+        }
+        if (outputs_) {
+            state_["outputs/paths"]    = boost::join(outputs_->paths(), " ");
+            state_["outputs/draining"] = static_cast<int64_t>(outputs_->draining());
+        }
+        int n = 0;
+        for (const auto& output : reconnecting_) {
+            const auto stats  = output.second->stats();
+            const auto prefix = "reconnect/" + std::to_string(n++) + "/";
+            state_[prefix + "path"]        = output.first;
+            state_[prefix + "state"]       = stats.state;
+            state_[prefix + "connects"]    = stats.connects;
+            state_[prefix + "disconnects"] = stats.disconnects;
+            state_[prefix + "buffered-ms"] = stats.buffered_ms;
+            state_[prefix + "dropped"]     = stats.dropped;
+            state_[prefix + "backoff-s"]   = stats.backoff_s;
+            state_[prefix + "last-error"]  = stats.last_error;
+        }
+    }
+    
+    // Errors of the pipeline end the consumer, so the channel removes it instead of feeding a
+    // pipeline that stopped. The bus is emptied on the way.
+    void check_bus()
+    {
+        auto bus = make_gst_ptr<GstBus>(gst_element_get_bus(pipeline_.get()));
+        while (auto message = gst_bus_pop(bus.get())) {
+            CASPAR_SCOPE_EXIT { gst_message_unref(message); };
+            if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_ERROR && GST_MESSAGE_TYPE(message) != GST_MESSAGE_WARNING) {
+                continue;
+            }
             
-            // Support for format conversion
-            if (video_filter.find("format=yuv420p") != std::string::npos) {
-                pipeline_desc += "videoconvert ! video/x-raw,format=I420 ! ";
+            GError* err      = nullptr;
+            gchar*  dbg_info = nullptr;
+            if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+                gst_message_parse_error(message, &err, &dbg_info);
+            } else {
+                gst_message_parse_warning(message, &err, &dbg_info);
+            }
+            const std::string text = std::string(GST_MESSAGE_SRC_NAME(message)) + ": " +
+                                     (err ? err->message : "unknown");
+            if (err) {
+                g_error_free(err);
             }
+            g_free(dbg_info);
             
-            // Support for framerate conversion
-            boost::regex fps_regex("fps=(\\d+)");
-            boost::smatch fps_matches;
-            if (boost::regex_search(video_filter, fps_matches, fps_regex)) {
-                std::string fps = fps_matches[1];
-                pipeline_desc += "videorate ! video/x-raw,framerate=" + fps + "/1 ! ";
+            if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_WARNING) {
+                CASPAR_LOG(warning) << print() << L" " << u16(text);
+                continue;
+            }
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("GStreamer pipeline error, " + text));
+        }
+    }
+    
+    GstEncoderControl& encoder_control()
+    {
+        if (!encoder_control_) {
+            CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info("The consumer has no encoder to change"));
+        }
+        return *encoder_control_;
+    }
+    
+    GstOutputBranches& outputs()
+    {
+        if (!outputs_) {
+            CASPAR_THROW_EXCEPTION(invalid_operation()
+                                   << msg_info("Outputs of multiplexed and paced streams can't be changed"));
+        }
+        return *outputs_;
+    }
+    
+    // Outputs have their own parser so they can take another stream format than the others
+    std::string output_parser() const
+    {
+        if (video_codec_ == "x264" || video_codec_ == "libx264" || video_codec_ == "nvenc" ||
+            video_codec_ == "nvh264" || video_codec_ == "openh264") {
+            return "h264parse config-interval=-1 ! ";
+        }
+        return "";
+    }
+    
+    // An output fed from the tee, and watched by the adaptive bitrate. Streams that reconnect, by
+    // default RTMP, are sent from a pipeline of their own fed through an appsink, so their errors
+    // don't stop the encoder.
+    GstElement* add_output(const std::string& path, bool watched)
+    {
+        const auto before_sink = watched ? abr_->queue_description() : std::string();
+        const auto reconnect   = get_option(options_, "reconnect", path.substr(0, 7) == "rtmp://" ? "1" : "0");
+        if (reconnect == "0" || reconnect == "off") {
+            return outputs().add(path, "queue ! " + output_parser() + output_description(path, options_, before_sink));
+        }
+        
+        GstReconnectingOutput::Settings settings;
+        settings.path        = path;
+        settings.description = output_parser() + output_description(path, options_, before_sink);
+        try {
+            settings.buffer_ms      = std::stoi(get_option(options_, "reconnect_buffer", "10")) * 1000;
+            settings.replay         = get_option(options_, "reconnect_replay", "0") == "1";
+            settings.max_backoff_ms = std::stoi(get_option(options_, "reconnect_backoff", "30")) * 1000;
+        } catch (...) {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Invalid reconnect options"));
+        }
+        settings.max_backoff_ms = std::max(settings.max_backoff_ms, settings.min_backoff_ms);
+        
+        std::weak_ptr<GstEncoderControl> encoder = encoder_control_;
+        settings.force_keyframe                  = [encoder] {
+            if (auto control = encoder.lock()) {
+                control->force_keyframe();
             }
+        };
+        
+        auto output = std::make_shared<GstReconnectingOutput>(settings, placement_);
+        auto bin = outputs().add(path, "queue ! " + output_parser() + "appsink name=encoded_output sync=false");
+        auto appsink = make_gst_ptr<GstElement>(gst_bin_get_by_name(GST_BIN(bin), "encoded_output"));
+        output->attach(appsink.get());
+        reconnecting_[path] = output;
+        return bin;
+    }
+    
+    void remove_output(const std::string& path)
+    {
+        outputs().remove(path);
+        
+        auto it = reconnecting_.find(path);
+        if (it != reconnecting_.end()) {
+            it->second->stop();
+            reconnecting_.erase(it);
+        }
+    }
+    
+    std::string run_command(const std::vector<std::wstring>& params)
+    {
+        if (!pipeline_ || params.empty()) {
+            CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info("Nothing to change on " + path_));
         }
         
-        // Add video conversion (needed before encoding)
-        pipeline_desc += "videoconvert ! ";
+        const auto command  = boost::to_upper_copy(u8(params.at(0)));
+        const auto argument = [&](size_t n) {
+            if (params.size() <= n) {
+                CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info(command + " needs more arguments"));
+            }
+            return u8(params.at(n));
+        };
         
-        // Add video encoding based on codec
-        if (video_codec == "x264" || video_codec == "libx264") {
-            // H.264 encoding
-            pipeline_desc += "x264enc bitrate=" + std::to_string(video_bitrate) + 
-                            " speed-preset=veryfast tune=zerolatency ! ";
+        std::string result;
+        if (command == "BITRATE") {
+            const auto kbps = boost::lexical_cast<int>(argument(1));
+            if (kbps <= 0) {
+                CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Invalid bitrate"));
+            }
+            // The adaptive bitrate takes it as its new maximum
+            if (abr_) {
+                abr_->set_max_bitrate(kbps);
+            } else {
+                encoder_control().set({encoder_bitrate_property(video_codec_, kbps)});
+            }
+            result = std::to_string(kbps);
             
-            // Check for specific x264 parameters (similar to FFmpeg)
-            if (options.find("preset:v") != options.end()) {
-                std::string preset = options.at("preset:v");
-                if (preset == "ultrafast" || preset == "superfast" || preset == "veryfast" || 
-                    preset == "faster" || preset == "fast" || preset == "medium" || 
-                    preset == "slow" || preset == "slower" || preset == "veryslow") {
-                    // Replace the default encoder section with updated preset
-                    pipeline_desc = pipeline_desc.substr(0, pipeline_desc.length() - 2);  // Remove " ! "
-                    pipeline_desc = pipeline_desc.substr(0, pipeline_desc.rfind(" "));    // Remove last parameter
-                    pipeline_desc += " speed-preset=" + preset + " tune=zerolatency ! ";
-                }
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["encode/bitrate"] = kbps;
+        } else if (command == "KEYINT") {
+            const auto property = encoder_keyint_property(video_codec_);
+            const auto frames   = boost::lexical_cast<int>(argument(1));
+            if (property.empty() || frames <= 0) {
+                CASPAR_THROW_EXCEPTION(invalid_argument()
+                                       << msg_info("No keyframe interval to set for " + video_codec_));
             }
-        } else if (video_codec == "openh264") {
-            // OpenH264 encoding (uses bitrate in bits/s rather than kbits/s)
-            pipeline_desc += "openh264enc bitrate=" + std::to_string(video_bitrate*1000) + " ! ";
-        } else if (video_codec == "nvenc" || video_codec == "nvh264") {
-            // NVIDIA H.264 encoding
-            pipeline_desc += "nvh264enc bitrate=" + std::to_string(video_bitrate) + " ! ";
-        } else if (video_codec == "vp8") {
-            // VP8 encoding
-            pipeline_desc += "vp8enc target-bitrate=" + std::to_string(video_bitrate*1000) + " ! ";
-        } else if (video_codec == "vp9") {
-            // VP9 encoding
-            pipeline_desc += "vp9enc target-bitrate=" + std::to_string(video_bitrate*1000) + " ! ";
-        } else if (video_codec == "jpeg" || video_codec == "mjpeg") {
-            // JPEG encoding
-            pipeline_desc += "jpegenc quality=85 ! ";
-        } else {
-            // Default to H.264 if codec not recognized
-            CASPAR_LOG(warning) << "Unrecognized video codec '" << video_codec << "', using x264 instead";
-            pipeline_desc += "x264enc bitrate=" + std::to_string(video_bitrate) + 
-                            " speed-preset=veryfast tune=zerolatency ! ";
-        }
-        
-        // Add necessary parser
-        if (video_codec == "x264" || video_codec == "libx264" || video_codec == "nvenc" || video_codec == "nvh264" || video_codec == "openh264") {
-            pipeline_desc += "h264parse ! ";
-        } else if (video_codec == "vp8") {
-            pipeline_desc += "vp8parse ! ";
-        } else if (video_codec == "vp9") {
-            pipeline_desc += "vp9parse ! ";
-        }
-        
-        // Determine output format based on path and options
-        std::string container_format;
-        
-        // Override format if specified in options
-        if (!format.empty()) {
-            container_format = format;
-        } else if (is_stream) {
-            // For streaming, determine protocol
-            if (path_.substr(0, 7) == "rtmp://") {
-                container_format = "flv";
-            } else if (path_.substr(0, 7) == "rtsp://") {
-                container_format = "rtp";
-            } else if (path_.substr(0, 6) == "udp://") {
-                container_format = "ts";
-            } else if (path_.substr(0, 7) == "http://") {
-                container_format = "hls";
+            // A keyframe starts the new interval, a replaced encoder starts on one anyway
+            if (encoder_control().set({{property, std::to_string(frames)}})) {
+                encoder_control().force_keyframe();
             }
-        } else {
-            // For files, use extension
-            std::string ext = boost::filesystem::path(path_).extension().string();
-            boost::to_lower(ext);
+            result = std::to_string(frames);
             
-            if (ext == ".mp4") {
-                container_format = "mp4";
-            } else if (ext == ".mov") {
-                container_format = "mov";
-            } else if (ext == ".flv") {
-                container_format = "flv";
-            } else if (ext == ".mkv") {
-                container_format = "matroska";
-            } else if (ext == ".ts") {
-                container_format = "ts";
-            } else if (ext == ".webm") {
-                container_format = "webm";
-            } else if (ext == ".avi") {
-                container_format = "avi";
-            } else {
-                // Default to MP4 if unknown extension
-                container_format = "mp4";
-                CASPAR_LOG(warning) << "Unknown file extension, defaulting to mp4 container format";
-            }
-        }
-        
-        // Configure container/muxer and output
-        if (is_stream) {
-            if (path_.substr(0, 7) == "rtmp://") {
-                pipeline_desc += "flvmux streamable=true ! rtmpsink location=\"" + path_ + "\" ";
-            } else if (path_.substr(0, 7) == "rtsp://") {
-                pipeline_desc += "rtph264pay ! udpsink host=" + path_.substr(7) + " port=5000 ";
-            } else if (path_.substr(0, 6) == "udp://") {
-                std::string udp_address = path_.substr(6);
-                // Extract host and port if specified
-                size_t port_pos = udp_address.find(":");
-                int port = 5000; // Default port
-                std::string host = udp_address;
-                
-                if (port_pos != std::string::npos) {
-                    try {
-                        port = std::stoi(udp_address.substr(port_pos + 1));
-                        host = udp_address.substr(0, port_pos);
-                    } catch (...) {
-                        // Use defaults if conversion fails
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["encode/key-int"] = frames;
+        } else if (command == "PRESET") {
+            static const std::set<std::string> presets = {"ultrafast", "superfast", "veryfast", "faster", "fast",
+                                                          "medium",    "slow",      "slower",   "veryslow"};
+            const auto                         preset  = boost::to_lower_copy(argument(1));
+            if (video_codec_ != "x264" && video_codec_ != "libx264") {
+                CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Only x264 has presets"));
+            }
+            if (presets.count(preset) == 0) {
+                CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unknown preset " + preset));
+            }
+            encoder_control().set({{"speed-preset", preset}});
+            result = preset;
+            
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["encode/preset"] = preset;
+        } else if (command == "KEYFRAME") {
+            encoder_control().force_keyframe();
+            result = "OK";
+        } else if (command == "OUTPUT") {
+            const auto action = boost::to_upper_copy(argument(1));
+            if (action == "ADD") {
+                const auto path = argument(2);
+                if (outputs().contains(path)) {
+                    CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Already an output: " + path));
+                }
+                add_output(path, false);
+                encoder_control().force_keyframe();
+            } else if (action == "REMOVE") {
+                const auto path = argument(2);
+                if (path == abr_output_) {
+                    CASPAR_THROW_EXCEPTION(invalid_argument()
+                                           << msg_info("The adaptive bitrate watches " + path + ", swap it instead"));
+                }
+                if (outputs().contains(path) && outputs().paths().size() == 1) {
+                    CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("The last output can't be removed"));
+                }
+                remove_output(path);
+            } else if (action == "SWAP") {
+                const auto from = argument(2);
+                const auto to   = argument(3);
+                if (!outputs().contains(from) || outputs().contains(to)) {
+                    CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Can't swap " + from + " for " + to));
+                }
+                // The adaptive bitrate moves along to the new output
+                const bool watched = abr_ && from == abr_output_;
+                auto       bin     = add_output(to, watched);
+                encoder_control().force_keyframe();
+                remove_output(from);
+                if (watched) {
+                    // A reconnecting output hands over its queue once it connected
+                    if (reconnecting_.count(to) == 0) {
+                        abr_->watch_output(bin);
                     }
+                    abr_output_ = to;
                 }
-                
-                pipeline_desc += "mpegtsmux ! udpsink host=" + host + " port=" + std::to_string(port) + " ";
-            } else if (path_.substr(0, 7) == "http://") {
-                pipeline_desc += "mpegtsmux ! hlssink location=" + path_.substr(7) + " ";
-            } else {
-                // Default streaming output
-                pipeline_desc += "mpegtsmux ! filesink location=\"" + path_ + "\" ";
+            } else if (action != "LIST") {
+                CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unknown output action " + action));
             }
+            result = boost::join(outputs().paths(), " ");
         } else {
-            // File output with container format
-            if (container_format == "mp4") {
-                pipeline_desc += "mp4mux ! filesink location=\"" + path_ + "\" ";
-            } else if (container_format == "mov") {
-                pipeline_desc += "qtmux ! filesink location=\"" + path_ + "\" ";
-            } else if (container_format == "flv") {
-                pipeline_desc += "flvmux ! filesink location=\"" + path_ + "\" ";
-            } else if (container_format == "matroska" || container_format == "mkv") {
-                pipeline_desc += "matroskamux ! filesink location=\"" + path_ + "\" ";
-            } else if (container_format == "ts") {
-                pipeline_desc += "mpegtsmux ! filesink location=\"" + path_ + "\" ";
-            } else if (container_format == "webm") {
-                if (video_codec == "vp8" || video_codec == "vp9") {
-                    pipeline_desc += "webmmux ! filesink location=\"" + path_ + "\" ";
-                } else {
-                    // Can't use webm container with non-VP8/VP9 codecs
-                    CASPAR_LOG(warning) << "WebM container requires VP8 or VP9 codec. Switching to MKV container.";
-                    pipeline_desc += "matroskamux ! filesink location=\"" + 
-                                    boost::filesystem::path(path_).replace_extension(".mkv").string() + "\" ";
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unknown command " + command));
+        }
+        
+        CASPAR_LOG(info) << print() << L" " << u16(command + " " + result);
+        return result;
+    }
+    
+    void run_control_tasks()
+    {
+        std::function<void()> task;
+        while (control_tasks_.try_pop(task)) {
+            task();
+        }
+    }
+    
+    void update_raw_stats()
+    {
+        if (raw_timer_.elapsed() < 1.0) {
+            return;
+        }
+        raw_timer_.restart();
+        
+        const auto raw = raw_writer_->stats();
+        graph_->set_value("write-latency", std::min(raw.latency_max_us / 1000.0 * format_desc_.fps / 1000.0, 1.0));
+        
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        state_["raw/frames"]         = raw.frames;
+        state_["raw/dropped"]        = raw.dropped;
+        state_["raw/queued"]         = raw.queued;
+        state_["raw/latency-avg-us"] = raw.latency_avg_us;
+        state_["raw/latency-max-us"] = raw.latency_max_us;
+        state_["raw/written-mb"]     = raw.written_mb;
+    }
+    
+    // Create a GStreamer pipeline based on options
+    void create_pipeline(const std::map<std::string, std::string>& options) 
+    {
+        std::string pipeline_desc;
+        
+        const auto video_codec   = video_codec_option(options);
+        const auto video_bitrate = video_bitrate_option(options);
+        video_codec_             = video_codec;
+        options_                 = options;
+        
+        const bool multiplexed = multiplexed_output(options, path_);
+        const bool paced       = paced_output(options, path_);
+        const bool is_rtp      = path_.substr(0, 6) == "rtp://";
+        int        muxrate     = video_bitrate * 3 / 2;
+        try {
+            muxrate = std::stoi(get_option(options, "muxrate", std::to_string(muxrate)));
+        } catch (...) {
+            // Use default if conversion fails
+        }
+        if (multiplexed && video_codec != "x264" && video_codec != "libx264" && video_codec != "nvenc" &&
+            video_codec != "nvh264" && video_codec != "openh264") {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("MPEG-TS programs need an H.264 codec"));
+        }
+        
+        // A key path records the channel as separate fill and key, split from the same frame
+        const auto key_path = get_option(options, "key", "");
+        if (!key_path.empty() && (multiplexed || paced)) {
+            CASPAR_THROW_EXCEPTION(invalid_argument()
+                                   << msg_info("A separate key can't be sent with a multiplexed or paced stream"));
+        }
+        if (!key_path.empty() && depth_ != common::bit_depth::bit8) {
+            CASPAR_THROW_EXCEPTION(invalid_argument()
+                                   << msg_info("A separate key can only be split from an 8 bit channel"));
+        }
+        
+        // A proxy path also records a downscaled copy from the same frames, for file outputs
+        const auto proxy_path = get_option(options, "proxy", "");
+        if (!proxy_path.empty() && (multiplexed || paced)) {
+            CASPAR_THROW_EXCEPTION(invalid_argument()
+                                   << msg_info("A proxy can't be recorded with a multiplexed or paced stream"));
+        }
+        
+        abr_ = create_abr(options, path_, format_desc_);
+        
+        const bool shared_convert = shared_conversion(options);
+        sample_alpha_             = recorded_alpha(options);
+        
+        // Filters and encoder, repeated for the key. Intra-only codecs get a thread per CPU of the placement.
+        const int default_threads = placement_.cpus.empty() ? static_cast<int>(std::thread::hardware_concurrency())
+                                                            : static_cast<int>(placement_.cpus.size());
+        if (shared_convert) {
+            conversion_cache_  = GstConversionCache::for_channel(channel_index_, default_threads);
+            conversion_format_ = GST_VIDEO_FORMAT_I420;
+        }
+        
+        // Pipelines that end in the output tee don't depend on the path, one may have been built ahead.
+        // Their description is the one the pool keys them on.
+        const bool pooled = !multiplexed && !paced && key_path.empty() && proxy_path.empty();
+        if (pooled) {
+            pipeline_desc = encoder_pipeline_description(options, path_, format_desc_, default_threads);
+        } else {
+            // Create video source (appsrc), the fill is sent opaque when the key goes separately
+            pipeline_desc += video_source_description(
+                "video_src", shared_convert ? "I420" : key_path.empty() ? "BGRA" : "BGRx", format_desc_);
+            
+            auto        encode_options = options;
+            std::string proxy_desc;
+            if (!proxy_path.empty()) {
+                proxy_desc = proxy_description(options, format_desc_, default_threads, encode_options);
+            }
+            const auto encode_desc = video_encode_description(encode_options, default_threads, multiplexed || paced);
+            
+            if (!proxy_desc.empty()) {
+                // The 8 bit 4:2:0 encoders share one colour conversion with the proxy, which then scales
+                // the converted frames. Mezzanine codecs convert on their own to keep the precision.
+                if (video_codec != "prores" && video_codec != "dnxhr" && video_codec != "ffv1" &&
+                    video_codec != "qtrle") {
+                    pipeline_desc += "videoconvert ! video/x-raw,format=I420 ! ";
                 }
-            } else if (container_format == "avi") {
-                pipeline_desc += "avimux ! filesink location=\"" + path_ + "\" ";
+                pipeline_desc += "tee name=proxy_tee ! queue ! ";
+            }
+            pipeline_desc += encode_desc;
+            
+            // Configure container/muxer and output
+            if (multiplexed) {
+                pipeline_desc += "video/x-h264,stream-format=byte-stream,alignment=au ! "
+                                 "appsink name=encoded_sink sync=false emit-signals=false ";
+            } else if (paced) {
+                // 7 packets per datagram, padded with null packets to the constant bitrate the pacer sends at
+                pipeline_desc += "mpegtsmux alignment=7 bitrate=" +
+                                 std::to_string(static_cast<uint64_t>(muxrate) * 1000) +
+                                 " ! appsink name=ts_sink sync=true emit-signals=false ";
             } else {
-                // Default to MP4
-                pipeline_desc += "mp4mux ! filesink location=\"" + path_ + "\" ";
+                // The outputs hang off a tee, so they can be added and swapped while running
+                pipeline_desc += "tee name=output_tee ";
+            }
+            
+            if (!key_path.empty()) {
+                pipeline_desc += video_source_description("key_src", "GRAY8", format_desc_) + encode_desc +
+                                 output_description(key_path, options);
+            }
+            
+            if (!proxy_desc.empty()) {
+                pipeline_desc += "proxy_tee. ! queue ! " + proxy_desc;
             }
         }
         
         CASPAR_LOG(info) << "Creating GStreamer pipeline: " << pipeline_desc;
         
-        // Create the pipeline
-        pipeline_ = gstreamer::create_pipeline(pipeline_desc);
+        caspar::timer build_timer;
+        if (pooled) {
+            pipeline_  = take_prewarmed_pipeline(channel_index_, pipeline_desc);
+            prewarmed_ = pipeline_ != nullptr;
+        }
+        if (!pipeline_) {
+            pipeline_ = gstreamer::create_pipeline(pipeline_desc);
+        }
+        {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["startup/prewarmed"]   = prewarmed_;
+            state_["startup/pipeline-ms"] = build_timer.elapsed() * 1000.0;
+        }
+
+        // Run the streaming threads on the module task pool, with real-time priority for live outputs when configured
+        thread_placement placement = placement_;
+        placement.realtime =
+            realtime_ && env::properties().get(L"configuration.gstreamer.task-pool.realtime-output", false);
+        install_task_pool(pipeline_.get(), placement);
+        
+        if (multiplexed) {
+            join_multiplex(options, placement);
+        } else if (paced) {
+            auto address = split_host_port(path_.substr(6));
+            pacer_ = std::make_shared<GstUdpPacer>(address.first, address.second, static_cast<uint64_t>(muxrate) * 1000,
+                                                   is_rtp, std::stoi(get_option(options, "ttl", "16")), placement);
+            
+            auto ts_sink = make_gst_ptr<GstElement>(gst_bin_get_by_name(GST_BIN(pipeline_.get()), "ts_sink"));
+            pacer_->attach(ts_sink.get());
+        } else {
+            auto tee = make_gst_ptr<GstElement>(gst_bin_get_by_name(GST_BIN(pipeline_.get()), "output_tee"));
+            outputs_ = std::make_unique<GstOutputBranches>(pipeline_.get(), tee.get());
+        }
         
         // Get elements
         appsrc_ = make_gst_ptr<GstElement>(gst_bin_get_by_name(GST_BIN(pipeline_.get()), "video_src"));
+        if (!key_path.empty()) {
+            key_src_ = make_gst_ptr<GstElement>(gst_bin_get_by_name(GST_BIN(pipeline_.get()), "key_src"));
+            
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["file/key-path"] = key_path;
+        }
+        if (!proxy_path.empty()) {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["file/proxy-path"] = proxy_path;
+        }
+        if (auto encoder = find_main_encoder()) {
+            encoder_control_ = std::make_shared<GstEncoderControl>(encoder.get());
+        }
         
-        if (appsrc_) {
+        // The first output, once a reconnecting one can ask the encoder for keyframes
+        if (outputs_) {
+            caspar::timer output_timer;
+            add_output(path_, abr_ != nullptr);
+            if (abr_) {
+                abr_output_ = path_;
+            }
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["startup/output-ms"] = output_timer.elapsed() * 1000.0;
+        }
+        
+        watch_encoders();
+        if (abr_) {
+            abr_->attach(pipeline_.get());
+        }
+        
+        for (const auto& src : {appsrc_, key_src_}) {
+            if (!src) {
+                continue;
+            }
+            
             // Configure appsrc
-            g_object_set(G_OBJECT(appsrc_.get()), "format", GST_FORMAT_TIME, NULL);
-            g_object_set(G_OBJECT(appsrc_.get()), "do-timestamp", TRUE, NULL);
-            g_object_set(G_OBJECT(appsrc_.get()), "is-live", realtime_, NULL);
+            g_object_set(G_OBJECT(src.get()), "format", GST_FORMAT_TIME, NULL);
+            g_object_set(G_OBJECT(src.get()), "do-timestamp", TRUE, NULL);
+            g_object_set(G_OBJECT(src.get()), "is-live", realtime_, NULL);
             
             if (realtime_) {
-                g_object_set(G_OBJECT(appsrc_.get()), "max-bytes", 1920 * 1080 * 4 * 4, NULL); // 4 frames of BGRA
+                g_object_set(G_OBJECT(src.get()), "max-bytes", 1920 * 1080 * 4 * 4, NULL); // 4 frames of BGRA
             } else {
-                g_object_set(G_OBJECT(appsrc_.get()), "max-bytes", 1920 * 1080 * 4 * 16, NULL); // 16 frames of BGRA
+                g_object_set(G_OBJECT(src.get()), "max-bytes", 1920 * 1080 * 4 * 16, NULL); // 16 frames of BGRA
             }
         }
     }
     
+    void join_multiplex(const std::map<std::string, std::string>& options, const thread_placement& placement)
+    {
+        auto get_int = [&options](const std::string& key, int default_value) {
+            auto it = options.find(key);
+            // Base 0 so PIDs can be given in hex
+            return it != options.end() ? std::stoi(it->second, nullptr, 0) : default_value;
+        };
+        
+        GstTsMultiplex::Settings settings;
+        std::tie(settings.host, settings.port) = split_host_port(path_.substr(6));
+        settings.bitrate      = get_int("muxrate", 0);
+        settings.ttl          = get_int("ttl", settings.ttl);
+        settings.pcr_interval = get_int("pcr_period", settings.pcr_interval);
+        
+        program_ = GstTsMultiplex::join(settings, get_int("program", 1), get_int("pid", 0), placement);
+        
+        encoded_sink_ = make_gst_ptr<GstElement>(gst_bin_get_by_name(GST_BIN(pipeline_.get()), "encoded_sink"));
+        
+        GstAppSinkCallbacks callbacks;
+        memset(&callbacks, 0, sizeof(GstAppSinkCallbacks));
+        callbacks.new_sample = &gstreamer_consumer::new_encoded_sample;
+        gst_app_sink_set_callbacks(GST_APP_SINK(encoded_sink_.get()), &callbacks, this, nullptr);
+        
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        state_["mux/program"] = program_->number();
+        state_["mux/pid"]     = program_->pid();
+        state_["mux/bitrate"] = program_->bitrate();
+    }
+    
     void process_frames() 
     {
         caspar::timer frame_timer;
@@ -532,31 +1647,58 @@ private:
                 break;
             }
             
+            run_control_tasks();
             frame_timer.restart();
             
+            if (raw_writer_) {
+                if (!raw_writer_->push(frame)) {
+                    graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                }
+                graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.fps * 0.5);
+                update_raw_stats();
+                continue;
+            }
+            
             // Send frame to GStreamer
             try {
-                GstSample* sample = make_gst_sample(frame, format_desc_);
-                if (sample) {
-                    GstBuffer* buffer = gst_sample_get_buffer(sample);
+                // Fill and key are split in one pass over the frame when the key goes separately
+                GstSample* sample = nullptr;
+                GstSample* key    = nullptr;
+                if (key_src_) {
+                    std::tie(sample, key) = make_gst_fill_key_samples(frame, format_desc_);
+                } else if (conversion_cache_) {
+                    sample = conversion_cache_->convert(frame, format_desc_, conversion_format_);
+                } else {
+                    sample = make_gst_sample(frame, format_desc_, sample_alpha_);
+                }
+                
+                // Convert frame count to seconds, then to nanoseconds for GstClockTime
+                double frame_seconds = static_cast<double>(frame_count) / format_desc_.fps;
+                
+                const auto targets = {std::make_pair(sample, appsrc_.get()), std::make_pair(key, key_src_.get())};
+                for (const auto& target : targets) {
+                    if (!target.first) {
+                        continue;
+                    }
+                    GstBuffer* buffer = gst_sample_get_buffer(target.first);
                     
                     // Set buffer timestamp and duration with proper conversion
-                    // Convert frame count to seconds, then to nanoseconds for GstClockTime
-                    double frame_seconds = static_cast<double>(frame_count) / format_desc_.fps;
                     GST_BUFFER_PTS(buffer) = static_cast<GstClockTime>(frame_seconds * GST_SECOND);
                     GST_BUFFER_DURATION(buffer) = static_cast<GstClockTime>(GST_SECOND / format_desc_.fps);
                     
-                    // Increment frame counter
-                    frame_count++;
-                    
                     // Push buffer to appsrc
-                    GstFlowReturn ret = gst_app_src_push_sample(GST_APP_SRC(appsrc_.get()), sample);
+                    GstFlowReturn ret = gst_app_src_push_sample(GST_APP_SRC(target.second), target.first);
                     if (ret != GST_FLOW_OK) {
                         CASPAR_LOG(error) << "Error pushing sample to GStreamer pipeline: " << gst_flow_get_name(ret);
                     }
                     
                     // Release the sample
-                    gst_sample_unref(sample);
+                    gst_sample_unref(target.first);
+                }
+                
+                // Increment frame counter
+                if (sample) {
+                    frame_count++;
                 }
             }
             catch (const std::exception& e) {
@@ -564,18 +1706,83 @@ private:
             }
             
             graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.fps * 0.5);
+            check_bus();
+            update_encode_stats();
+            update_startup();
+            update_abr();
+            update_control();
             graph_->set_value("input", static_cast<double>(frame_buffer_.size() + 0.001) / frame_buffer_.capacity());
+
+            {
+                std::lock_guard<std::mutex> lock(state_mutex_);
+                append_module_stats(state_, placement_.numa_node);
+
+                if (program_) {
+                    state_["mux/programs"] = program_->program_count();
+                    state_["mux/dropped"]  = program_->dropped();
+                }
+
+                if (auto pacer = pacer_ ? pacer_ : (program_ ? program_->pacer() : nullptr)) {
+                    const auto udp = pacer->stats();
+                    state_["udp/packets"]       = udp.packets;
+                    state_["udp/batches"]       = udp.batches;
+                    state_["udp/late"]          = udp.late;
+                    state_["udp/dropped"]       = udp.dropped;
+                    state_["udp/queued"]        = udp.queued;
+                    state_["udp/jitter-avg-us"] = udp.jitter_avg;
+                    state_["udp/jitter-max-us"] = udp.jitter_max;
+                    graph_->set_value("pacing-jitter", std::min(udp.jitter_max / 1000.0, 1.0));
+                }
+
+                const auto prewarm = get_prewarm_stats();
+                if (prewarm.profiles > 0) {
+                    state_["prewarm/ready"]  = prewarm.ready;
+                    state_["prewarm/hits"]   = prewarm.hits;
+                    state_["prewarm/misses"] = prewarm.misses;
+                }
+                
+                if (conversion_cache_) {
+                    state_["convert/format"]      = std::string(gst_video_format_to_string(conversion_format_));
+                    state_["convert/conversions"] = conversion_cache_->conversions();
+                    state_["convert/hits"]        = conversion_cache_->hits();
+                    state_["convert/consumers"]   = static_cast<int>(conversion_cache_.use_count());
+                }
+            }
         }
         
         // Send EOS to clean up the pipeline
         if (pipeline_ && appsrc_) {
             gst_app_src_end_of_stream(GST_APP_SRC(appsrc_.get()));
         }
+        if (pipeline_ && key_src_) {
+            gst_app_src_end_of_stream(GST_APP_SRC(key_src_.get()));
+        }
         
         is_running_ = false;
     }
 };
 
+// Queues a command to the running consumer with the output, answered once the frame thread ran it
+std::future<std::wstring> call_consumer(const std::string& path, const std::vector<std::wstring>& params)
+{
+    std::lock_guard<std::mutex> lock(consumers_mutex);
+    auto it = std::find_if(consumers.begin(), consumers.end(),
+                           [&](const gstreamer_consumer* consumer) { return consumer->has_output(path); });
+    if (it == consumers.end()) {
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("No GStreamer consumer outputs " + path));
+    }
+    return (*it)->reconfigure(params);
+}
+
+// Pipelines configured to be built ahead need the formats of the channels, which the module
+// first learns here
+static void prime_channels(const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    for (const auto& channel : channels) {
+        prime_prewarm_pool(channel->index(), channel->video_format_desc());
+    }
+}
+
 // Enhanced create_consumer to handle both standard and GS-specific commands
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&     params,
                                                       const core::video_format_repository& format_repository,
@@ -584,6 +1791,8 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
 {
     if (params.empty())
         return core::frame_consumer::empty();
+    
+    prime_channels(channels);
         
     // Handle GS-specific commands
     if (boost::iequals(params.at(0), L"GSADD") || boost::iequals(params.at(0), L"GSFILE")) {
@@ -623,12 +1832,30 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
     return core::frame_consumer::empty();
 }
 
+spl::shared_ptr<core::frame_consumer> create_call_consumer(const std::vector<std::wstring>&     params,
+                                                           const core::video_format_repository& format_repository,
+                                                           const std::vector<spl::shared_ptr<core::video_channel>>& channels,
+                                                           common::bit_depth                                        depth)
+{
+    if (params.size() < 3 || !boost::iequals(params.at(0), L"GSCALL")) {
+        return core::frame_consumer::empty();
+    }
+    
+    // Not waited for, the result is in the consumer's control/* state. Commands with an answer go
+    // through the GSCONTROL producer instead.
+    call_consumer(u8(params.at(1)), std::vector<std::wstring>(params.begin() + 2, params.end()));
+    CASPAR_LOG(info) << L"[gstreamer] GSCALL " << params.at(1) << L" " << params.at(2) << L" queued.";
+    return core::frame_consumer::empty();
+}
+
 spl::shared_ptr<core::frame_consumer>
 create_preconfigured_consumer(const boost::property_tree::wptree&                      ptree,
                               const core::video_format_repository&                     format_repository,
                               const std::vector<spl::shared_ptr<core::video_channel>>& channels,
                               common::bit_depth                                        depth)
 {
+    prime_channels(channels);
+    
     return spl::make_shared<gstreamer_consumer>(u8(ptree.get<std::wstring>(L"path", L"")),
                                              u8(ptree.get<std::wstring>(L"args", L"")),
                                              ptree.get(L"realtime", false),
@@ -25,6 +25,9 @@
 
 #include <boost/property_tree/ptree_fwd.hpp>
 
+#include <future>
+#include <map>
+#include <string>
 #include <vector>
 
 namespace caspar { namespace gstreamer {
@@ -36,16 +39,55 @@ namespace caspar { namespace gstreamer {
  *   GSADD 1 FILE output.mp4 -codec:v x264 -bitrate:v 5000
  *   GSADD 1 STREAM rtmp://server/live/stream -codec:v x264 -bitrate:v 3000
  *   GSREMOVE 1 FILE
+ *   GSCALL rtmp://server/live/stream BITRATE 2500
  */
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&     params,
                                                       const core::video_format_repository& format_repository,
                                                       const std::vector<spl::shared_ptr<core::video_channel>>& channels,
                                                       common::bit_depth                                        depth);
 
+// GSCALL <output> <command> [arguments] changes the running consumer with the output instead of
+// adding one, so nothing is returned. The command is queued, the consumer's control/* state has
+// its result.
+spl::shared_ptr<core::frame_consumer> create_call_consumer(const std::vector<std::wstring>&     params,
+                                                           const core::video_format_repository& format_repository,
+                                                           const std::vector<spl::shared_ptr<core::video_channel>>& channels,
+                                                           common::bit_depth                                        depth);
+
+// Queues a command to the running consumer with the output, throws when no consumer has it
+std::future<std::wstring> call_consumer(const std::string& path, const std::vector<std::wstring>& params);
+
 spl::shared_ptr<core::frame_consumer>
 create_preconfigured_consumer(const boost::property_tree::wptree&,
                               const core::video_format_repository&                     format_repository,
                               const std::vector<spl::shared_ptr<core::video_channel>>& channels,
                               common::bit_depth                                        depth);
 
+// FFmpeg style consumer arguments ("-codec:v x264 -bitrate:v 5000") keyed by option, "codec:v" etc.
+std::map<std::string, std::string> parse_consumer_options(const std::string& args);
+
+// -codec:v (FFmpeg style) or -vcodec, x264 when neither is given
+std::string video_codec_option(const std::map<std::string, std::string>& options);
+
+// Filters, conversion, encoder and parser of the consumer's video for the options, as a pipeline
+// description ending in " ! ". Intra-only codecs default to the given number of threads.
+// repeat_headers sends H.264 parameter sets with every keyframe.
+std::string video_encode_description(const std::map<std::string, std::string>& options,
+                                     int                                       threads,
+                                     bool                                      repeat_headers);
+
+// Everything of a consumer's pipeline before its outputs, from the frames' source to the output tee,
+// for a consumer without a separate key, proxy, multiplex or pacing. Empty for the others. The path,
+// or just its protocol, decides those and whether the adaptive bitrate scaler is in front of the encoder.
+std::string encoder_pipeline_description(const std::map<std::string, std::string>& options,
+                                         const std::string&                        path,
+                                         const core::video_format_desc&            format_desc,
+                                         int                                       threads);
+
+// Muxer and sink of a file, or of a stream for paths with a protocol. before_sink is put between
+// the two, ending in " ! ".
+std::string output_description(const std::string&                        path,
+                               const std::map<std::string, std::string>& options,
+                               const std::string&                        before_sink = "");
+
 }} // namespace caspar::gstreamer
\ No newline at end of file
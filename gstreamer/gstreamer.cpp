@@ -19,15 +19,28 @@
 
 #include "gstreamer.h"
 
+#include "consumer/gst_prewarm_pool.h"
 #include "consumer/gstreamer_consumer.h"
+#include "producer/gst_control.h"
+#include "producer/gst_http_cache.h"
+#include "producer/gst_read_ahead_src.h"
+#include "producer/gst_transcode.h"
 #include "producer/gstreamer_producer.h"
+#include "util/gst_allocator.h"
+#include "util/gst_task_pool.h"
+#include "util/gst_util.h"
 
+#include <common/env.h>
 #include <common/log.h>
+#include <common/utf.h>
 
 #include <core/module_dependencies.h>
 #include <core/consumer/frame_consumer.h>
 
+#include <algorithm>
+#include <map>
 #include <mutex>
+#include <thread>
 
 namespace caspar { namespace gstreamer {
 
@@ -140,6 +153,96 @@ void init(const core::module_dependencies& dependencies)
         CASPAR_LOG(warning) << L"Some required GStreamer plugins are missing. The GStreamer module may not function correctly.";
     }
 
+    // WebM with alpha stores it as a second VP8/VP9 stream, only the alpha decode bins combine the
+    // two. Keep them ahead of any (hardware) decoder that would accept the stream and drop the alpha.
+    for (const auto& name : {"vp8alphadecodebin", "vp9alphadecodebin"}) {
+        if (auto factory = gst_element_factory_find(name)) {
+            gst_plugin_feature_set_rank(GST_PLUGIN_FEATURE(factory), GST_RANK_PRIMARY + 256);
+            gst_object_unref(factory);
+        }
+    }
+
+    // Streaming threads of all pipelines are reused from one pool instead of each task creating its own
+    const auto pool_threads = env::properties().get(
+        L"configuration.gstreamer.task-pool.threads",
+        std::max(16, static_cast<int>(std::thread::hardware_concurrency()) * 2));
+    thread_placement pool_placement;
+    pool_placement.cpus = parse_cpu_list(u8(env::properties().get(L"configuration.gstreamer.task-pool.cpus", L"")));
+    init_task_pool(pool_threads, pool_placement);
+
+    set_copy_threads(env::properties().get(L"configuration.gstreamer.copy-threads", 0));
+
+    // Frame sized buffers are recycled through hugepage backed slabs
+    const auto pool_size = env::properties().get(L"configuration.gstreamer.allocator.pool-size", 1024);
+    init_frame_allocator(static_cast<size_t>(std::max(pool_size, 0)) * 1024 * 1024);
+
+    // File sources read ahead of the demuxer so network storage hiccups don't reach the output
+    if (env::properties().get(L"configuration.gstreamer.read-ahead.enabled", true)) {
+        const auto window = env::properties().get(L"configuration.gstreamer.read-ahead.window", 32);
+        register_read_ahead_source(static_cast<size_t>(std::max(window, 2)) * 1024 * 1024,
+                                   env::properties().get(L"configuration.gstreamer.read-ahead.mmap", false));
+    }
+
+    // Progressive HTTP media is kept on local disk after the first play
+    if (env::properties().get(L"configuration.gstreamer.http-cache.enabled", true)) {
+        const auto folder = env::properties().get(L"configuration.gstreamer.http-cache.path",
+                                                  env::data_folder() + L"gstreamer-cache");
+        const auto size   = env::properties().get(L"configuration.gstreamer.http-cache.size", 10240);
+        init_http_cache(u8(folder), static_cast<uint64_t>(std::max(size, 0)) * 1024 * 1024);
+    }
+
+    // Channels can be kept on the CPUs and memory of one NUMA node
+    std::map<int, thread_placement> channel_placements;
+    if (auto channels = env::properties().get_child_optional(L"configuration.gstreamer.channels")) {
+        for (auto& channel : *channels) {
+            if (channel.first != L"channel") {
+                continue;
+            }
+
+            const auto index = channel.second.get(L"index", -1);
+            if (index < 1) {
+                CASPAR_LOG(warning) << L"[gstreamer] Ignoring channel placement without a valid index.";
+                continue;
+            }
+
+            thread_placement placement;
+            placement.cpus      = parse_cpu_list(u8(channel.second.get(L"cpus", L"")));
+            placement.numa_node = channel.second.get(L"numa-node", -1);
+            channel_placements[index] = placement;
+
+            CASPAR_LOG(info) << L"[gstreamer] Channel " << index << L" placed on NUMA node " << placement.numa_node
+                             << L", " << placement.cpus.size() << L" CPUs.";
+        }
+    }
+    set_channel_placements(std::move(channel_placements));
+
+    // Consumer pipelines are kept ready for the configured profiles, and for the options consumers
+    // used when a count is set
+    if (env::properties().get(L"configuration.gstreamer.prewarm.enabled", true)) {
+        std::vector<prewarm_profile> profiles;
+        if (auto configured = env::properties().get_child_optional(L"configuration.gstreamer.prewarm")) {
+            for (auto& profile : *configured) {
+                if (profile.first != L"profile") {
+                    continue;
+                }
+
+                prewarm_profile added;
+                added.channel = profile.second.get(L"channel", -1);
+                added.args    = u8(profile.second.get(L"args", L""));
+                added.path    = u8(profile.second.get(L"path", L""));
+                added.count   = profile.second.get(L"count", 1);
+                if (added.channel < 1) {
+                    CASPAR_LOG(warning) << L"[gstreamer] Ignoring prewarm profile without a valid channel.";
+                    continue;
+                }
+                profiles.push_back(added);
+            }
+        }
+        init_prewarm_pool(std::move(profiles),
+                          env::properties().get(L"configuration.gstreamer.prewarm.count", 0),
+                          env::properties().get(L"configuration.gstreamer.prewarm.profiles", 4));
+    }
+
     // Register regular consumers
     dependencies.consumer_registry->register_consumer_factory(L"GStreamer Consumer", create_consumer);
     dependencies.consumer_registry->register_preconfigured_consumer_factory(L"gstreamer", create_preconfigured_consumer);
@@ -148,16 +251,29 @@ void init(const core::module_dependencies& dependencies)
     dependencies.consumer_registry->register_consumer_factory(L"GSADD", create_consumer);
     dependencies.consumer_registry->register_consumer_factory(L"GSFILE", create_consumer);
     
+    // Commands to running consumers
+    dependencies.consumer_registry->register_consumer_factory(L"GSCALL", create_call_consumer);
+    
     // Register producer
     dependencies.producer_registry->register_producer_factory(L"GStreamer Producer", create_producer);
     dependencies.producer_registry->register_producer_factory(L"GSTREAMER_PRODUCER", create_producer);
     
+    // Commands to running consumers that answer, sent with CALL to a layer playing it
+    dependencies.producer_registry->register_producer_factory(L"GSCONTROL", create_control_producer);
+    
+    // Offline transcodes run while their producer is on a layer
+    dependencies.producer_registry->register_producer_factory(L"GSTRANSCODE", create_transcode_producer);
+    
     CASPAR_LOG(info) << L"GStreamer module initialized successfully";
 }
 
 void uninit()
 {
     CASPAR_LOG(info) << L"Uninitializing GStreamer module";
+    uninit_transcodes();
+    uninit_prewarm_pool();
+    uninit_task_pool();
+    uninit_frame_allocator();
     gst_debug_remove_log_function(gst_debug_log_callback);
     gst_deinit();
     CASPAR_LOG(info) << L"GStreamer module uninitialized";
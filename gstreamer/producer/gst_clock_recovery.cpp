@@ -0,0 +1,164 @@
+#include "gst_clock_recovery.h"
+
+#include <common/log.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace caspar { namespace gstreamer {
+
+namespace {
+
+// Depth error in seconds to ratio. The loop settles over minutes, well damped, so the
+// packet sized sawtooth of the FIFO depth moves the ratio by a few ppm at most.
+constexpr double proportional_gain = 0.01;
+constexpr double integral_gain     = 1e-6;
+
+// Real clocks are within 100 ppm of each other, anything beyond is a broken source
+constexpr double max_correction = 0.002;
+
+// Fill of the buffer smoothed over about two seconds of frames
+constexpr double depth_smoothing = 0.02;
+
+} // namespace
+
+GstClockRecovery::GstClockRecovery(const core::video_format_desc& format_desc, int target_depth)
+    : channels_(std::max(format_desc.audio_channels, 1))
+    , sample_rate_(std::max(format_desc.audio_sample_rate, 1))
+    , target_depth_(target_depth)
+    , settle_frames_(static_cast<int>(format_desc.fps * 2))
+    , min_interval_(static_cast<int>(format_desc.fps * 4))
+{
+}
+
+GstClockRecovery::video_action GstClockRecovery::next_video(size_t depth)
+{
+    const auto avg = depth_avg_ < 0 ? static_cast<double>(depth)
+                                    : depth_avg_ + depth_smoothing * (static_cast<double>(depth) - depth_avg_);
+    depth_avg_ = avg;
+
+    ++video_frames_;
+    ++since_correction_;
+    if (video_frames_ < settle_frames_ || since_correction_ < min_interval_) {
+        return video_action::push;
+    }
+
+    if (avg > target_depth_ + 1.0) {
+        since_correction_ = 0;
+        depth_avg_        = avg - 1.0;
+        ++drops_;
+        return video_action::drop;
+    }
+    if (avg < target_depth_ - 1.0) {
+        since_correction_ = 0;
+        depth_avg_        = avg + 1.0;
+        ++repeats_;
+        return video_action::repeat;
+    }
+    return video_action::push;
+}
+
+void GstClockRecovery::push_audio(GstSample* sample)
+{
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    if (fifo_.empty() && buffer && GST_BUFFER_PTS_IS_VALID(buffer)) {
+        head_time_ = GST_BUFFER_PTS(buffer);
+    }
+    append_audio_samples(sample, channels_, fifo_);
+}
+
+bool GstClockRecovery::align(int64_t pts)
+{
+    if (fifo_.empty() || !GST_CLOCK_TIME_IS_VALID(head_time_)) {
+        return false;
+    }
+
+    // Audio that arrived before the first frame is dropped, audio that starts after it is
+    // preceded by silence, so both start in sync
+    const auto video_time = static_cast<GstClockTime>(std::max<int64_t>(pts, 0)) * GST_MSECOND;
+    const auto available  = fifo_.size() / channels_;
+    if (head_time_ < video_time) {
+        const auto skip = std::min<size_t>(available, gst_util_uint64_scale(video_time - head_time_, sample_rate_, GST_SECOND));
+        fifo_.erase(fifo_.begin(), fifo_.begin() + skip * channels_);
+        head_time_ += gst_util_uint64_scale(skip, GST_SECOND, sample_rate_);
+        if (fifo_.empty()) {
+            return false;
+        }
+    } else if (head_time_ > video_time) {
+        const auto lead = std::min<size_t>(gst_util_uint64_scale(head_time_ - video_time, sample_rate_, GST_SECOND),
+                                           static_cast<size_t>(sample_rate_));
+        fifo_.insert(fifo_.begin(), lead * channels_, 0);
+        head_time_ = video_time;
+    }
+
+    aligned_      = true;
+    audio_frames_ = 0;
+    audio_target_ = -1.0;
+    phase_        = 0.0;
+    return true;
+}
+
+std::vector<int32_t> GstClockRecovery::pull_audio(int64_t pts, int samples)
+{
+    std::vector<int32_t> out(static_cast<size_t>(samples) * channels_, 0);
+    if (!aligned_ && !align(pts)) {
+        return out;
+    }
+
+    const auto available = fifo_.size() / channels_;
+    audio_depth_ms_      = available * 1000.0 / sample_rate_;
+
+    // The depth the source settles at is the one to hold, averaged while it settles
+    ++audio_frames_;
+    if (audio_frames_ <= settle_frames_) {
+        audio_target_ = audio_target_ < 0 ? available : audio_target_ + (available - audio_target_) / audio_frames_;
+    } else {
+        const auto error = (available - audio_target_) / sample_rate_;
+        integral_        = std::clamp(integral_ + integral_gain * error, -max_correction, max_correction);
+        ratio_           = 1.0 + std::clamp(proportional_gain * error + integral_, -max_correction, max_correction);
+    }
+
+    const double ratio = ratio_;
+    const auto   span  = phase_ + (samples - 1) * ratio;
+    if (static_cast<size_t>(span) + 2 > available) {
+        // Ran dry, the source stalled. Start over in sync once it's back.
+        if (underruns_++ % 100 == 0) {
+            CASPAR_LOG(warning) << "[gstreamer] Clock recovery ran out of audio (" << underruns_ << " times)";
+        }
+        fifo_.clear();
+        head_time_ = GST_CLOCK_TIME_NONE;
+        aligned_   = false;
+        return out;
+    }
+
+    // Linear interpolation is transparent for the few ppm this stretches by
+    for (int n = 0; n < samples; ++n) {
+        const auto position = phase_ + n * ratio;
+        const auto index    = static_cast<size_t>(position);
+        const auto frac     = position - index;
+        const auto a        = fifo_.data() + index * channels_;
+        const auto b        = a + channels_;
+        for (int c = 0; c < channels_; ++c) {
+            out[n * channels_ + c] = static_cast<int32_t>(std::lround(a[c] + (b[c] - static_cast<double>(a[c])) * frac));
+        }
+    }
+
+    const auto end      = phase_ + samples * ratio;
+    const auto consumed = static_cast<size_t>(end);
+    phase_              = end - consumed;
+    fifo_.erase(fifo_.begin(), fifo_.begin() + consumed * channels_);
+    head_time_ += gst_util_uint64_scale(consumed, GST_SECOND, sample_rate_);
+    return out;
+}
+
+void GstClockRecovery::reset()
+{
+    fifo_.clear();
+    head_time_        = GST_CLOCK_TIME_NONE;
+    aligned_          = false;
+    video_frames_     = 0;
+    since_correction_ = 0;
+    depth_avg_        = -1.0;
+}
+
+}} // namespace caspar::gstreamer
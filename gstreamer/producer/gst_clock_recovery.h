@@ -0,0 +1,75 @@
+#pragma once
+
+#include "../util/gst_util.h"
+
+#include <core/video_format.h>
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace caspar { namespace gstreamer {
+
+// Plays a live source that runs on its own clock at the channel's. Audio is resampled by up
+// to a few hundred ppm, steered by a PI controller on the depth of the audio FIFO, so it never
+// glitches. Video can't be resampled, so a frame is dropped or repeated once the producer's
+// buffer has drifted a whole frame from its target, and at most every few seconds.
+class GstClockRecovery
+{
+  public:
+    enum class video_action
+    {
+        push,
+        drop,
+        repeat
+    };
+
+    GstClockRecovery(const core::video_format_desc& format_desc, int target_depth);
+
+    // What to do with the next decoded frame, given the frames in the producer's buffer
+    video_action next_video(size_t depth);
+
+    // Decoded audio of the source, any channel count
+    void push_audio(GstSample* sample);
+
+    // Audio of the channel for the video frame at pts (milliseconds), samples per channel
+    std::vector<int32_t> pull_audio(int64_t pts, int samples);
+
+    // After a seek or flush. The drift estimate is kept, it belongs to the clocks.
+    void reset();
+
+    double  drift_ppm() const { return (ratio_.load() - 1.0) * 1e6; }
+    double  depth() const { return depth_avg_.load(); } // frames
+    double  audio_depth() const { return audio_depth_ms_.load(); }
+    int64_t drops() const { return drops_.load(); }
+    int64_t repeats() const { return repeats_.load(); }
+
+  private:
+    bool align(int64_t pts);
+
+    const int    channels_;
+    const int    sample_rate_;
+    const int    target_depth_;
+    const int    settle_frames_; // before measuring, while the source starts up
+    const int    min_interval_;  // frames between video corrections
+
+    int64_t video_frames_     = 0;
+    int64_t since_correction_ = 0;
+
+    std::vector<int32_t> fifo_;
+    GstClockTime         head_time_    = GST_CLOCK_TIME_NONE; // of the first sample in the FIFO
+    bool                 aligned_      = false;
+    int64_t              audio_frames_ = 0;
+    double               audio_target_ = -1.0; // FIFO depth in samples the controller holds
+    double               integral_     = 0.0;
+    double               phase_        = 0.0; // fractional read position into the FIFO
+    int64_t              underruns_    = 0;
+
+    std::atomic<double>  ratio_{1.0}; // source samples per channel sample
+    std::atomic<double>  depth_avg_{-1.0};
+    std::atomic<double>  audio_depth_ms_{0.0};
+    std::atomic<int64_t> drops_{0};
+    std::atomic<int64_t> repeats_{0};
+};
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,54 @@
+#include "../StdAfx.h"
+
+#include "gst_control.h"
+
+#include "../consumer/gstreamer_consumer.h"
+
+#include <common/except.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+namespace caspar { namespace gstreamer {
+
+struct control_producer : public core::frame_producer
+{
+    // frame_producer
+
+    core::draw_frame last_frame(const core::video_field field) override { return core::draw_frame{}; }
+
+    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
+    {
+        return core::draw_frame{};
+    }
+
+    // The answer comes from the consumer's frame thread, between two of its frames
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        if (params.size() < 2) {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("GSCONTROL needs an output and a command"));
+        }
+        return call_consumer(u8(params.at(0)), std::vector<std::wstring>(params.begin() + 1, params.end()));
+    }
+
+    std::wstring print() const override { return L"gscontrol[]"; }
+
+    std::wstring name() const override { return L"gscontrol"; }
+
+    core::monitor::state state() const override { return core::monitor::state{}; }
+};
+
+spl::shared_ptr<core::frame_producer> create_control_producer(const core::frame_producer_dependencies& dependencies,
+                                                              const std::vector<std::wstring>&         params)
+{
+    if (params.empty() || !boost::iequals(params.at(0), L"GSCONTROL")) {
+        return core::frame_producer::empty();
+    }
+    return spl::make_shared<control_producer>();
+}
+
+}} // namespace caspar::gstreamer
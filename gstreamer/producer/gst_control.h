@@ -0,0 +1,17 @@
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/fwd.h>
+
+#include <string>
+#include <vector>
+
+namespace caspar { namespace gstreamer {
+
+// GSCONTROL, a producer that outputs nothing and forwards CALL <output> <command> [arguments]
+// to the running consumer with the output, answering with the command's result
+spl::shared_ptr<core::frame_producer> create_control_producer(const core::frame_producer_dependencies& dependencies,
+                                                              const std::vector<std::wstring>&         params);
+
+}} // namespace caspar::gstreamer
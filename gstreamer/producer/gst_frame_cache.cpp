@@ -0,0 +1,109 @@
+#include "gst_frame_cache.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace caspar { namespace gstreamer {
+
+GstFrameCache::GstFrameCache(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 2))
+{
+}
+
+void GstFrameCache::insert(int64_t pts, const core::draw_frame& frame)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    frames_[pts] = frame;
+}
+
+void GstFrameCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    frames_.clear();
+}
+
+std::optional<std::pair<int64_t, core::draw_frame>> GstFrameCache::step(int64_t pts, int offset) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = frames_.find(pts);
+    if (it == frames_.end()) {
+        return {};
+    }
+
+    if (offset > 0) {
+        if (std::distance(it, frames_.end()) <= offset) {
+            return {};
+        }
+    } else if (std::distance(frames_.begin(), it) < -offset) {
+        return {};
+    }
+
+    std::advance(it, offset);
+    return std::make_pair(it->first, it->second);
+}
+
+std::optional<std::pair<int64_t, core::draw_frame>> GstFrameCache::nearest(int64_t pts) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (frames_.empty()) {
+        return {};
+    }
+
+    auto it = frames_.lower_bound(pts);
+    if (it == frames_.end() || (it != frames_.begin() && pts - std::prev(it)->first < it->first - pts)) {
+        --it;
+    }
+    return std::make_pair(it->first, it->second);
+}
+
+int GstFrameCache::available(int64_t pts, int direction) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (direction >= 0) {
+        return static_cast<int>(std::distance(frames_.upper_bound(pts), frames_.end()));
+    }
+    return static_cast<int>(std::distance(frames_.begin(), frames_.lower_bound(pts)));
+}
+
+std::optional<int64_t> GstFrameCache::first() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (frames_.empty()) {
+        return {};
+    }
+    return frames_.begin()->first;
+}
+
+std::optional<int64_t> GstFrameCache::last() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (frames_.empty()) {
+        return {};
+    }
+    return frames_.rbegin()->first;
+}
+
+size_t GstFrameCache::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return frames_.size();
+}
+
+void GstFrameCache::trim(int64_t pts)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Only ever evict from the ends, which keeps the cached run contiguous
+    while (frames_.size() > capacity_) {
+        if (pts - frames_.begin()->first > frames_.rbegin()->first - pts) {
+            frames_.erase(frames_.begin());
+        } else {
+            frames_.erase(std::prev(frames_.end()));
+        }
+    }
+}
+
+}} // namespace caspar::gstreamer
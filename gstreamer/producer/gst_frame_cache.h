@@ -0,0 +1,46 @@
+#pragma once
+
+#include <core/frame/draw_frame.h>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace caspar { namespace gstreamer {
+
+// Decoded frames around the playhead, keyed by pts in milliseconds. The cache
+// always holds one contiguous run of frames so stepping through it never skips
+// frames that were not decoded.
+class GstFrameCache
+{
+  public:
+    explicit GstFrameCache(size_t capacity);
+
+    void insert(int64_t pts, const core::draw_frame& frame);
+    void clear();
+
+    // Frame `offset` frames away from pts, if the cache holds it
+    std::optional<std::pair<int64_t, core::draw_frame>> step(int64_t pts, int offset) const;
+
+    // Cached frame closest to pts
+    std::optional<std::pair<int64_t, core::draw_frame>> nearest(int64_t pts) const;
+
+    // Frames cached past pts in the given direction
+    int available(int64_t pts, int direction) const;
+
+    std::optional<int64_t> first() const;
+    std::optional<int64_t> last() const;
+    size_t                 size() const;
+
+    // Evicts the frames farthest from pts until the cache fits its capacity
+    void trim(int64_t pts);
+
+  private:
+    mutable std::mutex                  mutex_;
+    std::map<int64_t, core::draw_frame> frames_;
+    const size_t                        capacity_;
+};
+
+}} // namespace caspar::gstreamer
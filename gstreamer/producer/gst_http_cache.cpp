@@ -0,0 +1,230 @@
+#include "gst_http_cache.h"
+
+#include <common/log.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <algorithm>
+#include <ctime>
+#include <iomanip>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <vector>
+
+namespace caspar { namespace gstreamer {
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+std::mutex cache_mutex;
+fs::path   cache_folder;
+uint64_t   cache_quota = 0;
+
+// Stable across runs, unlike std::hash
+std::string hash_uri(const std::string& uri)
+{
+    uint64_t hash = 1469598103934665603ULL;
+    for (unsigned char c : uri) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    std::ostringstream str;
+    str << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return str.str();
+}
+
+fs::path index_path(const std::string& uri) { return cache_folder / (hash_uri(uri) + ".done"); }
+
+struct cache_entry
+{
+    fs::path    index;
+    fs::path    location;
+    std::time_t used = 0;
+    uint64_t    size = 0;
+};
+
+std::optional<cache_entry> read_entry(const fs::path& index)
+{
+    fs::ifstream file(index);
+    std::string  uri;
+    std::string  location;
+    if (!std::getline(file, uri) || !std::getline(file, location)) {
+        return {};
+    }
+
+    boost::system::error_code ec;
+    cache_entry               entry;
+    entry.index    = index;
+    entry.location = location;
+    entry.used     = fs::last_write_time(index, ec);
+    entry.size     = fs::file_size(entry.location, ec);
+    if (ec) {
+        return {};
+    }
+    return entry;
+}
+
+void remove_entry(const fs::path& index, const fs::path& location)
+{
+    boost::system::error_code ec;
+    fs::remove(location, ec);
+    fs::remove(index, ec);
+}
+
+// Called with cache_mutex held
+void evict()
+{
+    boost::system::error_code ec;
+    std::vector<cache_entry>  entries;
+    uint64_t                  total = 0;
+
+    for (fs::directory_iterator it(cache_folder, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() != ".done") {
+            continue;
+        }
+        if (auto entry = read_entry(it->path())) {
+            total += entry->size;
+            entries.push_back(*entry);
+        } else {
+            fs::remove(it->path(), ec);
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return a.used < b.used; });
+
+    for (const auto& entry : entries) {
+        if (total <= cache_quota) {
+            break;
+        }
+        CASPAR_LOG(info) << "[gstreamer] Evicting " << entry.location.string() << " from the HTTP cache.";
+        remove_entry(entry.index, entry.location);
+        total -= entry.size;
+    }
+}
+
+} // namespace
+
+void init_http_cache(const std::string& folder, uint64_t quota_bytes)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+
+    boost::system::error_code ec;
+    fs::create_directories(folder, ec);
+    if (ec) {
+        CASPAR_LOG(warning) << "[gstreamer] HTTP cache disabled, could not create " << folder << ": " << ec.message();
+        return;
+    }
+
+    cache_folder = folder;
+    cache_quota  = quota_bytes;
+
+    // Downloads interrupted by a restart left partial "<hash>-XXXXXX" files that no index refers to
+    std::set<fs::path> complete;
+    for (fs::directory_iterator it(cache_folder, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() == ".done") {
+            if (auto entry = read_entry(it->path())) {
+                complete.insert(entry->location);
+            }
+        }
+    }
+    for (fs::directory_iterator it(cache_folder, ec), end; !ec && it != end; it.increment(ec)) {
+        const auto name = it->path().filename().string();
+        const bool partial = name.size() == 23 && name[16] == '-' && it->path().extension() != ".done";
+        if (partial && complete.find(it->path()) == complete.end()) {
+            boost::system::error_code remove_ec;
+            fs::remove(it->path(), remove_ec);
+        }
+    }
+
+    evict();
+
+    CASPAR_LOG(info) << "[gstreamer] HTTP cache in " << folder << ", " << quota_bytes / (1024 * 1024) << " MB.";
+}
+
+bool is_http_cacheable(const std::string& uri)
+{
+    auto lower = boost::algorithm::to_lower_copy(uri);
+    if (!boost::starts_with(lower, "http://") && !boost::starts_with(lower, "https://")) {
+        return false;
+    }
+
+    lower = lower.substr(0, lower.find_first_of("?#"));
+    return !boost::ends_with(lower, ".m3u8") && !boost::ends_with(lower, ".mpd") && !boost::ends_with(lower, ".ism") &&
+           !boost::ends_with(lower, "/manifest");
+}
+
+std::optional<std::string> http_cache_lookup(const std::string& uri)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (cache_folder.empty()) {
+        return {};
+    }
+
+    const auto index = index_path(uri);
+    auto       entry = read_entry(index);
+    if (!entry || entry->size == 0) {
+        return {};
+    }
+
+    // The index file's time is the entry's last use for eviction
+    boost::system::error_code ec;
+    fs::last_write_time(index, std::time(nullptr), ec);
+
+    return entry->location.string();
+}
+
+std::string http_cache_template(const std::string& uri)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (cache_folder.empty()) {
+        return {};
+    }
+
+    return (cache_folder / (hash_uri(uri) + "-XXXXXX")).string();
+}
+
+void http_cache_complete(const std::string& uri, const std::string& location)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (cache_folder.empty()) {
+        return;
+    }
+
+    // Another layer may have finished the same clip first
+    const auto index = index_path(uri);
+    if (auto existing = read_entry(index)) {
+        if (existing->location != fs::path(location)) {
+            boost::system::error_code ec;
+            fs::remove(location, ec);
+        }
+        return;
+    }
+
+    {
+        fs::ofstream file(index);
+        file << uri << "\n" << location << "\n";
+    }
+
+    CASPAR_LOG(info) << "[gstreamer] Cached " << uri << " in " << location;
+
+    evict();
+}
+
+void http_cache_abandon(const std::string& uri, const std::string& location)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+
+    auto entry = read_entry(index_path(uri));
+    if (!entry || entry->location != fs::path(location)) {
+        boost::system::error_code ec;
+        fs::remove(location, ec);
+    }
+}
+
+}} // namespace caspar::gstreamer
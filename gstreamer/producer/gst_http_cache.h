@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace caspar { namespace gstreamer {
+
+// Disk cache for progressive HTTP media. The first play downloads the clip into
+// the cache while it plays, later plays and seeks are served from the local copy.
+// Least recently played entries are evicted when the cache exceeds its quota.
+void init_http_cache(const std::string& folder, uint64_t quota_bytes);
+
+// True for http(s) URIs of single files, streaming manifests are never cached
+bool is_http_cacheable(const std::string& uri);
+
+// Local copy of a completely downloaded URI, marked as recently used
+std::optional<std::string> http_cache_lookup(const std::string& uri);
+
+// queue2 temp-template the URI should be downloaded into
+std::string http_cache_template(const std::string& uri);
+
+// Records a finished download and evicts entries over the quota
+void http_cache_complete(const std::string& uri, const std::string& location);
+
+// Removes the partial file of a download that was stopped before it finished
+void http_cache_abandon(const std::string& uri, const std::string& location);
+
+}} // namespace caspar::gstreamer
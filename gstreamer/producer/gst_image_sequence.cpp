@@ -0,0 +1,425 @@
+#include "gst_image_sequence.h"
+
+#include "../util/gst_task_pool.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/regex.hpp>
+
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+
+namespace caspar { namespace gstreamer {
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+struct sequence_pattern
+{
+    std::string folder;
+    std::string prefix;
+    std::string suffix;
+    int         digits = 0;
+};
+
+std::optional<sequence_pattern> parse_pattern(const std::string& path)
+{
+    const auto    file = fs::path(path).filename().string();
+    boost::smatch matches;
+    if (!boost::regex_match(file, matches, boost::regex("(.*)%0?(\\d*)d(.*)"))) {
+        return {};
+    }
+
+    sequence_pattern pattern;
+    pattern.folder = fs::path(path).parent_path().string();
+    pattern.prefix = matches[1];
+    pattern.digits = matches[2].length() > 0 ? std::stoi(matches[2]) : 0;
+    pattern.suffix = matches[3];
+    return pattern;
+}
+
+std::vector<int64_t> find_frames(const sequence_pattern& pattern)
+{
+    std::vector<int64_t> numbers;
+
+    boost::system::error_code ec;
+    const auto folder = pattern.folder.empty() ? fs::path(".") : fs::path(pattern.folder);
+    for (fs::directory_iterator it(folder, ec), end; !ec && it != end; it.increment(ec)) {
+        const auto name = it->path().filename().string();
+        if (name.size() <= pattern.prefix.size() + pattern.suffix.size() ||
+            !boost::starts_with(name, pattern.prefix) || !boost::ends_with(name, pattern.suffix)) {
+            continue;
+        }
+
+        const auto number = name.substr(pattern.prefix.size(), name.size() - pattern.prefix.size() - pattern.suffix.size());
+        if (number.size() < static_cast<size_t>(pattern.digits) || number.size() > 18 ||
+            !std::all_of(number.begin(), number.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            continue;
+        }
+        numbers.push_back(std::stoll(number));
+    }
+
+    std::sort(numbers.begin(), numbers.end());
+    return numbers;
+}
+
+// Caps of the encoded images by extension, decodebin picks the decoder for them
+std::string image_caps(const std::string& suffix)
+{
+    const auto extension = boost::to_lower_copy(fs::path(suffix).extension().string());
+    if (extension == ".png") {
+        return "image/png";
+    } else if (extension == ".jpg" || extension == ".jpeg") {
+        return "image/jpeg";
+    } else if (extension == ".tga") {
+        return "image/x-tga";
+    } else if (extension == ".tif" || extension == ".tiff") {
+        return "image/tiff";
+    } else if (extension == ".bmp") {
+        return "image/bmp";
+    }
+    return "";
+}
+
+} // namespace
+
+bool GstImageSequence::is_pattern(const std::string& path)
+{
+    return path.find("://") == std::string::npos && parse_pattern(path).has_value();
+}
+
+std::optional<std::string> GstImageSequence::resolve(const std::string& pattern)
+{
+    for (const auto& path : {fs::path(pattern), fs::path(u8(env::media_folder())) / pattern}) {
+        auto parsed = parse_pattern(path.string());
+        if (parsed && !find_frames(*parsed).empty()) {
+            return path.string();
+        }
+        if (fs::path(pattern).is_absolute()) {
+            break;
+        }
+    }
+    return {};
+}
+
+GstImageSequence::GstImageSequence(const std::string& pattern, bool loop, thread_placement placement)
+    : placement_(std::move(placement))
+    , loop_(loop)
+{
+    const auto path   = resolve(pattern);
+    const auto parsed = path ? parse_pattern(*path) : std::nullopt;
+    if (!parsed) {
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info("No frames of " + pattern));
+    }
+
+    folder_  = parsed->folder;
+    prefix_  = parsed->prefix;
+    suffix_  = parsed->suffix;
+    digits_  = parsed->digits;
+    numbers_ = find_frames(*parsed);
+
+    caps_ = image_caps(suffix_);
+    if (caps_.empty()) {
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported image type of " + pattern));
+    }
+
+    // A worker per CPU up to 8 and twice as many frames decoded ahead by default
+    auto workers = env::properties().get(L"configuration.gstreamer.image-sequence.workers", 0);
+    if (workers <= 0) {
+        workers = std::clamp(static_cast<int>(std::thread::hardware_concurrency()), 1, 8);
+    }
+    window_ = env::properties().get(L"configuration.gstreamer.image-sequence.window", 0);
+    window_ = window_ > 0 ? std::max<int64_t>(window_, workers) : workers * 2;
+
+    CASPAR_LOG(info) << "[gstreamer] Image sequence " << *path << ": " << numbers_.size() << " frames, " << workers
+                     << " decode workers, " << window_ << " frames ahead.";
+
+    for (int n = 0; n < workers; ++n) {
+        workers_.create_thread([this] { run(); });
+    }
+}
+
+GstImageSequence::~GstImageSequence()
+{
+    abort_request_ = true;
+    cond_.notify_all();
+    workers_.join_all();
+
+    for (auto& frame : ready_) {
+        if (frame.second) {
+            gst_buffer_unref(frame.second);
+        }
+    }
+}
+
+std::string GstImageSequence::frame_path(int64_t number) const
+{
+    auto digits = std::to_string(number);
+    if (digits.size() < static_cast<size_t>(digits_)) {
+        digits.insert(0, digits_ - digits.size(), '0');
+    }
+    return (fs::path(folder_) / (prefix_ + digits + suffix_)).string();
+}
+
+GstImageSequence::worker GstImageSequence::start_worker() const
+{
+    worker w;
+    w.pipeline = create_pipeline("appsrc name=src format=time caps=" + caps_ +
+                                 " ! decodebin ! videoconvert n-threads=1 ! video/x-raw,format=BGRA ! "
+                                 "appsink name=sink sync=false max-buffers=1");
+    install_task_pool(w.pipeline.get(), placement_);
+
+    w.appsrc  = make_gst_ptr<GstElement>(gst_bin_get_by_name(GST_BIN(w.pipeline.get()), "src"));
+    w.appsink = make_gst_ptr<GstElement>(gst_bin_get_by_name(GST_BIN(w.pipeline.get()), "sink"));
+
+    if (gst_element_set_state(w.pipeline.get(), GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        gst_element_set_state(w.pipeline.get(), GST_STATE_NULL);
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Can't start an image sequence decoder"));
+    }
+    return w;
+}
+
+GstBuffer* GstImageSequence::decode(worker& w, int64_t index)
+{
+    const auto    path = frame_path(numbers_[index]);
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info("Can't read " + path));
+    }
+    const auto size = static_cast<gsize>(file.tellg());
+    file.seekg(0);
+
+    GstBuffer* data = gst_buffer_new_allocate(nullptr, size, nullptr);
+    GstMapInfo map;
+    gst_buffer_map(data, &map, GST_MAP_WRITE);
+    file.read(reinterpret_cast<char*>(map.data), size);
+    gst_buffer_unmap(data, &map);
+
+    // The decoder only needs increasing timestamps, the frame's own are set when it is handed out
+    GST_BUFFER_PTS(data) = w.pushed++ * GST_MSECOND;
+    if (gst_app_src_push_buffer(GST_APP_SRC(w.appsrc.get()), data) != GST_FLOW_OK) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Image sequence decoder stopped at " + path));
+    }
+
+    GstSample* sample = gst_app_sink_try_pull_sample(GST_APP_SINK(w.appsink.get()), 10 * GST_SECOND);
+    if (!sample) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Can't decode " + path));
+    }
+
+    if (width_ == 0) {
+        GstVideoInfo info;
+        if (gst_video_info_from_caps(&info, gst_sample_get_caps(sample))) {
+            width_  = info.width;
+            height_ = info.height;
+        }
+    }
+
+    auto frame = gst_buffer_ref(gst_sample_get_buffer(sample));
+    gst_sample_unref(sample);
+    return frame;
+}
+
+int64_t GstImageSequence::next_index() const
+{
+    const auto count = static_cast<int64_t>(numbers_.size());
+    if (next_claim_ < count && next_claim_ < next_out_ + window_) {
+        return next_claim_;
+    }
+    // Near the end the first frames are decoded ahead too, so looping back to them doesn't wait
+    if (next_claim_ >= count && next_head_ < next_out_ && count - next_out_ + next_head_ < window_) {
+        return next_head_;
+    }
+    return -1;
+}
+
+void GstImageSequence::run()
+{
+    set_thread_name(L"[gstreamer::image-sequence]");
+    apply_thread_placement(placement_);
+
+    worker w;
+    while (!abort_request_) {
+        int64_t  index      = 0;
+        uint64_t generation = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [&] { return abort_request_ || (index = next_index()) >= 0; });
+            if (abort_request_) {
+                break;
+            }
+            if (index == next_claim_) {
+                ++next_claim_;
+            } else {
+                ++next_head_;
+            }
+            generation = generation_;
+        }
+
+        // A frame that fails to decode is skipped, its decoder is replaced in case it's stuck
+        GstBuffer* frame = nullptr;
+        try {
+            if (!w.pipeline) {
+                w = start_worker();
+            }
+            frame = decode(w, index);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            if (w.pipeline) {
+                gst_element_set_state(w.pipeline.get(), GST_STATE_NULL);
+            }
+            w = worker{};
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (generation == generation_ && ready_.count(index) == 0) {
+                ready_[index] = frame;
+            } else if (frame) {
+                gst_buffer_unref(frame);
+            }
+        }
+        cond_.notify_all();
+    }
+
+    if (w.pipeline) {
+        gst_element_set_state(w.pipeline.get(), GST_STATE_NULL);
+    }
+}
+
+bool GstImageSequence::try_pop(GstSample** sample)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const auto count = static_cast<int64_t>(numbers_.size());
+    while (true) {
+        if (next_out_ >= count) {
+            if (!loop_) {
+                return false;
+            }
+            next_out_   = 0;
+            next_claim_ = next_head_;
+            next_head_  = 0;
+            cond_.notify_all();
+        }
+
+        auto it = ready_.find(next_out_);
+        if (it == ready_.end()) {
+            return false;
+        }
+
+        auto       frame = it->second;
+        const auto index = next_out_++;
+        ready_.erase(it);
+        cond_.notify_all();
+
+        if (!frame) {
+            continue;
+        }
+
+        const auto num = fps_num_.load();
+        const auto den = fps_den_.load();
+
+        frame                      = gst_buffer_make_writable(frame);
+        GST_BUFFER_PTS(frame)      = gst_util_uint64_scale(index, den * GST_SECOND, num);
+        GST_BUFFER_DTS(frame)      = GST_CLOCK_TIME_NONE;
+        GST_BUFFER_DURATION(frame) = gst_util_uint64_scale(GST_SECOND, den, num);
+
+        auto caps = get_caps();
+        *sample   = gst_sample_new(frame, caps, nullptr, nullptr);
+        gst_caps_unref(caps);
+        gst_buffer_unref(frame);
+        return true;
+    }
+}
+
+void GstImageSequence::seek(int64_t position_ms)
+{
+    const auto count = static_cast<int64_t>(numbers_.size());
+    const auto index = std::clamp<int64_t>(
+        static_cast<int64_t>(gst_util_uint64_scale_round(std::max<int64_t>(position_ms, 0), fps_num_, fps_den_ * 1000)),
+        0,
+        std::max<int64_t>(count - 1, 0));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // Frames already decoded for the new position are kept, a loop back to the start usually finds them
+        for (auto it = ready_.begin(); it != ready_.end();) {
+            if (it->first >= index && it->first < index + window_) {
+                ++it;
+                continue;
+            }
+            if (it->second) {
+                gst_buffer_unref(it->second);
+            }
+            it = ready_.erase(it);
+        }
+
+        ++generation_;
+        next_out_   = index;
+        next_claim_ = index;
+        next_head_  = 0;
+        while (ready_.count(next_claim_)) {
+            ++next_claim_;
+        }
+    }
+    cond_.notify_all();
+}
+
+void GstImageSequence::set_frame_rate(int numerator, int denominator)
+{
+    if (numerator > 0 && denominator > 0) {
+        fps_num_ = numerator;
+        fps_den_ = denominator;
+    }
+}
+
+bool GstImageSequence::eof() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !loop_ && next_out_ >= static_cast<int64_t>(numbers_.size());
+}
+
+int64_t GstImageSequence::duration() const
+{
+    return static_cast<int64_t>(gst_util_uint64_scale(numbers_.size(), fps_den_ * 1000, fps_num_));
+}
+
+int64_t GstImageSequence::position() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<int64_t>(gst_util_uint64_scale(next_out_, fps_den_ * 1000, fps_num_));
+}
+
+double GstImageSequence::fill() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return window_ > 0 ? static_cast<double>(ready_.size()) / window_ : 0.0;
+}
+
+GstCaps* GstImageSequence::get_caps() const
+{
+    if (width_ == 0) {
+        return nullptr;
+    }
+    return gst_caps_new_simple("video/x-raw",
+                               "format", G_TYPE_STRING, "BGRA",
+                               "width", G_TYPE_INT, width_.load(),
+                               "height", G_TYPE_INT, height_.load(),
+                               "framerate", GST_TYPE_FRACTION, fps_num_.load(), fps_den_.load(),
+                               nullptr);
+}
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "../util/gst_thread.h"
+#include "../util/gst_util.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+namespace caspar { namespace gstreamer {
+
+// Plays a numbered image sequence such as renders/frame_%06d.png. Every image decodes on
+// its own, so a pool of workers, each with a small decode pipeline, decodes the frames ahead
+// of the reader in parallel and a reorder window hands them out in frame order. Gaps in the
+// numbering are skipped. Images have no frame rate, frames are timestamped at the rate set
+// with set_frame_rate(), 25 fps until then.
+class GstImageSequence
+{
+  public:
+    GstImageSequence(const std::string& pattern, bool loop, thread_placement placement);
+    ~GstImageSequence();
+
+    GstImageSequence(const GstImageSequence&)            = delete;
+    GstImageSequence& operator=(const GstImageSequence&) = delete;
+
+    // Next frame in order as BGRA, false while it's still being decoded or at the end
+    bool try_pop(GstSample** sample);
+
+    void seek(int64_t position_ms);
+    void set_frame_rate(int numerator, int denominator);
+
+    bool    eof() const;
+    int64_t duration() const; // milliseconds
+    int64_t position() const;
+    int     width() const { return width_; }
+    int     height() const { return height_; }
+    double  fill() const; // share of the read-ahead window decoded
+
+    GstCaps* get_caps() const;
+
+    // Whether the path has a printf style frame number, %d or %06d
+    static bool is_pattern(const std::string& path);
+
+    // The pattern relative to the media folder or absolute, when frames of it exist
+    static std::optional<std::string> resolve(const std::string& pattern);
+
+  private:
+    struct worker
+    {
+        gst_ptr<GstElement> pipeline;
+        gst_ptr<GstElement> appsrc;
+        gst_ptr<GstElement> appsink;
+        uint64_t            pushed = 0;
+    };
+
+    GstBuffer*  decode(worker& w, int64_t index);
+    worker      start_worker() const;
+    std::string frame_path(int64_t number) const;
+    int64_t     next_index() const; // to decode next, -1 when the window is full
+    void        run();
+
+    const thread_placement placement_;
+    const bool             loop_;
+    std::string            folder_;
+    std::string            prefix_; // file name up to the frame number
+    std::string            suffix_; // file name after it
+    int                    digits_ = 0;
+    std::string            caps_; // of the encoded images
+    std::vector<int64_t>   numbers_; // frame numbers found on disk, in order
+    int64_t                window_ = 0;
+
+    std::atomic<int> width_{0};
+    std::atomic<int> height_{0};
+    std::atomic<int> fps_num_{25};
+    std::atomic<int> fps_den_{1};
+
+    mutable std::mutex            mutex_;
+    std::condition_variable       cond_;
+    std::map<int64_t, GstBuffer*> ready_; // decoded frames by index, waiting for their turn
+    int64_t                       next_claim_ = 0;
+    int64_t                       next_out_   = 0;
+    int64_t                       next_head_  = 0; // first frames decoded ahead of a loop
+    uint64_t                      generation_ = 0; // raised by seeks, decodes started before are dropped
+
+    std::atomic<bool>   abort_request_{false};
+    boost::thread_group workers_;
+};
+
+}} // namespace caspar::gstreamer
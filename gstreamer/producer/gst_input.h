@@ -1,5 +1,9 @@
 #pragma once
 
+#include "gst_image_sequence.h"
+#include "gst_read_ahead_src.h"
+
+#include "../util/gst_thread.h"
 #include "../util/gst_util.h"
 #include <common/diagnostics/graph.h>
 
@@ -12,6 +16,7 @@
 #include <optional>
 #include <queue>
 #include <string>
+#include <utility>
 
 #include <tbb/concurrent_queue.h>
 
@@ -22,7 +27,10 @@ namespace caspar { namespace gstreamer {
 class GstInput
 {
   public:
-    GstInput(const std::string& uri, std::shared_ptr<diagnostics::graph> graph, std::optional<bool> loop = std::nullopt);
+    GstInput(const std::string&                  uri,
+             std::shared_ptr<diagnostics::graph> graph,
+             std::optional<bool>                 loop      = std::nullopt,
+             thread_placement                    placement = {});
     ~GstInput();
 
     // Get video and audio samples
@@ -36,11 +44,24 @@ class GstInput
     int audio_sample_rate() const;
     
     // Control methods
-    void seek(int64_t position, bool flush = true);
+    void seek(int64_t position, bool flush = true, bool snap_before = false);
+    void set_rate(double rate, bool key_only = false);
+    double rate() const { return rate_; }
+    
+    // Without sync the pipeline decodes as fast as the reader consumes and no video is dropped
+    void set_sync(bool sync);
     void abort();
     void reset();
     bool eof() const;
     int64_t duration() const;
+    
+    // Last known position and seekable range in milliseconds, refreshed twice a second
+    int64_t                     position() const;
+    std::pair<int64_t, int64_t> seek_window() const;
+
+    // Rate image sequences are timestamped at, other media carry their own
+    void set_frame_rate(int numerator, int denominator);
+
     void start();
     void stop();
     
@@ -49,19 +70,29 @@ class GstInput
     GstCaps* get_audio_caps() const;
     
     // Status information
-    bool is_valid() const { return pipeline_ != nullptr; }
+    bool audio_only() const { return audio_only_; }
+    bool is_valid() const { return pipeline_ != nullptr || sequence_ != nullptr; }
     
     // Static callback handlers for AppSink
     static GstFlowReturn new_video_sample(GstAppSink* sink, gpointer user_data);
     static GstFlowReturn new_audio_sample(GstAppSink* sink, gpointer user_data);
+    static void          source_setup(GstElement* playbin, GstElement* source, gpointer user_data);
+    static void          element_added(GstBin* bin, GstBin* sub_bin, GstElement* element, gpointer user_data);
 
   private:
     void initialize_pipeline(const std::string& uri);
     void create_pipeline(const std::string& uri);
+    bool seek_pipeline(gint64 position, GstSeekFlags flags);
+    void update_mute();
+    void clear_buffers();
+    void update_read_stats(double elapsed);
+    void update_position();
+    void abandon_download();
     
     std::string                              uri_;
     std::shared_ptr<diagnostics::graph>      graph_;
     std::optional<bool>                      loop_;
+    thread_placement                         placement_;
 
     // Pipeline elements
     gst_ptr<GstElement>                      pipeline_;
@@ -77,17 +108,42 @@ class GstInput
     std::atomic<bool>                        eof_{false};
     std::atomic<bool>                        abort_request_{false};
     
+    // Playback rate, negative for reverse. Key-only playback decodes keyframes only.
+    std::atomic<double>                      rate_{1.0};
+    std::atomic<bool>                        key_only_{false};
+    bool                                     has_scaletempo_ = false;
+    bool                                     audio_only_     = false;
+    std::atomic<bool>                        sync_{true};
+    
     // Stream info
     std::atomic<int>                         width_{0};
     std::atomic<int>                         height_{0};
     std::atomic<int>                         audio_channels_{0};
     std::atomic<int>                         audio_sample_rate_{0};
     std::atomic<int64_t>                     duration_{0};  // Store in milliseconds instead of GstClockTime
+    std::atomic<int64_t>                     position_ms_{0};
+    std::atomic<int64_t>                     window_start_ms_{0};
+    std::atomic<int64_t>                     window_end_ms_{0};
     
     // Synchronization
     mutable std::mutex                       mutex_;
     std::condition_variable                  cond_;
     
+    // Read-ahead of file sources, reported on the graph
+    std::shared_ptr<read_ahead_stats>        read_stats_;
+    std::mutex                               source_mutex_;
+    
+    // HTTP media being downloaded into the disk cache while it plays
+    std::string                              cache_uri_;
+    std::string                              cache_template_;
+    gst_ptr<GstElement>                      download_queue_;
+    std::atomic<bool>                        download_complete_{false};
+    int64_t                                  last_bytes_read_ = 0;
+    int64_t                                  last_stall_ns_   = 0;
+    
+    // Numbered images, decoded by their own workers instead of the pipeline
+    std::unique_ptr<GstImageSequence>        sequence_;
+
     // Monitoring thread
     boost::thread                            thread_;
 };
@@ -1,7 +1,12 @@
 #include "gst_producer.h"
+#include "gst_clock_recovery.h"
+#include "gst_frame_cache.h"
 #include "gst_input.h"
+#include "gst_shared_input.h"
+#include "gst_timeshift.h"
 
 #include "../util/gst_assert.h"
+#include "../util/gst_module_stats.h"
 #include "../util/gst_util.h"
 
 #include <boost/format.hpp>
@@ -22,9 +27,13 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cmath>
 #include <deque>
 #include <iomanip>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <thread>
 
@@ -53,16 +62,39 @@ struct GstProducer::Impl
     const std::string                          name_;
     const std::string                          path_;
 
-    GstInput                input_;
-    std::string             vfilter_;
+    // Live sources played through a time-shift ring instead of directly
+    std::unique_ptr<GstTimeshift>               timeshift_;
+    std::string                                 input_uri_;
+    std::atomic<bool>                           dvr_paused_{false};
+    std::atomic<bool>                           dvr_catch_up_{false};
+    std::atomic<bool>                           dvr_ready_{false}; // the ring's input is open
+
+    // Audio-only sources leave audio in channel frames of the cadence, with an empty image
+    bool                                        audio_only_ = false;
+    std::vector<int32_t>                        audio_fifo_;
+    GstClockTime                                audio_time_ = GST_CLOCK_TIME_NONE;
+
+    // Live sources played at the channel's clock instead of their own
+    std::unique_ptr<GstClockRecovery>           clock_recovery_;
+
+    std::shared_ptr<GstInput>                   input_;
+    std::shared_ptr<GstSharedInput::Subscriber> shared_input_;
+    std::atomic<bool>                           shared_{false};
+    std::atomic<int>                            shared_subscribers_{0};
+    std::string                                 vfilter_;
 
     std::atomic<int64_t>    start_{0};
     std::atomic<int64_t>    duration_{std::numeric_limits<int64_t>::max()};
     std::atomic<int64_t>    input_duration_{0};
     std::atomic<int64_t>    seek_{-1};
     std::atomic<bool>       loop_{false};
+    std::atomic<double>     speed_{1.0};
+    std::atomic<bool>       speed_key_only_{false};
+    std::atomic<bool>       speed_changed_{false};
 
     core::frame_geometry::scale_mode scale_mode_;
+    const alpha_mode                 alpha_;
+    const thread_placement           placement_;
     int64_t                          frame_count_    = 0;
     bool                             frame_flush_    = true;
     int64_t                          frame_time_     = 0;
@@ -75,6 +107,25 @@ struct GstProducer::Impl
     std::atomic<bool>               buffer_eof_{false};
     int                             buffer_capacity_ = static_cast<int>(format_desc_.fps) / 4;
 
+    // Jog/shuttle: frames are stepped from a cache of decoded GOPs around the playhead
+    struct Refill
+    {
+        bool    active    = false;
+        int64_t from      = -1;
+        int64_t until     = 0;
+        int     direction = 1;
+    };
+
+    GstFrameCache                   cache_{static_cast<size_t>(format_desc_.fps)};
+    std::atomic<bool>               jog_{false};
+    std::atomic<bool>               jog_changed_{false};
+    mutable std::mutex              jog_mutex_;
+    core::draw_frame                jog_frame_;
+    int64_t                         jog_pts_       = 0;
+    int                             jog_direction_ = 1;
+    std::optional<int64_t>          jog_target_;
+    std::atomic<int64_t>            source_period_{0};
+
     caspar::executor                executor_ { L"gstreamer_producer" };
 
     int latency_ = 0;
@@ -90,17 +141,23 @@ struct GstProducer::Impl
          std::optional<int64_t>               seek,
          std::optional<int64_t>               duration,
          std::optional<bool>                  loop,
-         core::frame_geometry::scale_mode     scale_mode)
+         core::frame_geometry::scale_mode     scale_mode,
+         bool                                 shared,
+         thread_placement                     placement,
+         int64_t                              timeshift,
+         alpha_mode                           alpha)
         : frame_factory_(frame_factory)
         , format_desc_(format_desc)
         , name_(name)
         , path_(path)
-        , input_(path, graph_)
+        , input_uri_(path)
         , vfilter_(vfilter)
         , start_(start.value_or(0))
         , duration_(duration.value_or(std::numeric_limits<int64_t>::max()))
         , loop_(loop.value_or(false))
         , scale_mode_(scale_mode)
+        , alpha_(alpha)
+        , placement_(std::move(placement))
     {
         diagnostics::register_graph(graph_);
         graph_->set_color("underflow", diagnostics::color(0.6f, 0.3f, 0.9f));
@@ -112,7 +169,36 @@ struct GstProducer::Impl
         state_["loop"]      = loop_;
         update_state();
 
-        input_.start();
+        // The ring's input is opened on the producer's thread once its first segments are recorded
+        if (timeshift > 0) {
+            timeshift_ = std::make_unique<GstTimeshift>(path_, timeshift, placement_);
+            input_uri_ = timeshift_->playlist_uri();
+            shared     = false;
+        }
+
+        // Image sequences have no rate of their own and play at the channel's, audio-only
+        // files are paced by the channel's audio cadence
+        audio_only_ = is_audio_only_uri(input_uri_);
+        if (GstImageSequence::is_pattern(input_uri_) || audio_only_) {
+            shared = false;
+        }
+
+        // The buffer is held at the target depth, with room above it for a frame in flight
+        if (is_live_uri(path_) && !timeshift_ &&
+            env::properties().get(L"configuration.gstreamer.clock-recovery.enabled", true)) {
+            const auto depth = env::properties().get(L"configuration.gstreamer.clock-recovery.depth", 4);
+            clock_recovery_  = std::make_unique<GstClockRecovery>(format_desc_,
+                                                                 std::clamp(depth, 2, std::max(buffer_capacity_ - 2, 2)));
+        }
+
+        if (shared) {
+            shared_input_ = GstSharedInput::subscribe(path_, loop, placement_);
+            shared_       = true;
+        } else if (!timeshift_) {
+            input_ = std::make_shared<GstInput>(input_uri_, graph_, std::nullopt, placement_);
+            input_->set_frame_rate(format_desc_.framerate.numerator(), format_desc_.framerate.denominator());
+            input_->start();
+        }
 
         // If we have a specific seek position
         if (seek && *seek > 0) {
@@ -122,6 +208,7 @@ struct GstProducer::Impl
         thread_ = boost::thread([=] {
             try {
                 set_thread_name(L"[gstreamer::producer]");
+                apply_thread_placement(placement_);
                 run();
             } catch (boost::thread_interrupted&) {
                 // Do nothing...
@@ -142,11 +229,74 @@ struct GstProducer::Impl
             // Do nothing...
         }
 
-        input_.abort();
+        if (input_) {
+            input_->abort();
+        }
+        input_.reset();
+        timeshift_.reset();
+    }
+
+    bool try_pop_video(GstSample** sample)
+    {
+        return shared_input_ ? shared_input_->try_pop_video(sample) : input_->try_pop_video(sample);
+    }
+
+    bool try_pop_audio(GstSample** sample)
+    {
+        return shared_input_ ? shared_input_->try_pop_audio(sample) : input_->try_pop_audio(sample);
+    }
+
+    bool input_eof() const { return shared_input_ ? shared_input_->eof() : input_->eof(); }
+
+    // Leaves the shared decode for a private input of the same source. Only file
+    // sources can do this, live sources can't be repositioned per layer.
+    bool detach()
+    {
+        if (!shared_input_) {
+            return true;
+        }
+
+        if (is_live_uri(path_)) {
+            CASPAR_LOG(warning) << print() << " Cannot seek a shared live source.";
+            return false;
+        }
+
+        CASPAR_LOG(info) << print() << " Detaching from shared decode.";
+
+        input_ = std::make_shared<GstInput>(input_uri_, graph_, std::nullopt, placement_);
+        input_->set_frame_rate(format_desc_.framerate.numerator(), format_desc_.framerate.denominator());
+        input_->start();
+
+        shared_input_.reset();
+        shared_ = false;
+        return true;
+    }
+
+    // Waits for the ring to have segments to play, the layer stays empty meanwhile
+    bool open_timeshift()
+    {
+        caspar::timer wait_timer;
+        while (!timeshift_->wait_ready(std::chrono::milliseconds(100))) {
+            boost::this_thread::interruption_point();
+            if (wait_timer.elapsed() > 15.0) {
+                CASPAR_LOG(error) << print() << " No time-shift segments recorded from " << path_ << ".";
+                return false;
+            }
+        }
+
+        input_ = std::make_shared<GstInput>(input_uri_, graph_, std::nullopt, placement_);
+        input_->set_frame_rate(format_desc_.framerate.numerator(), format_desc_.framerate.denominator());
+        input_->start();
+        dvr_ready_ = true;
+        return true;
     }
 
     void run()
     {
+        if (timeshift_ && !open_timeshift()) {
+            return;
+        }
+
         std::vector<int> audio_cadence = format_desc_.audio_cadence;
         boost::range::rotate(audio_cadence, std::end(audio_cadence) - 1);
 
@@ -155,18 +305,76 @@ struct GstProducer::Impl
 
         int warning_debounce = 0;
 
+        // Trick play state, see below
+        const double frame_period = 1000.0 / format_desc_.fps;
+        double       speed_acc    = 0.0;
+        int64_t      last_pts     = -1;
+
+        Refill refill;
+
         while (!thread_.interruption_requested()) {
+            if (jog_changed_.exchange(false)) {
+                if (jog_) {
+                    if (detach()) {
+                        // Decode as fast as the cache is filled instead of playing
+                        input_->set_sync(false);
+                        input_->stop();
+                        clear_buffer();
+                        refill = Refill{};
+                    } else {
+                        jog_ = false;
+                    }
+                } else if (input_) {
+                    // Resume playback where jogging left off, unless a seek replaces it
+                    input_->set_sync(true);
+                    if (seek_ < 0) {
+                        std::lock_guard<std::mutex> lock(jog_mutex_);
+                        input_->seek(jog_pts_);
+                    }
+                    input_->start();
+                    cache_.clear();
+                    frame        = Frame{};
+                    frame_flush_ = true;
+                    last_pts     = -1;
+                }
+            }
+
             {
                 const auto seek_pos = seek_.exchange(-1);
                 if (seek_pos >= 0) {
                     // Perform seek
-                    input_.seek(seek_pos);
+                    if (detach()) {
+                        input_->seek(seek_pos);
+                    }
                     frame = Frame{};
                     frame_flush_ = true;
+                    last_pts     = -1;
+                    clear_audio_fifo();
                     continue;
                 }
             }
 
+            // Catch-up plays slightly fast until it is back at the live edge
+            if (dvr_catch_up_ && !dvr_paused_ && dvr_delay() < 500) {
+                dvr_catch_up_   = false;
+                speed_          = 1.0;
+                speed_key_only_ = false;
+                speed_changed_  = true;
+            }
+
+            if (speed_changed_.exchange(false)) {
+                if (detach()) {
+                    input_->set_rate(speed_, speed_key_only_);
+                }
+                speed_acc = 0.0;
+                last_pts  = -1;
+            }
+
+            if (jog_) {
+                jog(refill);
+                continue;
+            }
+
             // Check if we've reached the end of the clip
             {
                 auto start = start_.load();
@@ -175,13 +383,15 @@ struct GstProducer::Impl
                 auto end = (duration != std::numeric_limits<int64_t>::max()) ? start + duration : INT64_MAX;
                 auto time = frame.pts + frame.duration;
                 
-                buffer_eof_ = input_.eof() || time >= end;
+                buffer_eof_ = input_eof() || time >= end;
 
                 if (buffer_eof_) {
-                    if (loop_ && frame_count_ > 2) {
+                    if (loop_ && frame_count_ > 2 && detach()) {
                         frame = Frame{};
-                        input_.seek(start);
+                        // Reverse playback loops from the end of the clip
+                        input_->seek(speed_ < 0 ? std::min(end, input_duration_.load()) : start);
                         frame_flush_ = true;
+                        clear_audio_fifo();
                     } else {
                         std::this_thread::sleep_for(std::chrono::milliseconds(10));
                     }
@@ -189,29 +399,135 @@ struct GstProducer::Impl
                 }
             }
 
+            input_duration_ = shared_input_ ? shared_input_->duration() : input_->duration();
+            if (shared_input_) {
+                shared_subscribers_ = shared_input_->subscriber_count();
+            }
+
+            if (audio_only_) {
+                if (!next_audio_frame(frame, audio_cadence)) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    continue;
+                }
+
+                frame.frame_count = frame_count_++;
+                {
+                    boost::unique_lock<boost::mutex> buffer_lock(buffer_mutex_);
+                    buffer_cond_.wait(buffer_lock, [&] { return buffer_.size() < buffer_capacity_; });
+                    if (seek_ == -1) {
+                        buffer_.push_back(frame);
+                    }
+                }
+
+                graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+                graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.fps * 0.5);
+                frame_timer.restart();
+
+                frame = Frame{};
+                continue;
+            }
+
             // Get a video sample from GStreamer
             GstSample* video_sample = nullptr;
-            if (input_.try_pop_video(&video_sample)) {
+            if (try_pop_video(&video_sample)) {
                 if (video_sample) {
+                    GstBuffer* buffer = gst_sample_get_buffer(video_sample);
+                    if (GST_BUFFER_DURATION_IS_VALID(buffer)) {
+                        source_period_ = static_cast<int64_t>(GST_BUFFER_DURATION(buffer) / GST_MSECOND);
+                    }
+
+                    // Trick play: the pipeline delivers frames at the requested speed, so each source
+                    // frame is shown for as many channel frames as its distance to the previous one
+                    // covers. Measuring the distance by pts also handles key frame only decode.
+                    int          repeats = 1;
+                    const double speed   = speed_;
+                    if (speed != 1.0 || speed_key_only_) {
+                        const auto pts = static_cast<int64_t>(GST_BUFFER_PTS(buffer));
+                        if (last_pts >= 0 && GST_BUFFER_PTS_IS_VALID(buffer)) {
+                            speed_acc += std::abs(pts - last_pts) / static_cast<double>(GST_MSECOND) /
+                                         std::abs(speed) / frame_period;
+                        } else {
+                            speed_acc += 1.0;
+                        }
+                        last_pts = pts;
+
+                        repeats = static_cast<int>(speed_acc);
+                        speed_acc -= repeats;
+
+                        if (repeats == 0) {
+                            gst_sample_unref(video_sample);
+                            continue;
+                        }
+                    }
+
+                    if (clock_recovery_) {
+                        GstSample* audio_sample = nullptr;
+                        while (try_pop_audio(&audio_sample)) {
+                            if (audio_sample) {
+                                clock_recovery_->push_audio(audio_sample);
+                                gst_sample_unref(audio_sample);
+                            }
+                        }
+
+                        size_t depth = 0;
+                        {
+                            boost::lock_guard<boost::mutex> buffer_lock(buffer_mutex_);
+                            depth = buffer_.size();
+                        }
+
+                        switch (clock_recovery_->next_video(depth)) {
+                            case GstClockRecovery::video_action::drop:
+                                CASPAR_LOG(info) << print() << " Clock recovery dropped a frame, source drifts by "
+                                                 << clock_recovery_->drift_ppm() << " ppm.";
+                                gst_sample_unref(video_sample);
+                                continue;
+                            case GstClockRecovery::video_action::repeat:
+                                CASPAR_LOG(info) << print() << " Clock recovery repeated a frame, source drifts by "
+                                                 << clock_recovery_->drift_ppm() << " ppm.";
+                                repeats += 1;
+                                break;
+                            default:
+                                break;
+                        }
+                    }
+
                     // Create a new frame
                     frame.video = video_sample;
                     
                     // Extract timing information
-                    GstBuffer* buffer = gst_sample_get_buffer(video_sample);
                     frame.pts = GST_BUFFER_PTS(buffer) / 1000000; // Convert from ns to ms
                     frame.duration = format_desc_.duration;
                     
-                    // Convert to a CasparCG frame
-                    frame.frame = core::draw_frame(make_frame(this, *frame_factory_, video_sample));
-                    frame.frame_count = frame_count_++;
+                    // Convert to a CasparCG frame. With clock recovery every copy carries its own
+                    // share of the resampled audio.
+                    std::vector<core::draw_frame> images;
+                    if (clock_recovery_) {
+                        for (int n = 0; n < repeats; ++n) {
+                            auto image = make_frame(this, *frame_factory_, video_sample, core::color_space::bt709, alpha_);
+                            image.audio_data() = clock_recovery_->pull_audio(frame.pts, audio_cadence.front());
+                            boost::range::rotate(audio_cadence, std::begin(audio_cadence) + 1);
+                            images.push_back(core::draw_frame(std::move(image)));
+                        }
+                    } else {
+                        frame.frame = core::draw_frame(make_frame(this, *frame_factory_, video_sample, core::color_space::bt709, alpha_));
+                    }
                     
                     // Add to buffer
-                    {
-                        boost::unique_lock<boost::mutex> buffer_lock(buffer_mutex_);
-                        buffer_cond_.wait(buffer_lock, [&] { return buffer_.size() < buffer_capacity_; });
-                        if (seek_ == -1) {
-                            buffer_.push_back(frame);
+                    for (int n = 0; n < repeats; ++n) {
+                        if (!images.empty()) {
+                            frame.frame = images[n];
+                        }
+                        frame.frame_count = frame_count_++;
+                        {
+                            boost::unique_lock<boost::mutex> buffer_lock(buffer_mutex_);
+                            buffer_cond_.wait(buffer_lock, [&] { return buffer_.size() < buffer_capacity_; });
+                            if (seek_ == -1) {
+                                buffer_.push_back(frame);
+                            }
                         }
+
+                        // Repeats share the converted frame, only the first one owns the sample
+                        frame.video = nullptr;
                     }
                     
                     graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
@@ -232,6 +548,192 @@ struct GstProducer::Impl
         }
     }
 
+    // Moves decoded audio into the FIFO until it holds the next channel frame's worth of the
+    // cadence, then takes that out as a frame without an image. Channels the source lacks are
+    // left silent, ones the channel lacks are dropped.
+    bool next_audio_frame(Frame& frame, std::vector<int>& cadence)
+    {
+        const auto channels = static_cast<size_t>(format_desc_.audio_channels);
+        const auto samples  = static_cast<size_t>(cadence.front()) * channels;
+
+        GstSample* sample = nullptr;
+        while (audio_fifo_.size() < samples && input_->try_pop_audio(&sample)) {
+            if (!sample) {
+                continue;
+            }
+            CASPAR_SCOPE_EXIT { gst_sample_unref(sample); };
+
+            GstBuffer* buffer = gst_sample_get_buffer(sample);
+            if (audio_fifo_.empty() && GST_BUFFER_PTS_IS_VALID(buffer)) {
+                audio_time_ = GST_BUFFER_PTS(buffer);
+            }
+            append_audio_samples(sample, format_desc_.audio_channels, audio_fifo_);
+        }
+
+        if (audio_fifo_.size() < samples) {
+            return false;
+        }
+
+        auto image         = frame_factory_->create_frame(this, core::pixel_format_desc(core::pixel_format::invalid));
+        image.audio_data() = std::vector<int32_t>(audio_fifo_.begin(), audio_fifo_.begin() + samples);
+        audio_fifo_.erase(audio_fifo_.begin(), audio_fifo_.begin() + samples);
+
+        frame.frame    = core::draw_frame(std::move(image));
+        frame.pts      = GST_CLOCK_TIME_IS_VALID(audio_time_) ? static_cast<int64_t>(audio_time_ / GST_MSECOND) : 0;
+        frame.duration = format_desc_.duration;
+
+        if (GST_CLOCK_TIME_IS_VALID(audio_time_)) {
+            audio_time_ += gst_util_uint64_scale(cadence.front(), GST_SECOND, format_desc_.audio_sample_rate);
+        }
+        boost::range::rotate(cadence, std::begin(cadence) + 1);
+        return true;
+    }
+
+    void clear_audio_fifo()
+    {
+        audio_fifo_.clear();
+        audio_time_ = GST_CLOCK_TIME_NONE;
+        if (clock_recovery_) {
+            clock_recovery_->reset();
+        }
+    }
+
+    int64_t source_period() const
+    {
+        const auto period = source_period_.load();
+        return period > 0 ? period : static_cast<int64_t>(1000.0 / format_desc_.fps);
+    }
+
+    void start_refill(Refill& refill, int64_t from, int64_t until, int direction)
+    {
+        input_->seek(from, true, true);
+        input_->start();
+        refill = Refill{true, from, until, direction};
+    }
+
+    // One iteration of jogging: keep the cache filled in the scrub direction and
+    // resolve steps that missed the cache once their frame has been decoded.
+    void jog(Refill& refill)
+    {
+        int64_t                pts;
+        int                    direction;
+        std::optional<int64_t> target;
+        {
+            std::lock_guard<std::mutex> lock(jog_mutex_);
+            pts       = jog_pts_;
+            direction = jog_direction_;
+            target    = jog_target_;
+        }
+
+        const auto period   = source_period();
+        const auto capacity = static_cast<int>(format_desc_.fps);
+        const auto window   = capacity / 2 * period;
+        const auto anchor   = target.value_or(pts);
+
+        if (!refill.active) {
+            const auto first = cache_.first();
+            const auto last  = cache_.last();
+
+            if (!first || anchor < *first - window || anchor > *last + window) {
+                // Jumped away from what is cached, start a new run around the target
+                cache_.clear();
+                if (direction > 0) {
+                    start_refill(refill, anchor, anchor + window, direction);
+                } else {
+                    start_refill(refill, std::max<int64_t>(0, anchor - window), anchor + period, direction);
+                }
+            } else if (direction > 0 && cache_.available(anchor, 1) < capacity / 4 && !input_eof()) {
+                start_refill(refill, *last, *last + window, direction);
+            } else if (direction < 0 && cache_.available(anchor, -1) < capacity / 4) {
+                // Nothing more to decode once a refill from the same position came back empty
+                const auto from = std::max<int64_t>(0, *first - window);
+                if (from != refill.from) {
+                    start_refill(refill, from, *first, direction);
+                }
+            }
+        }
+
+        const bool was_active = refill.active;
+        bool       received   = false;
+        GstSample* sample     = nullptr;
+        while (refill.active && try_pop_video(&sample)) {
+            if (!sample) {
+                continue;
+            }
+            received = true;
+
+            GstBuffer* buffer     = gst_sample_get_buffer(sample);
+            const auto sample_pts = static_cast<int64_t>(GST_BUFFER_PTS(buffer) / GST_MSECOND);
+            if (GST_BUFFER_DURATION_IS_VALID(buffer)) {
+                source_period_ = static_cast<int64_t>(GST_BUFFER_DURATION(buffer) / GST_MSECOND);
+            }
+
+            // Frames that were in flight from a previous position would break the contiguous run
+            if (sample_pts <= refill.until + period) {
+                auto frame = core::draw_frame(make_frame(this, *frame_factory_, sample, core::color_space::bt709, alpha_));
+                cache_.insert(sample_pts, frame);
+
+                std::lock_guard<std::mutex> lock(jog_mutex_);
+                if (jog_target_ && sample_pts >= *jog_target_ - period / 2) {
+                    jog_pts_   = sample_pts;
+                    jog_frame_ = frame;
+                    jog_target_.reset();
+                }
+            }
+            gst_sample_unref(sample);
+
+            if (sample_pts >= refill.until) {
+                refill.active = false;
+            }
+        }
+
+        if (refill.active && input_eof()) {
+            refill.active = false;
+        }
+
+        if (was_active && !refill.active) {
+            input_->stop();
+        }
+
+        if (!refill.active) {
+            // Stepped past what could be decoded, settle on the nearest cached frame
+            std::lock_guard<std::mutex> lock(jog_mutex_);
+            if (jog_target_) {
+                auto cached = cache_.nearest(*jog_target_);
+                if (cached) {
+                    jog_pts_   = cached->first;
+                    jog_frame_ = cached->second;
+                }
+                jog_target_.reset();
+            }
+        }
+
+        cache_.trim(pts);
+
+        if (!received) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+
+    void clear_buffer()
+    {
+        boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+
+        // Free GStreamer memory
+        for (auto& frame : buffer_) {
+            if (frame.video) {
+                gst_sample_unref(frame.video);
+            }
+            if (frame.audio) {
+                gst_sample_unref(frame.audio);
+            }
+        }
+        buffer_.clear();
+
+        buffer_cond_.notify_all();
+        graph_->set_value("buffer", 0.0);
+    }
+
     void update_state()
     {
         graph_->set_text(u16(print()));
@@ -239,6 +741,28 @@ struct GstProducer::Impl
         state_["file/clip"] = {start() / format_desc_.fps, duration() / format_desc_.fps};
         state_["file/time"] = {time() / format_desc_.fps, file_duration().value_or(0) / format_desc_.fps};
         state_["loop"]      = loop_;
+        state_["speed"]     = speed_.load();
+        state_["jog"]       = jog_.load();
+
+        state_["source/shared"]      = shared_.load();
+        state_["source/subscribers"] = shared_ ? shared_subscribers_.load() : 1;
+
+        if (clock_recovery_) {
+            state_["clock-recovery/drift-ppm"]      = clock_recovery_->drift_ppm();
+            state_["clock-recovery/depth"]          = clock_recovery_->depth();
+            state_["clock-recovery/audio-depth-ms"] = clock_recovery_->audio_depth();
+            state_["clock-recovery/drops"]          = clock_recovery_->drops();
+            state_["clock-recovery/repeats"]        = clock_recovery_->repeats();
+        }
+
+        if (dvr_ready_) {
+            const auto window = input_->seek_window();
+            state_["dvr/window"] = (window.second - window.first) / 1000.0;
+            state_["dvr/delay"]  = dvr_delay() / 1000.0;
+            state_["dvr/paused"] = dvr_paused_.load();
+        }
+
+        append_module_stats(state_, placement_.numa_node);
     }
 
     core::draw_frame prev_frame(const core::video_field field)
@@ -274,6 +798,19 @@ struct GstProducer::Impl
 
         boost::lock_guard<boost::mutex> lock(buffer_mutex_);
 
+        if (dvr_paused_) {
+            return core::draw_frame::still(frame_);
+        }
+
+        if (jog_) {
+            std::lock_guard<std::mutex> jog_lock(jog_mutex_);
+            if (jog_frame_) {
+                frame_      = jog_frame_;
+                frame_time_ = jog_pts_;
+            }
+            return core::draw_frame::still(frame_);
+        }
+
         if (buffer_.empty() || (frame_flush_ && buffer_.size() < 4)) {
             auto start    = start_.load();
             auto duration = duration_.load();
@@ -335,23 +872,53 @@ struct GstProducer::Impl
         CASPAR_SCOPE_EXIT { update_state(); };
 
         seek_ = time;
+        stop_jog();
 
-        {
-            boost::lock_guard<boost::mutex> lock(buffer_mutex_);
-            buffer_.clear();
-            
-            // Free GStreamer memory
-            for (auto& frame : buffer_) {
-                if (frame.video) {
-                    gst_sample_unref(frame.video);
-                }
-                if (frame.audio) {
-                    gst_sample_unref(frame.audio);
-                }
-            }
-            
-            buffer_cond_.notify_all();
-            graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+        clear_buffer();
+    }
+
+    void step(int offset)
+    {
+        CASPAR_SCOPE_EXIT { update_state(); };
+
+        if (is_live_uri(path_)) {
+            CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info("Cannot step a live source"));
+        }
+        if (audio_only_) {
+            CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info("Cannot step an audio-only source"));
+        }
+
+        boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+        std::lock_guard<std::mutex>     jog_lock(jog_mutex_);
+
+        if (!jog_) {
+            jog_pts_     = frame_time_;
+            jog_frame_   = frame_;
+            jog_         = true;
+            jog_changed_ = true;
+        }
+        jog_direction_ = offset < 0 ? -1 : 1;
+
+        if (jog_target_) {
+            // Still waiting for an earlier step, step on from where that one lands
+            jog_target_ = std::max<int64_t>(0, *jog_target_ + offset * source_period());
+            return;
+        }
+
+        auto cached = cache_.step(jog_pts_, offset);
+        if (cached) {
+            jog_pts_   = cached->first;
+            jog_frame_ = cached->second;
+        } else {
+            // Not decoded yet, the producer thread refills the cache and shows it once it arrives
+            jog_target_ = std::max<int64_t>(0, jog_pts_ + offset * source_period());
+        }
+    }
+
+    void stop_jog()
+    {
+        if (jog_.exchange(false)) {
+            jog_changed_ = true;
         }
     }
 
@@ -369,6 +936,84 @@ struct GstProducer::Impl
 
     bool loop() const { return loop_; }
 
+    void speed(double speed, bool key_only)
+    {
+        CASPAR_SCOPE_EXIT { update_state(); };
+
+        stop_jog();
+
+        speed_          = speed;
+        speed_key_only_ = key_only;
+        speed_changed_  = true;
+    }
+
+    double speed() const { return speed_; }
+
+    void require_timeshift() const
+    {
+        if (!timeshift_) {
+            CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info(print() + " was not opened with DVR"));
+        }
+        if (!dvr_ready_) {
+            CASPAR_THROW_EXCEPTION(invalid_operation()
+                                   << msg_info(print() + " is still recording its first time-shift segments"));
+        }
+    }
+
+    void dvr_pause(bool pause)
+    {
+        CASPAR_SCOPE_EXIT { update_state(); };
+        require_timeshift();
+
+        // The recorder keeps going, playout resumes where it paused as long as that is still in the ring
+        if (dvr_paused_.exchange(pause) != pause) {
+            if (pause) {
+                input_->stop();
+            } else {
+                input_->start();
+            }
+        }
+    }
+
+    void dvr_delay(int64_t delay)
+    {
+        CASPAR_SCOPE_EXIT { update_state(); };
+        require_timeshift();
+
+        const auto window = input_->seek_window();
+        dvr_catch_up_     = false;
+        if (speed_ != 1.0) {
+            speed(1.0, false);
+        }
+        seek(std::max(window.first, window.second - std::max<int64_t>(delay, 0)));
+        dvr_pause(false);
+    }
+
+    void dvr_rewind(int64_t offset)
+    {
+        require_timeshift();
+        dvr_delay(dvr_delay() + offset);
+    }
+
+    // Milliseconds behind the live edge of the recording
+    int64_t dvr_delay() const
+    {
+        if (!dvr_ready_) {
+            return 0;
+        }
+        return std::max<int64_t>(0, input_->seek_window().second - input_->position());
+    }
+
+    void dvr_catch_up()
+    {
+        CASPAR_SCOPE_EXIT { update_state(); };
+        require_timeshift();
+
+        dvr_pause(false);
+        dvr_catch_up_ = true;
+        speed(1.05, false);
+    }
+
     void start(int64_t start)
     {
         CASPAR_SCOPE_EXIT { update_state(); };
@@ -395,7 +1040,7 @@ struct GstProducer::Impl
 
     std::optional<int64_t> file_duration() const
     {
-        const auto input_duration = input_.duration();
+        const auto input_duration = input_duration_.load();
         if (input_duration == 0) {
             return {};
         }
@@ -422,7 +1067,11 @@ GstProducer::GstProducer(std::shared_ptr<core::frame_factory> frame_factory,
                        std::optional<int64_t>               seek,
                        std::optional<int64_t>               duration,
                        std::optional<bool>                  loop,
-                       core::frame_geometry::scale_mode     scale_mode)
+                       core::frame_geometry::scale_mode     scale_mode,
+                       bool                                 shared,
+                       thread_placement                     placement,
+                       int64_t                              timeshift,
+                       alpha_mode                           alpha)
     : impl_(new Impl(std::move(frame_factory),
                      std::move(format_desc),
                      std::move(name),
@@ -432,7 +1081,11 @@ GstProducer::GstProducer(std::shared_ptr<core::frame_factory> frame_factory,
                      std::move(seek),
                      std::move(duration),
                      std::move(loop),
-                     scale_mode))
+                     scale_mode,
+                     shared,
+                     std::move(placement),
+                     timeshift,
+                     alpha))
 {
 }
 
@@ -456,6 +1109,56 @@ GstProducer& GstProducer::loop(bool loop)
 
 bool GstProducer::loop() const { return impl_->loop(); }
 
+GstProducer& GstProducer::speed(double speed, bool key_only)
+{
+    impl_->speed(speed, key_only);
+    return *this;
+}
+
+double GstProducer::speed() const { return impl_->speed(); }
+
+GstProducer& GstProducer::step(int offset)
+{
+    impl_->step(offset);
+    return *this;
+}
+
+GstProducer& GstProducer::resume()
+{
+    impl_->stop_jog();
+    return *this;
+}
+
+bool GstProducer::jogging() const { return impl_->jog_; }
+
+GstProducer& GstProducer::dvr_pause(bool pause)
+{
+    impl_->dvr_pause(pause);
+    return *this;
+}
+
+GstProducer& GstProducer::dvr_delay(int64_t delay)
+{
+    impl_->dvr_delay(delay);
+    return *this;
+}
+
+GstProducer& GstProducer::dvr_rewind(int64_t offset)
+{
+    impl_->dvr_rewind(offset);
+    return *this;
+}
+
+GstProducer& GstProducer::dvr_catch_up()
+{
+    impl_->dvr_catch_up();
+    return *this;
+}
+
+int64_t GstProducer::dvr_delay() const { return impl_->dvr_delay(); }
+
+bool GstProducer::timeshifted() const { return impl_->timeshift_ != nullptr; }
+
 GstProducer& GstProducer::start(int64_t start)
 {
     impl_->start(start);
@@ -8,6 +8,9 @@
 #include <core/monitor/monitor.h>
 #include <core/video_format.h>
 
+#include "../util/gst_thread.h"
+#include "../util/gst_util.h"
+
 namespace caspar { namespace gstreamer {
 
 class GstProducer
@@ -22,7 +25,11 @@ public:
                 std::optional<int64_t>               seek,
                 std::optional<int64_t>               duration,
                 std::optional<bool>                  loop,
-                core::frame_geometry::scale_mode     scale_mode);
+                core::frame_geometry::scale_mode     scale_mode,
+                bool                                 shared    = false,
+                thread_placement                     placement = {},
+                int64_t                              timeshift = 0,
+                alpha_mode                           alpha     = alpha_mode::auto_detect);
 
     core::draw_frame prev_frame(const core::video_field field);
     core::draw_frame next_frame(const core::video_field field);
@@ -34,6 +41,23 @@ public:
     GstProducer& loop(bool loop);
     bool        loop() const;
 
+    GstProducer& speed(double speed, bool key_only = false);
+    double      speed() const;
+
+    // Steps frame by frame from a cache of decoded frames, resume() returns to playback
+    GstProducer& step(int offset);
+    GstProducer& resume();
+    bool        jogging() const;
+
+    // Time-shift of live sources opened with a DVR window. Delays and offsets are in milliseconds
+    // relative to the live edge, catch-up plays slightly fast until it reaches the live edge.
+    GstProducer& dvr_pause(bool pause);
+    GstProducer& dvr_delay(int64_t delay);
+    int64_t     dvr_delay() const;
+    GstProducer& dvr_rewind(int64_t offset);
+    GstProducer& dvr_catch_up();
+    bool        timeshifted() const;
+
     GstProducer& start(int64_t start);
     int64_t     start() const;
 
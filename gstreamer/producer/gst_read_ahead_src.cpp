@@ -0,0 +1,656 @@
+#include "gst_read_ahead_src.h"
+
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <gst/base/gstbasesrc.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace caspar { namespace gstreamer {
+
+namespace {
+
+const uint64_t chunk_size = 1024 * 1024;
+
+size_t default_window = 32 * 1024 * 1024;
+bool   default_mmap   = false;
+
+#ifndef _WIN32
+// A file mapping, kept alive by the buffers that point into it
+struct file_mapping
+{
+    void*  data = nullptr;
+    size_t size = 0;
+
+    ~file_mapping()
+    {
+        if (data) {
+            munmap(data, size);
+        }
+    }
+};
+#endif
+
+// Reads a file in chunks ahead of the position last asked for, on its own thread
+class file_reader
+{
+  public:
+    file_reader(std::string path, size_t window, bool use_mmap, std::shared_ptr<read_ahead_stats> stats)
+        : path_(std::move(path))
+        , window_chunks_(std::max<uint64_t>(window / chunk_size, 2))
+        , use_mmap_(use_mmap)
+        , stats_(std::move(stats))
+    {
+    }
+
+    ~file_reader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cond_.notify_all();
+
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+        if (file_) {
+            std::fclose(file_);
+        }
+    }
+
+    bool open()
+    {
+#ifdef _WIN32
+        file_ = _wfopen(u16(path_).c_str(), L"rb");
+#else
+        file_ = std::fopen(path_.c_str(), "rb");
+#endif
+        if (!file_) {
+            return false;
+        }
+
+        // Reads are already chunk sized, stdio buffering would only add a copy
+        std::setvbuf(file_, nullptr, _IONBF, 0);
+
+#ifdef _WIN32
+        _fseeki64(file_, 0, SEEK_END);
+        size_ = static_cast<uint64_t>(_ftelli64(file_));
+        if (use_mmap_) {
+            CASPAR_LOG(warning) << "[gstreamer] Memory mapped reads are not supported on Windows, reading ahead instead.";
+            use_mmap_ = false;
+        }
+#else
+        const int fd = fileno(file_);
+        struct stat info{};
+        fstat(fd, &info);
+        size_ = static_cast<uint64_t>(info.st_size);
+
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        if (use_mmap_ && size_ > 0) {
+            auto data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (data != MAP_FAILED) {
+                mapping_       = std::make_shared<file_mapping>();
+                mapping_->data = data;
+                mapping_->size = size_;
+            } else {
+                CASPAR_LOG(warning) << "[gstreamer] Could not map " << path_ << ", reading ahead instead.";
+                use_mmap_ = false;
+            }
+        }
+#endif
+
+        stats_->window = static_cast<int64_t>(window_chunks_ * chunk_size);
+
+        thread_ = std::thread([this] {
+            set_thread_name(L"[gstreamer::read_ahead]");
+            run();
+        });
+
+        return true;
+    }
+
+    uint64_t size() const { return size_; }
+
+    void set_flushing(bool flushing)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            flushing_ = flushing;
+        }
+        cond_.notify_all();
+    }
+
+    GstFlowReturn read(uint64_t offset, guint length, GstBuffer** out)
+    {
+        if (offset >= size_) {
+            return GST_FLOW_EOS;
+        }
+        length = static_cast<guint>(std::min<uint64_t>(length, size_ - offset));
+
+#ifndef _WIN32
+        if (mapping_) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                want_ = offset / chunk_size;
+            }
+            cond_.notify_all();
+
+            // The buffer holds a reference to the mapping, it may outlive the source
+            *out = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY,
+                                               mapping_->data,
+                                               mapping_->size,
+                                               offset,
+                                               length,
+                                               new std::shared_ptr<file_mapping>(mapping_),
+                                               [](gpointer data) {
+                                                   delete static_cast<std::shared_ptr<file_mapping>*>(data);
+                                               });
+            return GST_FLOW_OK;
+        }
+#endif
+
+        GstBuffer* buffer = gst_buffer_new_allocate(nullptr, length, nullptr);
+        GstMapInfo map;
+        if (!buffer || !gst_buffer_map(buffer, &map, GST_MAP_WRITE)) {
+            if (buffer) {
+                gst_buffer_unref(buffer);
+            }
+            return GST_FLOW_ERROR;
+        }
+
+        GstFlowReturn result = GST_FLOW_OK;
+        uint64_t      copied = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (copied < length) {
+                const auto position = offset + copied;
+                const auto index    = position / chunk_size;
+                auto       it       = chunks_.find(index);
+
+                if (it == chunks_.end()) {
+                    if (flushing_) {
+                        result = GST_FLOW_FLUSHING;
+                        break;
+                    }
+                    if (error_) {
+                        result = GST_FLOW_ERROR;
+                        break;
+                    }
+
+                    // The window ran dry or the demuxer jumped, wait for the I/O thread
+                    const auto stall = std::chrono::steady_clock::now();
+                    want_            = index;
+                    cond_.notify_all();
+                    cond_.wait(lock);
+                    stats_->stall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                            std::chrono::steady_clock::now() - stall)
+                                            .count();
+                    ++stats_->stalls;
+                    continue;
+                }
+
+                const auto chunk_offset = position - index * chunk_size;
+                const auto count = std::min<uint64_t>(length - copied, it->second->size() - chunk_offset);
+                std::memcpy(map.data + copied, it->second->data() + chunk_offset, count);
+                copied += count;
+            }
+
+            want_ = (offset + copied) / chunk_size;
+        }
+        cond_.notify_all();
+
+        gst_buffer_unmap(buffer, &map);
+
+        if (result != GST_FLOW_OK) {
+            gst_buffer_unref(buffer);
+            return result;
+        }
+
+        *out = buffer;
+        return GST_FLOW_OK;
+    }
+
+  private:
+    void run()
+    {
+        const uint64_t chunk_count = (size_ + chunk_size - 1) / chunk_size;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            const auto want = want_;
+
+#ifndef _WIN32
+            if (mapping_) {
+                // Let the kernel page in the window ahead of the demuxer
+                if (want != advised_) {
+                    advised_          = want;
+                    const auto offset = want * chunk_size;
+                    const auto length = std::min<uint64_t>(window_chunks_ * chunk_size, size_ - std::min(offset, size_));
+                    lock.unlock();
+                    madvise(static_cast<uint8_t*>(mapping_->data) + offset, length, MADV_WILLNEED);
+                    lock.lock();
+                    stats_->buffered = static_cast<int64_t>(length);
+                }
+                cond_.wait(lock, [&] { return stopping_ || want_ != advised_; });
+                continue;
+            }
+#endif
+
+            // Drop what fell out of the window, one chunk behind is kept for demuxers that step back
+            for (auto it = chunks_.begin(); it != chunks_.end();) {
+                if (it->first + 1 < want || it->first >= want + window_chunks_) {
+                    it = chunks_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+
+            uint64_t next = chunk_count;
+            for (auto index = want; index < std::min(want + window_chunks_, chunk_count); ++index) {
+                if (chunks_.find(index) == chunks_.end()) {
+                    next = index;
+                    break;
+                }
+            }
+
+            stats_->buffered = static_cast<int64_t>(chunks_.size() * chunk_size);
+
+            if (next == chunk_count || error_) {
+                cond_.wait(lock, [&] { return stopping_ || want_ != want; });
+                continue;
+            }
+
+            lock.unlock();
+            auto data = read_chunk(next);
+            lock.lock();
+
+            if (!data) {
+                CASPAR_LOG(error) << "[gstreamer] Read error in " << path_ << " at " << next * chunk_size;
+                error_ = true;
+            } else {
+                chunks_[next] = std::move(data);
+            }
+            cond_.notify_all();
+        }
+    }
+
+    std::shared_ptr<std::vector<uint8_t>> read_chunk(uint64_t index)
+    {
+        const auto offset = index * chunk_size;
+        const auto length = std::min(chunk_size, size_ - offset);
+
+        auto data = std::make_shared<std::vector<uint8_t>>(length);
+
+#ifdef _WIN32
+        if (_fseeki64(file_, static_cast<int64_t>(offset), SEEK_SET) != 0) {
+            return nullptr;
+        }
+        if (std::fread(data->data(), 1, length, file_) != length) {
+            return nullptr;
+        }
+#else
+        const int fd = fileno(file_);
+
+        // Ask the kernel for the chunk after this one while this one is read
+        posix_fadvise(fd, static_cast<off_t>(offset + length), static_cast<off_t>(chunk_size), POSIX_FADV_WILLNEED);
+
+        size_t done = 0;
+        while (done < length) {
+            const auto count = pread(fd, data->data() + done, length - done, static_cast<off_t>(offset + done));
+            if (count <= 0) {
+                return nullptr;
+            }
+            done += static_cast<size_t>(count);
+        }
+#endif
+
+        stats_->bytes_read += static_cast<int64_t>(length);
+        return data;
+    }
+
+    const std::string                 path_;
+    const uint64_t                    window_chunks_;
+    bool                              use_mmap_;
+    std::shared_ptr<read_ahead_stats> stats_;
+
+    std::FILE* file_ = nullptr;
+    uint64_t   size_ = 0;
+#ifndef _WIN32
+    std::shared_ptr<file_mapping> mapping_;
+    uint64_t                      advised_ = UINT64_MAX;
+#endif
+
+    std::mutex                                                       mutex_;
+    std::condition_variable                                          cond_;
+    std::map<uint64_t, std::shared_ptr<std::vector<uint8_t>>>        chunks_;
+    uint64_t                                                         want_     = 0;
+    bool                                                             flushing_ = false;
+    bool                                                             stopping_ = false;
+    bool                                                             error_    = false;
+    std::thread                                                      thread_;
+};
+
+enum
+{
+    PROP_0,
+    PROP_LOCATION,
+    PROP_WINDOW_SIZE,
+    PROP_USE_MMAP
+};
+
+GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+} // namespace
+
+struct CasparFileSrc
+{
+    GstBaseSrc parent;
+
+    gchar*                             location;
+    guint64                            window_size;
+    gboolean                           use_mmap;
+    file_reader*                       reader;
+    std::shared_ptr<read_ahead_stats>* stats;
+};
+
+struct CasparFileSrcClass
+{
+    GstBaseSrcClass parent_class;
+};
+
+static void caspar_file_src_uri_handler_init(gpointer g_iface, gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE(CasparFileSrc,
+                        caspar_file_src,
+                        GST_TYPE_BASE_SRC,
+                        G_IMPLEMENT_INTERFACE(GST_TYPE_URI_HANDLER, caspar_file_src_uri_handler_init))
+
+#define CASPAR_FILE_SRC(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), caspar_file_src_get_type(), CasparFileSrc))
+
+static void caspar_file_src_set_location(CasparFileSrc* self, const gchar* location)
+{
+    GST_OBJECT_LOCK(self);
+    g_free(self->location);
+    self->location = g_strdup(location);
+    GST_OBJECT_UNLOCK(self);
+}
+
+static void caspar_file_src_set_property(GObject* object, guint prop_id, const GValue* value, GParamSpec* pspec)
+{
+    auto self = CASPAR_FILE_SRC(object);
+
+    switch (prop_id) {
+        case PROP_LOCATION:
+            caspar_file_src_set_location(self, g_value_get_string(value));
+            break;
+        case PROP_WINDOW_SIZE:
+            self->window_size = g_value_get_uint64(value);
+            break;
+        case PROP_USE_MMAP:
+            self->use_mmap = g_value_get_boolean(value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void caspar_file_src_get_property(GObject* object, guint prop_id, GValue* value, GParamSpec* pspec)
+{
+    auto self = CASPAR_FILE_SRC(object);
+
+    switch (prop_id) {
+        case PROP_LOCATION:
+            GST_OBJECT_LOCK(self);
+            g_value_set_string(value, self->location);
+            GST_OBJECT_UNLOCK(self);
+            break;
+        case PROP_WINDOW_SIZE:
+            g_value_set_uint64(value, self->window_size);
+            break;
+        case PROP_USE_MMAP:
+            g_value_set_boolean(value, self->use_mmap);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+            break;
+    }
+}
+
+static void caspar_file_src_finalize(GObject* object)
+{
+    auto self = CASPAR_FILE_SRC(object);
+
+    delete self->reader;
+    delete self->stats;
+    g_free(self->location);
+
+    G_OBJECT_CLASS(caspar_file_src_parent_class)->finalize(object);
+}
+
+static gboolean caspar_file_src_start(GstBaseSrc* src)
+{
+    auto self = CASPAR_FILE_SRC(src);
+
+    GST_OBJECT_LOCK(self);
+    std::string location = self->location ? self->location : "";
+    GST_OBJECT_UNLOCK(self);
+
+    if (location.empty()) {
+        GST_ELEMENT_ERROR(self, RESOURCE, NOT_FOUND, ("No file name specified for reading."), (nullptr));
+        return FALSE;
+    }
+
+    auto reader = new file_reader(location, self->window_size, self->use_mmap != FALSE, *self->stats);
+    if (!reader->open()) {
+        delete reader;
+        GST_ELEMENT_ERROR(self, RESOURCE, OPEN_READ, ("Could not open file \"%s\" for reading.", location.c_str()),
+                          GST_ERROR_SYSTEM);
+        return FALSE;
+    }
+
+    self->reader = reader;
+    return TRUE;
+}
+
+static gboolean caspar_file_src_stop(GstBaseSrc* src)
+{
+    auto self = CASPAR_FILE_SRC(src);
+
+    delete self->reader;
+    self->reader = nullptr;
+    return TRUE;
+}
+
+static gboolean caspar_file_src_get_size(GstBaseSrc* src, guint64* size)
+{
+    auto self = CASPAR_FILE_SRC(src);
+    if (!self->reader) {
+        return FALSE;
+    }
+
+    *size = self->reader->size();
+    return TRUE;
+}
+
+static gboolean caspar_file_src_is_seekable(GstBaseSrc* src) { return TRUE; }
+
+static GstFlowReturn caspar_file_src_create(GstBaseSrc* src, guint64 offset, guint size, GstBuffer** buffer)
+{
+    auto self = CASPAR_FILE_SRC(src);
+    if (!self->reader) {
+        return GST_FLOW_FLUSHING;
+    }
+
+    auto result = self->reader->read(offset, size, buffer);
+    if (result == GST_FLOW_OK) {
+        GST_BUFFER_OFFSET(*buffer)     = offset;
+        GST_BUFFER_OFFSET_END(*buffer) = offset + gst_buffer_get_size(*buffer);
+    } else if (result == GST_FLOW_ERROR) {
+        GST_ELEMENT_ERROR(self, RESOURCE, READ, (nullptr), ("Could not read at offset %" G_GUINT64_FORMAT, offset));
+    }
+    return result;
+}
+
+static gboolean caspar_file_src_unlock(GstBaseSrc* src)
+{
+    auto self = CASPAR_FILE_SRC(src);
+    if (self->reader) {
+        self->reader->set_flushing(true);
+    }
+    return TRUE;
+}
+
+static gboolean caspar_file_src_unlock_stop(GstBaseSrc* src)
+{
+    auto self = CASPAR_FILE_SRC(src);
+    if (self->reader) {
+        self->reader->set_flushing(false);
+    }
+    return TRUE;
+}
+
+static void caspar_file_src_class_init(CasparFileSrcClass* klass)
+{
+    auto gobject_class = G_OBJECT_CLASS(klass);
+    auto element_class = GST_ELEMENT_CLASS(klass);
+    auto basesrc_class = GST_BASE_SRC_CLASS(klass);
+
+    gobject_class->set_property = caspar_file_src_set_property;
+    gobject_class->get_property = caspar_file_src_get_property;
+    gobject_class->finalize     = caspar_file_src_finalize;
+
+    g_object_class_install_property(
+        gobject_class,
+        PROP_LOCATION,
+        g_param_spec_string(
+            "location", "File Location", "Location of the file to read", nullptr,
+            static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(
+        gobject_class,
+        PROP_WINDOW_SIZE,
+        g_param_spec_uint64(
+            "window-size", "Window Size", "Bytes to read ahead of the reader", chunk_size * 2, G_MAXUINT64,
+            default_window, static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(
+        gobject_class,
+        PROP_USE_MMAP,
+        g_param_spec_boolean(
+            "use-mmap", "Use mmap", "Map the file instead of reading it, for local disks", default_mmap,
+            static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    gst_element_class_set_static_metadata(element_class,
+                                          "CasparCG read-ahead file source",
+                                          "Source/File",
+                                          "Reads a file ahead of the demuxer on a dedicated I/O thread",
+                                          "CasparCG");
+    gst_element_class_add_static_pad_template(element_class, &src_template);
+
+    basesrc_class->start       = caspar_file_src_start;
+    basesrc_class->stop        = caspar_file_src_stop;
+    basesrc_class->get_size    = caspar_file_src_get_size;
+    basesrc_class->is_seekable = caspar_file_src_is_seekable;
+    basesrc_class->create      = caspar_file_src_create;
+    basesrc_class->unlock      = caspar_file_src_unlock;
+    basesrc_class->unlock_stop = caspar_file_src_unlock_stop;
+}
+
+static void caspar_file_src_init(CasparFileSrc* self)
+{
+    self->location    = nullptr;
+    self->window_size = default_window;
+    self->use_mmap    = default_mmap;
+    self->reader      = nullptr;
+    self->stats       = new std::shared_ptr<read_ahead_stats>(std::make_shared<read_ahead_stats>());
+
+    gst_base_src_set_blocksize(GST_BASE_SRC(self), static_cast<guint>(chunk_size / 4));
+}
+
+static GstURIType caspar_file_src_uri_get_type(GType type) { return GST_URI_SRC; }
+
+static const gchar* const* caspar_file_src_uri_get_protocols(GType type)
+{
+    static const gchar* protocols[] = {"file", nullptr};
+    return protocols;
+}
+
+static gchar* caspar_file_src_uri_get_uri(GstURIHandler* handler)
+{
+    auto self = CASPAR_FILE_SRC(handler);
+
+    GST_OBJECT_LOCK(self);
+    gchar* uri = self->location ? gst_filename_to_uri(self->location, nullptr) : nullptr;
+    GST_OBJECT_UNLOCK(self);
+    return uri;
+}
+
+static gboolean caspar_file_src_uri_set_uri(GstURIHandler* handler, const gchar* uri, GError** error)
+{
+    gchar* location = g_filename_from_uri(uri, nullptr, nullptr);
+    if (!location) {
+        location = gst_uri_get_location(uri);
+    }
+    if (!location) {
+        g_set_error(error, GST_URI_ERROR, GST_URI_ERROR_BAD_URI, "Invalid file URI: %s", uri);
+        return FALSE;
+    }
+
+    caspar_file_src_set_location(CASPAR_FILE_SRC(handler), location);
+    g_free(location);
+    return TRUE;
+}
+
+static void caspar_file_src_uri_handler_init(gpointer g_iface, gpointer iface_data)
+{
+    auto iface = static_cast<GstURIHandlerInterface*>(g_iface);
+
+    iface->get_type      = caspar_file_src_uri_get_type;
+    iface->get_protocols = caspar_file_src_uri_get_protocols;
+    iface->get_uri       = caspar_file_src_uri_get_uri;
+    iface->set_uri       = caspar_file_src_uri_set_uri;
+}
+
+void register_read_ahead_source(size_t window_bytes, bool use_mmap)
+{
+    default_window = std::max<size_t>(window_bytes, chunk_size * 2);
+    default_mmap   = use_mmap;
+
+    if (!gst_element_register(nullptr, "casparfilesrc", GST_RANK_PRIMARY + 1, caspar_file_src_get_type())) {
+        CASPAR_LOG(warning) << L"[gstreamer] Could not register the read-ahead file source.";
+        return;
+    }
+
+    CASPAR_LOG(info) << L"[gstreamer] Read-ahead file source registered, " << default_window / (1024 * 1024)
+                     << L" MB window" << (use_mmap ? L", memory mapped." : L".");
+}
+
+std::shared_ptr<read_ahead_stats> get_read_ahead_stats(GstElement* source)
+{
+    if (!source || !G_TYPE_CHECK_INSTANCE_TYPE(source, caspar_file_src_get_type())) {
+        return nullptr;
+    }
+    return *CASPAR_FILE_SRC(source)->stats;
+}
+
+}} // namespace caspar::gstreamer
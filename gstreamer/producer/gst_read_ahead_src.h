@@ -0,0 +1,31 @@
+#pragma once
+
+#include <gst/gst.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace caspar { namespace gstreamer {
+
+// Counters of a read-ahead source, shared with whoever reports them
+struct read_ahead_stats
+{
+    std::atomic<int64_t> bytes_read{0};
+    std::atomic<int64_t> stall_ns{0};
+    std::atomic<int64_t> stalls{0};
+    std::atomic<int64_t> buffered{0};
+    std::atomic<int64_t> window{0};
+};
+
+// Registers "casparfilesrc", a file:// source that reads ahead of the demuxer in
+// large blocks on its own I/O thread, so storage hiccups are absorbed by the
+// window instead of stalling the streaming thread. It ranks above filesrc, which
+// makes playbin pick it for every file URI.
+void register_read_ahead_source(size_t window_bytes, bool use_mmap);
+
+// Counters of the source, nullptr when the element isn't a read-ahead source
+std::shared_ptr<read_ahead_stats> get_read_ahead_stats(GstElement* source);
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,204 @@
+#include "gst_shared_input.h"
+
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <map>
+#include <thread>
+
+namespace caspar { namespace gstreamer {
+
+namespace {
+
+std::mutex                                           registry_mutex;
+std::map<std::string, std::weak_ptr<GstSharedInput>> registry;
+
+std::string make_key(const std::string& uri, std::optional<bool> loop)
+{
+    // Everything that changes what the decoder produces has to be part of the key
+    return uri + "|loop=" + (loop.value_or(false) ? "1" : "0");
+}
+
+} // namespace
+
+void GstSharedInput::Ring::push(GstSample* sample)
+{
+    while (samples.size() >= capacity) {
+        gst_sample_unref(samples.front());
+        samples.pop_front();
+        ++first_seq;
+    }
+    samples.push_back(sample);
+}
+
+bool GstSharedInput::Ring::read(uint64_t& cursor, GstSample** sample, std::atomic<int64_t>& dropped) const
+{
+    if (cursor < first_seq) {
+        // Subscriber fell behind the ring, skip to the oldest sample still held
+        dropped += static_cast<int64_t>(first_seq - cursor);
+        cursor = first_seq;
+    }
+
+    if (cursor >= next_seq()) {
+        return false;
+    }
+
+    *sample = gst_sample_ref(samples[cursor - first_seq]);
+    ++cursor;
+    return true;
+}
+
+void GstSharedInput::Ring::clear()
+{
+    for (auto sample : samples) {
+        gst_sample_unref(sample);
+    }
+    first_seq += samples.size();
+    samples.clear();
+}
+
+GstSharedInput::GstSharedInput(const std::string& uri, std::optional<bool> loop, thread_placement placement)
+    : uri_(uri)
+    , input_(uri, graph_, loop, placement)
+{
+    video_ring_.capacity = 32;
+    audio_ring_.capacity = 64;
+
+    graph_->set_text(u16("gstreamer-shared[" + uri_ + "]"));
+    diagnostics::register_graph(graph_);
+
+    input_.start();
+
+    thread_ = boost::thread([this, placement] {
+        try {
+            set_thread_name(L"[gstreamer::shared_input]");
+            apply_thread_placement(placement);
+            run();
+        } catch (boost::thread_interrupted&) {
+            // Do nothing...
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    });
+}
+
+GstSharedInput::~GstSharedInput()
+{
+    try {
+        if (thread_.joinable()) {
+            thread_.interrupt();
+            thread_.join();
+        }
+    } catch (boost::thread_interrupted&) {
+        // Do nothing...
+    }
+
+    input_.abort();
+
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+    video_ring_.clear();
+    audio_ring_.clear();
+}
+
+std::shared_ptr<GstSharedInput::Subscriber>
+GstSharedInput::subscribe(const std::string& uri, std::optional<bool> loop, const thread_placement& placement)
+{
+    std::shared_ptr<GstSharedInput> source;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+
+        const auto key = make_key(uri, loop);
+        source         = registry[key].lock();
+        if (!source) {
+            CASPAR_LOG(info) << "Starting shared GStreamer decode for: " << uri;
+            source        = std::make_shared<GstSharedInput>(uri, loop, placement);
+            registry[key] = source;
+        } else {
+            CASPAR_LOG(info) << "Attaching to shared GStreamer decode for: " << uri;
+        }
+
+        // Drop entries whose source has already gone away
+        for (auto it = registry.begin(); it != registry.end();) {
+            it = it->second.expired() ? registry.erase(it) : std::next(it);
+        }
+    }
+
+    return std::make_shared<Subscriber>(std::move(source));
+}
+
+void GstSharedInput::run()
+{
+    int idle = 0;
+
+    while (!boost::this_thread::interruption_requested()) {
+        bool received = false;
+
+        GstSample* sample = nullptr;
+        while (input_.try_pop_video(&sample)) {
+            if (sample) {
+                std::lock_guard<std::mutex> lock(ring_mutex_);
+                video_ring_.push(sample);
+                received = true;
+            }
+        }
+
+        while (input_.try_pop_audio(&sample)) {
+            if (sample) {
+                std::lock_guard<std::mutex> lock(ring_mutex_);
+                audio_ring_.push(sample);
+                received = true;
+            }
+        }
+
+        idle = received ? 0 : idle + 1;
+
+        // Subscribers are paced by their channels, so we only have to keep up with the decoder
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(idle > 25 ? 10 : 2));
+    }
+}
+
+GstSharedInput::Subscriber::Subscriber(std::shared_ptr<GstSharedInput> source)
+    : source_(std::move(source))
+{
+    // New subscribers join at the decode head, like any viewer of a live stream
+    std::lock_guard<std::mutex> lock(source_->ring_mutex_);
+    video_cursor_ = source_->video_ring_.next_seq();
+    audio_cursor_ = source_->audio_ring_.next_seq();
+    ++source_->subscribers_;
+}
+
+GstSharedInput::Subscriber::~Subscriber()
+{
+    --source_->subscribers_;
+}
+
+bool GstSharedInput::Subscriber::try_pop_video(GstSample** sample)
+{
+    std::lock_guard<std::mutex> lock(source_->ring_mutex_);
+    return source_->video_ring_.read(video_cursor_, sample, dropped_);
+}
+
+bool GstSharedInput::Subscriber::try_pop_audio(GstSample** sample)
+{
+    std::lock_guard<std::mutex> lock(source_->ring_mutex_);
+    return source_->audio_ring_.read(audio_cursor_, sample, dropped_);
+}
+
+bool GstSharedInput::Subscriber::eof() const
+{
+    if (!source_->input_.eof()) {
+        return false;
+    }
+
+    // Let the subscriber drain what was decoded before the end of stream
+    std::lock_guard<std::mutex> lock(source_->ring_mutex_);
+    return video_cursor_ >= source_->video_ring_.next_seq();
+}
+
+int64_t GstSharedInput::Subscriber::duration() const { return source_->input_.duration(); }
+
+const std::string& GstSharedInput::Subscriber::uri() const { return source_->uri_; }
+
+int GstSharedInput::Subscriber::subscriber_count() const { return source_->subscribers_; }
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "gst_input.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/memory.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include <boost/thread.hpp>
+
+namespace caspar { namespace gstreamer {
+
+// Decodes a source once and fans the decoded samples out to every producer
+// playing it. Each subscriber keeps its own read cursor into a shared ring, so
+// N layers playing the same source cost one network pull and one decode.
+class GstSharedInput
+{
+  public:
+    class Subscriber
+    {
+      public:
+        explicit Subscriber(std::shared_ptr<GstSharedInput> source);
+        ~Subscriber();
+
+        Subscriber(const Subscriber&)            = delete;
+        Subscriber& operator=(const Subscriber&) = delete;
+
+        // Samples are returned with a reference owned by the caller
+        bool try_pop_video(GstSample** sample);
+        bool try_pop_audio(GstSample** sample);
+
+        bool    eof() const;
+        int64_t duration() const;
+
+        const std::string& uri() const;
+        int                subscriber_count() const;
+        int64_t            dropped() const { return dropped_; }
+
+      private:
+        std::shared_ptr<GstSharedInput> source_;
+        uint64_t                        video_cursor_;
+        uint64_t                        audio_cursor_;
+        std::atomic<int64_t>            dropped_{0};
+    };
+
+    GstSharedInput(const std::string& uri, std::optional<bool> loop, thread_placement placement);
+    ~GstSharedInput();
+
+    // Attaches to the running decode for uri + decode parameters, creating it on first use.
+    // The decode runs with the placement of the subscriber that created it.
+    static std::shared_ptr<Subscriber>
+    subscribe(const std::string& uri, std::optional<bool> loop, const thread_placement& placement = {});
+
+  private:
+    struct Ring
+    {
+        std::deque<GstSample*> samples;
+        uint64_t               first_seq = 0;
+        size_t                 capacity  = 0;
+
+        uint64_t next_seq() const { return first_seq + samples.size(); }
+        void     push(GstSample* sample);
+        bool     read(uint64_t& cursor, GstSample** sample, std::atomic<int64_t>& dropped) const;
+        void     clear();
+    };
+
+    void run();
+
+    const std::string                   uri_;
+    spl::shared_ptr<diagnostics::graph> graph_;
+    GstInput                            input_;
+
+    mutable std::mutex                  ring_mutex_;
+    Ring                                video_ring_;
+    Ring                                audio_ring_;
+
+    std::atomic<int>                    subscribers_{0};
+    boost::thread                       thread_;
+};
+
+}} // namespace caspar::gstreamer
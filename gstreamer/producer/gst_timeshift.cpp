@@ -0,0 +1,235 @@
+#include "gst_timeshift.h"
+
+#include "../util/gst_task_pool.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <algorithm>
+#include <thread>
+
+namespace caspar { namespace gstreamer {
+
+namespace fs = boost::filesystem;
+
+// Segments are cut at the first keyframe after this many seconds
+static const int64_t segment_seconds = 2;
+
+GstTimeshift::GstTimeshift(const std::string& uri, int64_t window_seconds, const thread_placement& placement)
+    : uri_(uri)
+    , window_seconds_(std::max(window_seconds, segment_seconds * 3))
+{
+    const auto root = env::properties().get(L"configuration.gstreamer.dvr.path", u16((fs::temp_directory_path() / "casparcg-dvr").string()));
+    folder_         = fs::path(root) / fs::unique_path("%%%%-%%%%-%%%%");
+    fs::create_directories(folder_);
+
+    pipeline_ = make_gst_ptr<GstElement>(gst_pipeline_new("timeshift"));
+    auto source = gst_element_factory_make("urisourcebin", "source");
+    auto parse  = gst_element_factory_make("parsebin", "parse");
+    auto sink   = gst_element_factory_make("hlssink2", "segments");
+    if (!source || !parse || !sink) {
+        CASPAR_THROW_EXCEPTION(caspar_exception()
+                               << msg_info("Time-shift needs urisourcebin, parsebin and hlssink2"));
+    }
+
+    const auto segments = static_cast<guint>(window_seconds_ / segment_seconds);
+    g_object_set(source, "uri", uri_.c_str(), nullptr);
+    g_object_set(sink,
+                 "location", (folder_ / "segment%06d.ts").string().c_str(),
+                 "playlist-location", (folder_ / "playlist.m3u8").string().c_str(),
+                 "target-duration", static_cast<guint>(segment_seconds),
+                 "playlist-length", segments,
+                 // A few more on disk than listed, so a reader of the oldest segment doesn't lose it
+                 "max-files", segments + 3,
+                 "send-keyframe-requests", FALSE,
+                 nullptr);
+
+    gst_bin_add_many(GST_BIN(pipeline_.get()), source, parse, sink, nullptr);
+    parse_ = make_gst_ptr<GstElement>(GST_ELEMENT(gst_object_ref(parse)));
+    sink_  = make_gst_ptr<GstElement>(GST_ELEMENT(gst_object_ref(sink)));
+
+    g_signal_connect(source, "pad-added", G_CALLBACK(&GstTimeshift::pad_added), this);
+    g_signal_connect(parse, "pad-added", G_CALLBACK(&GstTimeshift::pad_added), this);
+
+    install_task_pool(pipeline_.get(), placement);
+
+    if (gst_element_set_state(pipeline_.get(), GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to start time-shift recording of " + uri_));
+    }
+
+    CASPAR_LOG(info) << "Recording " << uri_ << " for time-shift into " << folder_.string() << ", "
+                     << window_seconds_ << " seconds.";
+
+    thread_ = boost::thread([this, placement] {
+        try {
+            set_thread_name(L"[gstreamer::timeshift]");
+            apply_thread_placement(placement);
+            run();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    });
+}
+
+GstTimeshift::~GstTimeshift()
+{
+    abort_request_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    gst_element_set_state(pipeline_.get(), GST_STATE_NULL);
+
+    boost::system::error_code ec;
+    fs::remove_all(folder_, ec);
+}
+
+std::string GstTimeshift::playlist_uri() const
+{
+    gchar*      uri = gst_filename_to_uri((folder_ / "playlist.m3u8").string().c_str(), nullptr);
+    std::string result = uri ? uri : "";
+    g_free(uri);
+    return result;
+}
+
+bool GstTimeshift::wait_ready(std::chrono::milliseconds timeout) const
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    // The demuxer starts a live playlist a few segments from its end, give it more than one
+    while (std::chrono::steady_clock::now() < deadline) {
+        fs::ifstream file(folder_ / "playlist.m3u8");
+        std::string  line;
+        int          segments = 0;
+        while (std::getline(file, line)) {
+            if (boost::starts_with(line, "#EXTINF")) {
+                ++segments;
+            }
+        }
+        if (segments >= 2) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return false;
+}
+
+void GstTimeshift::pad_added(GstElement* element, GstPad* pad, gpointer user_data)
+{
+    auto self = static_cast<GstTimeshift*>(user_data);
+
+    if (element != self->parse_.get()) {
+        // Source pads feed the parser, it splits the container into elementary streams
+        GstPad* sink = gst_element_get_static_pad(self->parse_.get(), "sink");
+        if (sink && !gst_pad_is_linked(sink)) {
+            gst_pad_link(pad, sink);
+        }
+        if (sink) {
+            gst_object_unref(sink);
+        }
+        return;
+    }
+
+    self->link_stream(pad);
+}
+
+void GstTimeshift::link_stream(GstPad* pad)
+{
+    GstCaps* caps = gst_pad_get_current_caps(pad);
+    if (!caps) {
+        caps = gst_pad_query_caps(pad, nullptr);
+    }
+    const std::string name = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+    gst_caps_unref(caps);
+
+    GstElement* element  = nullptr;
+    const char* sink_pad = nullptr;
+
+    if ((name == "video/x-h264" || name == "video/x-h265") && !has_video_) {
+        // The muxer wants Annex B with parameter sets in front of every keyframe
+        element = gst_element_factory_make(name == "video/x-h264" ? "h264parse" : "h265parse", nullptr);
+        g_object_set(element, "config-interval", -1, nullptr);
+        sink_pad   = "video";
+        has_video_ = true;
+    } else if (boost::starts_with(name, "audio/") && !has_audio_) {
+        element    = gst_element_factory_make("queue", nullptr);
+        sink_pad   = "audio";
+        has_audio_ = true;
+    } else {
+        // Segments only take H.264 and H.265, a recording of other video would play without picture
+        if (boost::starts_with(name, "video/") && !has_video_) {
+            CASPAR_LOG(warning) << "Time-shift of " << uri_ << " can't record " << name
+                                << " video, only H.264 and H.265. The recording has no picture.";
+        } else {
+            CASPAR_LOG(debug) << "Time-shift of " << uri_ << " ignores stream " << name;
+        }
+        element = gst_element_factory_make("fakesink", nullptr);
+        g_object_set(element, "sync", FALSE, "async", FALSE, nullptr);
+    }
+
+    gst_bin_add(GST_BIN(pipeline_.get()), element);
+    gst_element_sync_state_with_parent(element);
+
+    GstPad* element_sink = gst_element_get_static_pad(element, "sink");
+    gst_pad_link(pad, element_sink);
+    gst_object_unref(element_sink);
+
+    if (sink_pad) {
+#if GST_CHECK_VERSION(1, 20, 0)
+        GstPad* segments_sink = gst_element_request_pad_simple(sink_.get(), sink_pad);
+#else
+        GstPad* segments_sink = gst_element_get_request_pad(sink_.get(), sink_pad);
+#endif
+        GstPad* element_src = gst_element_get_static_pad(element, "src");
+        if (!segments_sink || gst_pad_link(element_src, segments_sink) != GST_PAD_LINK_OK) {
+            CASPAR_LOG(warning) << "Time-shift of " << uri_ << " could not record " << name;
+        }
+        gst_object_unref(element_src);
+        if (segments_sink) {
+            gst_object_unref(segments_sink);
+        }
+    }
+}
+
+void GstTimeshift::run()
+{
+    GstBus* bus = gst_element_get_bus(pipeline_.get());
+
+    while (!abort_request_) {
+        GstMessage* msg = gst_bus_timed_pop(bus, 100 * GST_MSECOND);
+        if (!msg) {
+            continue;
+        }
+
+        switch (GST_MESSAGE_TYPE(msg)) {
+            case GST_MESSAGE_ERROR: {
+                GError* err      = nullptr;
+                gchar*  dbg_info = nullptr;
+                gst_message_parse_error(msg, &err, &dbg_info);
+                CASPAR_LOG(error) << "Time-shift recording of " << uri_ << " failed: " << (err ? err->message : "unknown")
+                                  << " " << (dbg_info ? dbg_info : "");
+                g_error_free(err);
+                g_free(dbg_info);
+                break;
+            }
+            case GST_MESSAGE_EOS:
+                CASPAR_LOG(warning) << "Time-shift source " << uri_ << " ended.";
+                break;
+            default:
+                break;
+        }
+
+        gst_message_unref(msg);
+    }
+
+    gst_object_unref(bus);
+}
+
+}} // namespace caspar::gstreamer
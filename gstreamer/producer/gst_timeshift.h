@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../util/gst_thread.h"
+#include "../util/gst_util.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/thread.hpp>
+
+namespace caspar { namespace gstreamer {
+
+// Records a live source as it arrives, without re-encoding, into a bounded ring
+// of HLS segments on disk. Playing the ring's playlist instead of the source
+// allows pausing, rewinding and delayed playout within the recorded window
+// while the source itself is still pulled only once.
+class GstTimeshift
+{
+  public:
+    GstTimeshift(const std::string& uri, int64_t window_seconds, const thread_placement& placement);
+    ~GstTimeshift();
+
+    GstTimeshift(const GstTimeshift&)            = delete;
+    GstTimeshift& operator=(const GstTimeshift&) = delete;
+
+    // file:// URI of the live playlist of the ring
+    std::string playlist_uri() const;
+
+    // Waits until enough segments are on disk to start playing the playlist
+    bool wait_ready(std::chrono::milliseconds timeout) const;
+
+    int64_t window() const { return window_seconds_; }
+
+  private:
+    static void pad_added(GstElement* element, GstPad* pad, gpointer user_data);
+    void        link_stream(GstPad* pad);
+    void        run();
+
+    const std::string      uri_;
+    const int64_t          window_seconds_;
+    boost::filesystem::path folder_;
+
+    gst_ptr<GstElement> pipeline_;
+    gst_ptr<GstElement> parse_;
+    gst_ptr<GstElement> sink_;
+    bool                has_video_ = false;
+    bool                has_audio_ = false;
+
+    std::atomic<bool> abort_request_{false};
+    boost::thread     thread_;
+};
+
+}} // namespace caspar::gstreamer
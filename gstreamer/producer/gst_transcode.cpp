@@ -0,0 +1,584 @@
+#include "../StdAfx.h"
+
+#include "gst_transcode.h"
+
+#include "../consumer/gstreamer_consumer.h"
+#include "../util/gst_task_pool.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/filesystem.h>
+#include <common/os/thread.h>
+#include <common/param.h>
+#include <common/scope_exit.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+
+#include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+
+#include <gst/app/gstappsrc.h>
+
+#include <algorithm>
+#include <future>
+#include <thread>
+
+namespace caspar { namespace gstreamer {
+
+namespace fs = boost::filesystem;
+
+// Chunks shorter than this spend more time starting decoders and encoders than they save
+static const int64_t min_chunk_seconds = 10;
+
+// Decoded frames an encoder may have queued before the job waits for it
+static const guint max_queued_frames = 4;
+
+namespace {
+
+// Jobs stopped away from the channel's thread. Each thread moves itself to exited when done, those
+// are joined with the next stop, the others when the module unloads.
+std::mutex                             stopping_mutex;
+std::map<std::thread::id, std::thread> stopping;
+std::vector<std::thread>               exited;
+
+void stop_in_background(std::unique_ptr<GstTranscodeJob> job)
+{
+    std::vector<std::thread> done;
+    {
+        // Held while the thread is added, its own exit waits for it to be registered
+        std::lock_guard<std::mutex> lock(stopping_mutex);
+        std::thread thread([job = std::move(job)]() mutable {
+            try {
+                job.reset();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+
+            std::lock_guard<std::mutex> lock(stopping_mutex);
+            auto                        self = stopping.find(std::this_thread::get_id());
+            if (self != stopping.end()) {
+                exited.push_back(std::move(self->second));
+                stopping.erase(self);
+            }
+        });
+        const auto id = thread.get_id();
+        stopping.emplace(id, std::move(thread));
+        done.swap(exited);
+    }
+    for (auto& thread : done) {
+        thread.join();
+    }
+}
+
+} // namespace
+
+void uninit_transcodes()
+{
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(stopping_mutex);
+        for (auto& thread : stopping) {
+            threads.push_back(std::move(thread.second));
+        }
+        stopping.clear();
+        for (auto& thread : exited) {
+            threads.push_back(std::move(thread));
+        }
+        exited.clear();
+    }
+    if (!threads.empty()) {
+        CASPAR_LOG(info) << "[gstreamer] Waiting for " << threads.size() << " transcodes to stop.";
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+GstTranscodeJob::GstTranscodeJob(Settings settings)
+    : settings_(std::move(settings))
+    , options_(parse_consumer_options(settings_.options))
+    , graph_(std::make_shared<diagnostics::graph>())
+{
+    if (settings_.output.empty()) {
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Transcode needs an output path"));
+    }
+
+    thread_ = boost::thread([this] { run(); });
+}
+
+GstTranscodeJob::~GstTranscodeJob()
+{
+    cancel();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void GstTranscodeJob::cancel() { abort_request_ = true; }
+
+bool GstTranscodeJob::finished() const { return finished_; }
+
+transcode_progress GstTranscodeJob::progress() const
+{
+    transcode_progress progress;
+    progress.frames      = frames_;
+    progress.total       = total_;
+    progress.chunks      = chunks_;
+    progress.chunks_done = chunks_done_;
+
+    std::lock_guard<std::mutex> lock(status_mutex_);
+    progress.status = status_;
+    progress.error  = error_;
+
+    const auto now     = finished_ ? stopped_ : std::chrono::steady_clock::now();
+    const auto elapsed = std::chrono::duration<double>(now - started_).count();
+    if (elapsed > 0 && fps_num_ > 0) {
+        progress.fps   = progress.frames / elapsed;
+        progress.speed = progress.fps * fps_den_ / fps_num_;
+    }
+    return progress;
+}
+
+void GstTranscodeJob::set_status(const std::string& status, const std::string& error)
+{
+    std::lock_guard<std::mutex> lock(status_mutex_);
+    status_ = status;
+    error_  = error;
+}
+
+std::unique_ptr<GstInput> GstTranscodeJob::open_input(int64_t position)
+{
+    auto input = std::make_unique<GstInput>(settings_.input, graph_, false, settings_.placement);
+    if (!input->is_valid()) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Can't open " + settings_.input));
+    }
+
+    // Decode as fast as the encoder takes the frames instead of at the clip's rate
+    input->set_sync(false);
+
+    if (position > 0) {
+        // Seeking needs the prerolled pipeline, which has the duration
+        const auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (input->duration() <= 0 && !abort_request_ && std::chrono::steady_clock::now() < timeout) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        // From the keyframe before the chunk, the frames ahead of it are dropped by encode()
+        input->seek(position, true, true);
+    }
+
+    input->start();
+    return input;
+}
+
+gst_ptr<GstSample> GstTranscodeJob::next_sample(GstInput& input)
+{
+    GstSample* sample = nullptr;
+    while (!abort_request_) {
+        if (input.try_pop_video(&sample)) {
+            return make_gst_ptr<GstSample>(sample);
+        }
+        if (input.eof()) {
+            // The last frames may have been queued between the two checks
+            return input.try_pop_video(&sample) ? make_gst_ptr<GstSample>(sample) : nullptr;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return nullptr;
+}
+
+void GstTranscodeJob::encode(GstInput&          input,
+                             gst_ptr<GstSample> pending,
+                             int64_t            begin,
+                             int64_t            end,
+                             const std::string& sink)
+{
+    const auto frame_duration = gst_util_uint64_scale(GST_SECOND, fps_den_, fps_num_);
+
+    gst_ptr<GstElement> pipeline;
+    gst_ptr<GstElement> appsrc;
+    int64_t             last = -1;
+
+    while (!abort_request_) {
+        auto sample = pending ? std::move(pending) : next_sample(input);
+        if (!sample) {
+            break;
+        }
+
+        auto buffer = gst_sample_get_buffer(sample.get());
+        if (!buffer || !GST_BUFFER_PTS_IS_VALID(buffer)) {
+            continue;
+        }
+
+        // Frames are numbered by their stream time, which doesn't depend on how the chunk was seeked
+        auto time = gst_segment_to_stream_time(gst_sample_get_segment(sample.get()), GST_FORMAT_TIME,
+                                               GST_BUFFER_PTS(buffer));
+        if (!GST_CLOCK_TIME_IS_VALID(time)) {
+            time = GST_BUFFER_PTS(buffer);
+        }
+        const auto index = static_cast<int64_t>(gst_util_uint64_scale_round(time, fps_num_, fps_den_ * GST_SECOND));
+        if (index < begin || index <= last) {
+            continue;
+        }
+        if (end >= 0 && index >= end) {
+            break;
+        }
+        last = index;
+
+        if (!pipeline) {
+            pipeline = create_pipeline("appsrc name=src format=time ! " +
+                                       video_encode_description(options_, threads_, false) + sink);
+            install_task_pool(pipeline.get(), settings_.placement);
+
+            appsrc = make_gst_ptr<GstElement>(gst_bin_get_by_name(GST_BIN(pipeline.get()), "src"));
+            g_object_set(G_OBJECT(appsrc.get()), "caps", gst_sample_get_caps(sample.get()), nullptr);
+
+            if (gst_element_set_state(pipeline.get(), GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+                gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+                CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Can't start the transcode encoder"));
+            }
+        }
+
+        // Wait for the encoder to catch up, polling so that a failed encoder doesn't leave the push blocked
+        const auto max_bytes = gst_buffer_get_size(buffer) * max_queued_frames;
+        try {
+            while (!abort_request_ && gst_app_src_get_current_level_bytes(GST_APP_SRC(appsrc.get())) >= max_bytes) {
+                poll(pipeline.get(), GST_MSECOND);
+            }
+        } catch (...) {
+            gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+            throw;
+        }
+
+        // Shares the decoded memory, only the timestamps are the chunk's own. Restamped from the
+        // frame number, the chunks of a job continue each other's timeline exactly.
+        auto out                 = gst_buffer_copy(buffer);
+        GST_BUFFER_PTS(out)      = gst_util_uint64_scale(index, fps_den_ * GST_SECOND, fps_num_);
+        GST_BUFFER_DTS(out)      = GST_CLOCK_TIME_NONE;
+        GST_BUFFER_DURATION(out) = frame_duration;
+        if (gst_app_src_push_buffer(GST_APP_SRC(appsrc.get()), out) != GST_FLOW_OK) {
+            break;
+        }
+        ++frames_;
+    }
+
+    if (!pipeline) {
+        return;
+    }
+
+    gst_app_src_end_of_stream(GST_APP_SRC(appsrc.get()));
+    run_to_eos(pipeline.get());
+}
+
+bool GstTranscodeJob::poll(GstElement* pipeline, GstClockTime timeout)
+{
+    GstBus*     bus = gst_element_get_bus(pipeline);
+    GstMessage* msg = gst_bus_timed_pop_filtered(
+        bus, timeout, static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    gst_object_unref(bus);
+
+    if (!msg) {
+        return false;
+    }
+
+    std::string error;
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+        GError* err      = nullptr;
+        gchar*  dbg_info = nullptr;
+        gst_message_parse_error(msg, &err, &dbg_info);
+        error = err ? err->message : "unknown";
+        g_error_free(err);
+        g_free(dbg_info);
+    }
+    gst_message_unref(msg);
+
+    if (!error.empty()) {
+        CASPAR_THROW_EXCEPTION(caspar_exception()
+                               << msg_info("Transcode to " + settings_.output + " failed: " + error));
+    }
+    return true;
+}
+
+void GstTranscodeJob::run_to_eos(GstElement* pipeline)
+{
+    try {
+        while (!abort_request_ && !poll(pipeline, 100 * GST_MSECOND)) {
+        }
+    } catch (...) {
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        throw;
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+}
+
+void GstTranscodeJob::join(const std::vector<std::string>& parts)
+{
+    set_status("joining");
+
+    // Each part is a transport stream of its own muxer, with its own continuity counters and tables,
+    // so each is demuxed on its own. concat plays them one after another into the output's muxer,
+    // moving each part's segment to where the one before ended.
+    std::string description = "concat name=parts ! h264parse ! " + output_description(settings_.output, options_);
+    for (const auto& part : parts) {
+        description += "filesrc location=\"" + part + "\" ! tsdemux ! h264parse ! parts. ";
+    }
+
+    auto pipeline = create_pipeline(description);
+    install_task_pool(pipeline.get(), settings_.placement);
+
+    gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
+    CASPAR_SCOPE_EXIT {
+        for (const auto& part : parts) {
+            boost::system::error_code ec;
+            fs::remove(part, ec);
+        }
+    };
+    run_to_eos(pipeline.get());
+}
+
+void GstTranscodeJob::run()
+{
+    set_thread_name(L"[gstreamer::transcode]");
+    apply_thread_placement(settings_.placement);
+
+    {
+        std::lock_guard<std::mutex> lock(status_mutex_);
+        started_ = std::chrono::steady_clock::now();
+    }
+
+    std::vector<std::string> parts;
+    try {
+        // The first frame tells the frame rate, needed to number frames and split the clip
+        auto input = open_input(0);
+        auto first = next_sample(*input);
+        if (!first) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("No video decoded from " + settings_.input));
+        }
+
+        GstVideoInfo info;
+        if (!gst_video_info_from_caps(&info, gst_sample_get_caps(first.get())) || info.fps_n <= 0) {
+            CASPAR_THROW_EXCEPTION(caspar_exception()
+                                   << msg_info(settings_.input + " has no constant frame rate to transcode at"));
+        }
+        {
+            std::lock_guard<std::mutex> lock(status_mutex_);
+            fps_num_ = info.fps_n;
+            fps_den_ = info.fps_d;
+        }
+        total_ = static_cast<int64_t>(gst_util_uint64_scale(input->duration(), fps_num_, fps_den_ * 1000));
+
+        // Only H.264 parts can be joined without re-encoding, and only a known length can be split
+        const auto codec = video_codec_option(options_);
+        const bool h264  = codec == "x264" || codec == "libx264" || codec == "openh264" || codec == "nvenc" ||
+                          codec == "nvh264";
+        int chunks = 1;
+        if (h264 && total_ > 0) {
+            const auto min_chunk = std::max<int64_t>(min_chunk_seconds * fps_num_ / fps_den_, 1);
+            chunks =
+                static_cast<int>(std::clamp<int64_t>(settings_.chunks, 1, std::max<int64_t>(total_ / min_chunk, 1)));
+        }
+        chunks_ = chunks;
+
+        const int cpus = settings_.placement.cpus.empty() ? static_cast<int>(std::thread::hardware_concurrency())
+                                                          : static_cast<int>(settings_.placement.cpus.size());
+        threads_ = std::max(cpus / chunks, 1);
+
+        set_status("encoding");
+        CASPAR_LOG(info) << "[gstreamer] Transcoding " << settings_.input << " to " << settings_.output << " in "
+                         << chunks << " chunks" << (settings_.placement.background ? " in the background." : ".");
+
+        if (chunks == 1) {
+            encode(*input, std::move(first), 0, -1, output_description(settings_.output, options_));
+            ++chunks_done_;
+        } else {
+            for (int n = 0; n < chunks; ++n) {
+                parts.push_back(settings_.output + ".part" + std::to_string(n) + ".ts");
+            }
+
+            std::mutex  error_mutex;
+            std::string error;
+
+            const auto encode_chunk = [&](int n, std::unique_ptr<GstInput> chunk_input, gst_ptr<GstSample> pending) {
+                try {
+                    set_thread_name(L"[gstreamer::transcode]");
+                    apply_thread_placement(settings_.placement);
+
+                    const auto begin = total_ * n / chunks;
+                    const auto end   = n + 1 == chunks ? -1 : total_ * (n + 1) / chunks;
+                    if (!chunk_input) {
+                        chunk_input = open_input(begin * 1000 * fps_den_ / fps_num_);
+                    }
+                    encode(*chunk_input, std::move(pending), begin, end,
+                           "mpegtsmux ! filesink location=\"" + parts[n] + "\" ");
+                    ++chunks_done_;
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    error          = "Chunk " + std::to_string(n) + " failed";
+                    abort_request_ = true;
+                }
+            };
+
+            // The first chunk continues with the input that is already decoding
+            std::vector<std::thread> workers;
+            workers.emplace_back([&, chunk_input = std::move(input), pending = std::move(first)]() mutable {
+                encode_chunk(0, std::move(chunk_input), std::move(pending));
+            });
+            for (int n = 1; n < chunks; ++n) {
+                workers.emplace_back([&, n] { encode_chunk(n, nullptr, nullptr); });
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+
+            if (!error.empty()) {
+                CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(error));
+            }
+            if (!abort_request_) {
+                join(parts);
+            }
+        }
+
+        set_status(abort_request_ ? "cancelled" : "done");
+        CASPAR_LOG(info) << "[gstreamer] Transcode to " << settings_.output << " "
+                         << (abort_request_ ? "cancelled" : "done") << " after " << frames_ << " frames.";
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        set_status(abort_request_ ? "cancelled" : "failed", "Transcode to " + settings_.output + " failed");
+    }
+
+    if (abort_request_) {
+        for (const auto& part : parts) {
+            boost::system::error_code ec;
+            fs::remove(part, ec);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(status_mutex_);
+        stopped_ = std::chrono::steady_clock::now();
+    }
+    finished_ = true;
+}
+
+struct transcode_producer : public core::frame_producer
+{
+    const std::wstring               input_;
+    const std::wstring               output_;
+    std::unique_ptr<GstTranscodeJob> job_;
+
+  public:
+    transcode_producer(std::wstring input, std::wstring output, GstTranscodeJob::Settings settings)
+        : input_(std::move(input))
+        , output_(std::move(output))
+        , job_(std::make_unique<GstTranscodeJob>(std::move(settings)))
+    {
+    }
+
+    ~transcode_producer()
+    {
+        // Stopping the decoders and encoders can take a moment, not on the channel's thread
+        stop_in_background(std::move(job_));
+    }
+
+    // frame_producer
+
+    core::draw_frame last_frame(const core::video_field field) override { return core::draw_frame{}; }
+
+    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
+    {
+        return core::draw_frame{};
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        std::wstring result;
+
+        if (boost::iequals(params.at(0), L"cancel")) {
+            job_->cancel();
+            result = L"cancelled";
+        } else if (boost::iequals(params.at(0), L"progress")) {
+            const auto progress = job_->progress();
+            result = u16(progress.status) + L" " + std::to_wstring(progress.frames) + L"/" +
+                     std::to_wstring(progress.total);
+        } else {
+            CASPAR_THROW_EXCEPTION(invalid_argument());
+        }
+
+        std::promise<std::wstring> promise;
+        promise.set_value(result);
+        return promise.get_future();
+    }
+
+    std::wstring print() const override
+    {
+        const auto progress = job_->progress();
+        return L"gstranscode[" + input_ + L"|" + output_ + L"|" + std::to_wstring(progress.frames) + L"/" +
+               std::to_wstring(progress.total) + L"]";
+    }
+
+    std::wstring name() const override { return L"gstranscode"; }
+
+    core::monitor::state state() const override
+    {
+        const auto progress = job_->progress();
+
+        core::monitor::state state;
+        state["transcode/input"]       = u8(input_);
+        state["transcode/output"]      = u8(output_);
+        state["transcode/status"]      = progress.status;
+        state["transcode/frames"]      = progress.frames;
+        state["transcode/total"]       = progress.total;
+        state["transcode/progress"] =
+            progress.total > 0 ? std::min(static_cast<double>(progress.frames) / progress.total, 1.0) : 0.0;
+        state["transcode/fps"]         = progress.fps;
+        state["transcode/speed"]       = progress.speed;
+        state["transcode/chunks"]      = progress.chunks;
+        state["transcode/chunks-done"] = progress.chunks_done;
+        if (!progress.error.empty()) {
+            state["transcode/error"] = progress.error;
+        }
+        return state;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_transcode_producer(const core::frame_producer_dependencies& dependencies,
+                                                                const std::vector<std::wstring>&         params)
+{
+    if (params.size() < 3 || !boost::iequals(params.at(0), L"GSTRANSCODE")) {
+        return core::frame_producer::empty();
+    }
+
+    auto input = params.at(1);
+    if (!boost::contains(input, L"://")) {
+        auto path = find_file_within_dir_or_absolute(
+            env::media_folder(), input, [](const boost::filesystem::path&) { return true; });
+        if (!path) {
+            CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(u8(input) + " not found"));
+        }
+        input = path->wstring();
+    }
+
+    GstTranscodeJob::Settings settings;
+    settings.input  = u8(input);
+    settings.output = u8(params.at(2));
+    settings.chunks = get_param(L"CHUNKS", params, 1);
+
+    // Background jobs by default, playout comes first
+    settings.placement.background = !boost::iequals(get_param(L"PRIORITY", params, L"LOW"), L"NORMAL");
+
+    std::vector<std::string> args;
+    for (size_t n = 3; n < params.size(); ++n) {
+        args.emplace_back(u8(params[n]));
+    }
+    settings.options = boost::join(args, " ");
+
+    return spl::make_shared<transcode_producer>(params.at(1), params.at(2), std::move(settings));
+}
+
+}} // namespace caspar::gstreamer
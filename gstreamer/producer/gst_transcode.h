@@ -0,0 +1,108 @@
+#pragma once
+
+#include "gst_input.h"
+
+#include "../util/gst_thread.h"
+#include "../util/gst_util.h"
+
+#include <common/memory.h>
+
+#include <core/fwd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+namespace caspar { namespace gstreamer {
+
+struct transcode_progress
+{
+    std::string status;          // "starting", "encoding", "joining", "done", "failed" or "cancelled"
+    std::string error;           // why it failed
+    int64_t     frames      = 0; // encoded so far, all chunks together
+    int64_t     total       = 0; // frames of the source, 0 while unknown
+    double      fps         = 0; // encoded frames per second
+    double      speed       = 0; // media time encoded per second
+    int         chunks      = 0;
+    int         chunks_done = 0;
+};
+
+// Transcodes a clip into a file as fast as the CPU allows instead of at channel rate,
+// decoding with GstInput and encoding with the consumer's encoder and muxer for the same
+// options. H.264 outputs can be split into chunks that decode and encode in parallel, each
+// starting on a keyframe of its own, and are joined afterwards without re-encoding. Intra
+// codecs encode the slices of every frame in parallel already and run as one chunk.
+// A background placement runs every thread of the job at idle priority, so it only gets
+// the CPU time playout leaves over.
+class GstTranscodeJob
+{
+  public:
+    struct Settings
+    {
+        std::string      input;   // file in the media folder, absolute path or URI
+        std::string      output;
+        std::string      options; // as for the consumer, "-codec:v x264 -bitrate:v 5000"
+        int              chunks = 1;
+        thread_placement placement;
+    };
+
+    explicit GstTranscodeJob(Settings settings);
+    ~GstTranscodeJob(); // cancels an unfinished job
+
+    GstTranscodeJob(const GstTranscodeJob&)            = delete;
+    GstTranscodeJob& operator=(const GstTranscodeJob&) = delete;
+
+    void               cancel();
+    bool               finished() const;
+    transcode_progress progress() const;
+
+  private:
+    std::unique_ptr<GstInput> open_input(int64_t position);
+    gst_ptr<GstSample>        next_sample(GstInput& input);
+    void encode(GstInput& input, gst_ptr<GstSample> pending, int64_t begin, int64_t end, const std::string& sink);
+    void join(const std::vector<std::string>& parts);
+    bool poll(GstElement* pipeline, GstClockTime timeout); // true at the end of stream, throws on errors
+    void run_to_eos(GstElement* pipeline);
+    void set_status(const std::string& status, const std::string& error = "");
+    void run();
+
+    const Settings                           settings_;
+    const std::map<std::string, std::string> options_;
+    std::shared_ptr<diagnostics::graph>      graph_;
+
+    int fps_num_ = 0;
+    int fps_den_ = 1;
+    int threads_ = 1; // per chunk, for intra codecs
+
+    mutable std::mutex                    status_mutex_;
+    std::string                           status_ = "starting";
+    std::string                           error_;
+    std::chrono::steady_clock::time_point started_;
+    std::chrono::steady_clock::time_point stopped_;
+
+    std::atomic<int64_t> frames_{0};
+    std::atomic<int64_t> total_{0};
+    std::atomic<int>     chunks_{0};
+    std::atomic<int>     chunks_done_{0};
+    std::atomic<bool>    finished_{false};
+
+    std::atomic<bool> abort_request_{false};
+    boost::thread     thread_;
+};
+
+// GSTRANSCODE <input> <output> [CHUNKS n] [PRIORITY LOW|NORMAL] [consumer options], a
+// producer that outputs nothing and runs the job while it's on a layer
+spl::shared_ptr<core::frame_producer> create_transcode_producer(const core::frame_producer_dependencies& dependencies,
+                                                                const std::vector<std::wstring>&         params);
+
+// Waits for the jobs of producers that were removed to stop, before the module unloads
+void uninit_transcodes();
+
+}} // namespace caspar::gstreamer
@@ -18,7 +18,11 @@
 #include "../StdAfx.h"
 
 #include "gstreamer_producer.h"
+#include "gst_image_sequence.h"
 #include "gst_producer.h"
+
+#include "../util/gst_thread.h"
+#include "../util/gst_util.h"
  
 #include <common/env.h>
 #include <common/os/filesystem.h>
@@ -28,6 +32,7 @@
 #include <core/frame/frame_factory.h>
 #include <core/frame/geometry.h>
 #include <core/producer/frame_producer.h>
+#include <core/video_channel.h>
 #include <core/video_format.h>
  
 #include <boost/algorithm/string/predicate.hpp>
@@ -35,6 +40,8 @@
 #include <boost/filesystem/fstream.hpp>
 #include <boost/logic/tribool.hpp>
 #include <common/filesystem.h>
+
+#include <cmath>
  
 namespace caspar { namespace gstreamer {
  
@@ -56,7 +63,11 @@ struct gstreamer_producer : public core::frame_producer
                               std::optional<int64_t>               seek,
                               std::optional<int64_t>               duration,
                               std::optional<bool>                  loop,
-                              core::frame_geometry::scale_mode     scale_mode)
+                              core::frame_geometry::scale_mode     scale_mode,
+                              bool                                 shared,
+                              thread_placement                     placement,
+                              int64_t                              timeshift,
+                              alpha_mode                           alpha)
         : filename_(filename)
         , frame_factory_(frame_factory)
         , format_desc_(format_desc)
@@ -69,7 +80,11 @@ struct gstreamer_producer : public core::frame_producer
                                    seek,
                                    duration,
                                    loop,
-                                   scale_mode))
+                                   scale_mode,
+                                   shared,
+                                   std::move(placement),
+                                   timeshift,
+                                   alpha))
     {
         CASPAR_LOG(info) << L"GStreamer producer created for file: " << filename;
     }
@@ -162,6 +177,50 @@ struct gstreamer_producer : public core::frame_producer
             producer_->seek(seek);
  
             result = std::to_wstring(seek);
+        } else if (boost::iequals(cmd, L"speed")) {
+            if (!value.empty()) {
+                auto speed    = boost::lexical_cast<double>(value);
+                auto key_only = params.size() > 2 &&
+                                (boost::iequals(params.at(2), L"key") || boost::iequals(params.at(2), L"shuttle"));
+ 
+                // Key frame only shuttle can go much faster than full decode
+                auto max_speed = key_only ? 32.0 : 4.0;
+                auto min_speed = key_only ? 1.0 : 0.25;
+                if (std::abs(speed) > max_speed || std::abs(speed) < min_speed) {
+                    CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Speed out of range"));
+                }
+ 
+                producer_->speed(speed, key_only);
+            }
+ 
+            result = std::to_wstring(producer_->speed());
+        } else if (boost::iequals(cmd, L"step")) {
+            if (boost::iequals(value, L"off") || boost::iequals(value, L"resume")) {
+                producer_->resume();
+            } else {
+                producer_->step(value.empty() ? 1 : boost::lexical_cast<int>(value));
+            }
+ 
+            result = std::to_wstring(producer_->time());
+        } else if (boost::iequals(cmd, L"dvr")) {
+            // Time-shift within the recorded window, offsets in seconds
+            if (boost::iequals(value, L"pause")) {
+                producer_->dvr_pause(true);
+            } else if (boost::iequals(value, L"resume")) {
+                producer_->dvr_pause(false);
+            } else if (boost::iequals(value, L"live")) {
+                producer_->dvr_delay(0);
+            } else if (boost::iequals(value, L"catchup")) {
+                producer_->dvr_catch_up();
+            } else if (boost::iequals(value, L"rewind") && params.size() > 2) {
+                producer_->dvr_rewind(boost::lexical_cast<int64_t>(params.at(2)) * 1000);
+            } else if (boost::iequals(value, L"delay") && params.size() > 2) {
+                producer_->dvr_delay(boost::lexical_cast<int64_t>(params.at(2)) * 1000);
+            } else if (!value.empty()) {
+                CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unknown DVR command"));
+            }
+
+            result = std::to_wstring(producer_->dvr_delay() / 1000.0);
         } else {
             CASPAR_THROW_EXCEPTION(invalid_argument());
         }
@@ -190,7 +249,8 @@ static bool is_valid_gstreamer_file(const boost::filesystem::path& path)
         L".wma", L".nut", L".flac", L".opus", L".ogg", L".webm"
     };
     static const std::set<std::wstring> valid_protocols = {
-        L"rtmp://", L"rtmps://", L"http://", L"https://", L"mms://", L"rtp://", L"udp://"
+        L"rtmp://", L"rtmps://", L"http://", L"https://", L"mms://", L"rtp://", L"udp://",
+        L"rtsp://", L"srt://"
     };
     
     auto ext = boost::to_lower_copy(path.extension().wstring());
@@ -232,7 +292,13 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
     
     auto path = name;
  
-    if (!boost::contains(path, L"://")) {
+    if (GstImageSequence::is_pattern(u8(path))) {
+        auto pattern = GstImageSequence::resolve(u8(path));
+        if (!pattern) {
+            return core::frame_producer::empty();
+        }
+        path = u16(*pattern);
+    } else if (!boost::contains(path, L"://")) {
         auto fullMediaPath = find_file_within_dir_or_absolute(env::media_folder(), path, is_valid_gstreamer_file);
         if (fullMediaPath) {
             path = fullMediaPath->wstring();
@@ -267,6 +333,15 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
     auto filter_str = get_param(L"FILTER", params_copy, L"");
     
     auto scale_mode = core::scale_mode_from_string(get_param(L"SCALE_MODE", params_copy, L"STRETCH"));
+
+    // Keyed clips are almost always straight alpha, ALPHA PREMULTIPLIED for the ones that aren't
+    auto alpha_str = get_param(L"ALPHA", params_copy, L"AUTO");
+    auto alpha     = alpha_mode::auto_detect;
+    if (boost::iequals(alpha_str, L"STRAIGHT")) {
+        alpha = alpha_mode::straight;
+    } else if (boost::iequals(alpha_str, L"PREMULTIPLIED")) {
+        alpha = alpha_mode::premultiplied;
+    }
  
     std::optional<std::int64_t> start;
     std::optional<std::int64_t> seek2;
@@ -284,7 +359,31 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
     }
  
     auto vfilter = get_param(L"VF", params_copy, filter_str);
+
+    // Live sources are decoded once and shared between layers unless asked otherwise,
+    // file sources only when requested since every layer usually wants its own timeline.
+    auto shared = contains_param(L"SHARED", params_copy) ||
+                  (is_live_uri(u8(path)) && !contains_param(L"EXCLUSIVE", params_copy));
+
+    // A time-shift window records the live source to disk and plays the recording,
+    // each such layer has its own timeline so it never shares the decode
+    int64_t timeshift = 0;
+    if (is_live_uri(u8(path))) {
+        timeshift = get_param(L"DVR", params_copy, static_cast<uint32_t>(0));
+    }
+    if (timeshift > 0) {
+        shared = false;
+    }
  
+    // Decode on the CPUs and memory configured for the channel whose mixer receives the frames
+    thread_placement placement;
+    for (const auto& channel : dependencies.channels) {
+        if (channel->frame_factory().get() == dependencies.frame_factory.get()) {
+            placement = channel_placement(channel->index());
+            break;
+        }
+    }
+
     try {
         return spl::make_shared<gstreamer_producer>(dependencies.frame_factory,
                                                   dependencies.format_desc,
@@ -295,7 +394,11 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
                                                   seek2,
                                                   duration,
                                                   loop,
-                                                  scale_mode);
+                                                  scale_mode,
+                                                  shared,
+                                                  placement,
+                                                  timeshift,
+                                                  alpha);
     } catch (...) {
         CASPAR_LOG_CURRENT_EXCEPTION();
     }
@@ -0,0 +1,430 @@
+#include "gst_allocator.h"
+
+#include <common/log.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <cstdlib>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace caspar { namespace gstreamer {
+
+namespace {
+
+const size_t slab_size = 2 * 1024 * 1024;
+
+struct slab
+{
+    void*  data = nullptr;
+    size_t size = 0;
+    bool   huge = false;
+};
+
+std::atomic<bool> hugepages_available{true};
+
+slab allocate_slab(size_t size)
+{
+    slab result;
+    result.size = size;
+
+#ifdef _WIN32
+    const auto large_page = GetLargePageMinimum();
+    if (hugepages_available && large_page > 0 && size % large_page == 0) {
+        // Needs SeLockMemoryPrivilege, which most accounts don't have
+        result.data = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (result.data) {
+            result.huge = true;
+            return result;
+        }
+        hugepages_available = false;
+    }
+    result.data = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+#ifdef MAP_HUGETLB
+    if (hugepages_available) {
+        auto data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (data != MAP_FAILED) {
+            result.data = data;
+            result.huge = true;
+            return result;
+        }
+        // No hugepages reserved, transparent hugepages are the next best thing
+        hugepages_available = false;
+    }
+#endif
+    if (posix_memalign(&result.data, slab_size, size) != 0) {
+        result.data = nullptr;
+    }
+#ifdef MADV_HUGEPAGE
+    if (result.data) {
+        madvise(result.data, size, MADV_HUGEPAGE);
+    }
+#endif
+#endif
+
+    return result;
+}
+
+void free_slab(const slab& s)
+{
+#ifdef _WIN32
+    VirtualFree(s.data, 0, MEM_RELEASE);
+#else
+    if (s.huge) {
+        munmap(s.data, s.size);
+    } else {
+        free(s.data);
+    }
+#endif
+}
+
+int64_t read_rss()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return static_cast<int64_t>(counters.WorkingSetSize);
+    }
+    return 0;
+#else
+    std::ifstream file("/proc/self/statm");
+    int64_t       size = 0;
+    int64_t       resident = 0;
+    if (file >> size >> resident) {
+        return resident * sysconf(_SC_PAGESIZE);
+    }
+    return 0;
+#endif
+}
+
+// Freed slabs per bucket size, kept up to max_bytes in total
+class slab_pool
+{
+  public:
+    slab acquire(size_t size)
+    {
+        const auto bucket = (size + slab_size - 1) / slab_size * slab_size;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        ++allocations_;
+        ++buckets_[bucket];
+        used_bytes_ += bucket;
+
+        auto& free = free_[bucket];
+        if (!free.empty()) {
+            auto result = free.back();
+            free.pop_back();
+            pooled_bytes_ -= bucket;
+            ++hits_;
+            return result;
+        }
+        lock.unlock();
+
+        auto result = allocate_slab(bucket);
+        if (!result.data) {
+            lock.lock();
+            --buckets_[bucket];
+            used_bytes_ -= bucket;
+            return result;
+        }
+
+        if (result.huge) {
+            ++hugepage_slabs_;
+        }
+        return result;
+    }
+
+    void release(const slab& s)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        --buckets_[s.size];
+        used_bytes_ -= s.size;
+
+        if (pooled_bytes_ + s.size <= max_bytes_) {
+            free_[s.size].push_back(s);
+            pooled_bytes_ += s.size;
+            return;
+        }
+        lock.unlock();
+
+        if (s.huge) {
+            --hugepage_slabs_;
+        }
+        free_slab(s);
+    }
+
+    void set_max_bytes(size_t max_bytes)
+    {
+        std::vector<slab> released;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            max_bytes_ = max_bytes;
+
+            for (auto& bucket : free_) {
+                while (pooled_bytes_ > max_bytes_ && !bucket.second.empty()) {
+                    released.push_back(bucket.second.back());
+                    bucket.second.pop_back();
+                    pooled_bytes_ -= bucket.first;
+                }
+            }
+        }
+
+        for (auto& s : released) {
+            if (s.huge) {
+                --hugepage_slabs_;
+            }
+            free_slab(s);
+        }
+    }
+
+    frame_allocator_stats stats()
+    {
+        frame_allocator_stats stats;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats.allocations  = allocations_;
+            stats.hits         = hits_;
+            stats.pooled_bytes = pooled_bytes_;
+            stats.used_bytes   = used_bytes_;
+            for (auto& bucket : buckets_) {
+                if (bucket.second > 0) {
+                    stats.buckets[bucket.first] = bucket.second;
+                }
+            }
+
+            // Read at most once a second, every producer and consumer asks for stats each frame
+            const auto now = std::chrono::steady_clock::now();
+            if (now - rss_time_ > std::chrono::seconds(1)) {
+                rss_       = read_rss();
+                rss_time_ = now;
+            }
+            stats.rss_bytes = rss_;
+        }
+        stats.hugepage_slabs = hugepage_slabs_;
+        return stats;
+    }
+
+  private:
+    std::mutex                              mutex_;
+    std::map<size_t, std::vector<slab>>     free_;
+    std::map<size_t, int64_t>               buckets_;
+    size_t                                  max_bytes_    = 0;
+    size_t                                  pooled_bytes_ = 0;
+    int64_t                                 used_bytes_   = 0;
+    int64_t                                 allocations_  = 0;
+    int64_t                                 hits_         = 0;
+    std::atomic<int64_t>                    hugepage_slabs_{0};
+    int64_t                                 rss_ = 0;
+    std::chrono::steady_clock::time_point   rss_time_;
+};
+
+slab_pool pool;
+
+std::mutex    allocator_mutex;
+GstAllocator* slab_allocator = nullptr;
+
+struct SlabMemory
+{
+    GstMemory mem;
+    slab      data;
+};
+
+} // namespace
+
+struct CasparSlabAllocator
+{
+    GstAllocator parent;
+};
+
+struct CasparSlabAllocatorClass
+{
+    GstAllocatorClass parent_class;
+};
+
+G_DEFINE_TYPE(CasparSlabAllocator, caspar_slab_allocator, GST_TYPE_ALLOCATOR)
+
+static GstMemory* caspar_slab_allocator_alloc(GstAllocator* alloc, gsize size, GstAllocationParams* params)
+{
+    const gsize maxsize = params->prefix + size + params->padding;
+
+    // Audio and other small buffers would waste most of a slab
+    if (maxsize < slab_size / 2) {
+        return gst_allocator_alloc(nullptr, size, params);
+    }
+
+    auto s = pool.acquire(maxsize + params->align);
+    if (!s.data) {
+        CASPAR_LOG(warning) << "[gstreamer] Slab allocation of " << maxsize << " bytes failed.";
+        return gst_allocator_alloc(nullptr, size, params);
+    }
+
+    // Slabs are at least page aligned, larger alignments are honoured through the offset
+    const auto aligned = (reinterpret_cast<uintptr_t>(s.data) + params->align) & ~static_cast<uintptr_t>(params->align);
+    const auto padding = aligned - reinterpret_cast<uintptr_t>(s.data);
+
+    auto mem  = new SlabMemory();
+    mem->data = s;
+    gst_memory_init(GST_MEMORY_CAST(mem),
+                    params->flags,
+                    alloc,
+                    nullptr,
+                    s.size,
+                    params->align,
+                    padding + params->prefix,
+                    size);
+
+    auto data = static_cast<uint8_t*>(s.data);
+    if (params->prefix && (params->flags & GST_MEMORY_FLAG_ZERO_PREFIXED)) {
+        memset(data + padding, 0, params->prefix);
+    }
+    if (params->padding && (params->flags & GST_MEMORY_FLAG_ZERO_PADDED)) {
+        memset(data + padding + params->prefix + size, 0, params->padding);
+    }
+
+    return GST_MEMORY_CAST(mem);
+}
+
+static void caspar_slab_allocator_free(GstAllocator* alloc, GstMemory* memory)
+{
+    auto mem = reinterpret_cast<SlabMemory*>(memory);
+
+    // Shared sub-memories point into their parent's slab, which is released with the parent
+    if (!memory->parent) {
+        pool.release(mem->data);
+    }
+    delete mem;
+}
+
+static gpointer caspar_slab_mem_map(GstMemory* memory, gsize maxsize, GstMapFlags flags)
+{
+    return reinterpret_cast<SlabMemory*>(memory)->data.data;
+}
+
+static void caspar_slab_mem_unmap(GstMemory* memory) {}
+
+static GstMemory* caspar_slab_mem_share(GstMemory* memory, gssize offset, gssize size)
+{
+    auto parent = memory->parent ? memory->parent : memory;
+    if (size == -1) {
+        size = memory->size - offset;
+    }
+
+    auto sub  = new SlabMemory();
+    sub->data = reinterpret_cast<SlabMemory*>(memory)->data;
+    gst_memory_init(GST_MEMORY_CAST(sub),
+                    static_cast<GstMemoryFlags>(GST_MINI_OBJECT_FLAGS(parent) | GST_MINI_OBJECT_FLAG_LOCK_READONLY),
+                    memory->allocator,
+                    parent,
+                    memory->maxsize,
+                    memory->align,
+                    memory->offset + offset,
+                    size);
+
+    return GST_MEMORY_CAST(sub);
+}
+
+static void caspar_slab_allocator_class_init(CasparSlabAllocatorClass* klass)
+{
+    auto allocator_class = GST_ALLOCATOR_CLASS(klass);
+
+    allocator_class->alloc = caspar_slab_allocator_alloc;
+    allocator_class->free  = caspar_slab_allocator_free;
+}
+
+static void caspar_slab_allocator_init(CasparSlabAllocator* self)
+{
+    auto alloc = GST_ALLOCATOR_CAST(self);
+
+    alloc->mem_type  = "CasparSlab";
+    alloc->mem_map   = caspar_slab_mem_map;
+    alloc->mem_unmap = caspar_slab_mem_unmap;
+    alloc->mem_share = caspar_slab_mem_share;
+}
+
+static GstPadProbeReturn on_sink_query(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    auto query = GST_PAD_PROBE_INFO_QUERY(info);
+    if (GST_QUERY_TYPE(query) != GST_QUERY_ALLOCATION || !(GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_PULL)) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    auto alloc = frame_allocator();
+    if (!alloc) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    // On the way back upstream, put the frame allocator first so it is the one used
+    GstAllocationParams params;
+    gst_allocation_params_init(&params);
+    if (gst_query_get_n_allocation_params(query) > 0) {
+        gst_query_parse_nth_allocation_param(query, 0, nullptr, &params);
+        gst_query_set_nth_allocation_param(query, 0, alloc, &params);
+    } else {
+        gst_query_add_allocation_param(query, alloc, &params);
+    }
+
+    gst_object_unref(alloc);
+    return GST_PAD_PROBE_OK;
+}
+
+void init_frame_allocator(size_t max_pool_bytes)
+{
+    std::lock_guard<std::mutex> lock(allocator_mutex);
+
+    pool.set_max_bytes(max_pool_bytes);
+    if (max_pool_bytes == 0 || slab_allocator) {
+        return;
+    }
+
+    slab_allocator = GST_ALLOCATOR(g_object_new(caspar_slab_allocator_get_type(), nullptr));
+    gst_object_ref_sink(slab_allocator);
+
+    CASPAR_LOG(info) << L"[gstreamer] Frame allocator ready, keeping up to " << max_pool_bytes / (1024 * 1024)
+                     << L" MB of free slabs.";
+}
+
+void uninit_frame_allocator()
+{
+    std::lock_guard<std::mutex> lock(allocator_mutex);
+
+    // Buffers still alive keep the allocator, their slabs are freed on release
+    pool.set_max_bytes(0);
+    if (slab_allocator) {
+        gst_object_unref(slab_allocator);
+        slab_allocator = nullptr;
+    }
+}
+
+GstAllocator* frame_allocator()
+{
+    std::lock_guard<std::mutex> lock(allocator_mutex);
+    return slab_allocator ? GST_ALLOCATOR(gst_object_ref(slab_allocator)) : nullptr;
+}
+
+void install_frame_allocator(GstElement* sink)
+{
+    if (!sink) {
+        return;
+    }
+
+    GstPad* pad = gst_element_get_static_pad(sink, "sink");
+    if (pad) {
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM, on_sink_query, nullptr, nullptr);
+        gst_object_unref(pad);
+    }
+}
+
+frame_allocator_stats get_frame_allocator_stats() { return pool.stats(); }
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <gst/gst.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+
+namespace caspar { namespace gstreamer {
+
+struct frame_allocator_stats
+{
+    int64_t allocations    = 0;
+    int64_t hits           = 0;
+    int64_t hugepage_slabs = 0;
+    int64_t pooled_bytes   = 0;
+    int64_t used_bytes     = 0;
+    int64_t rss_bytes      = 0;
+
+    // Slabs in use per bucket size, every frame format lands in its own bucket
+    std::map<size_t, int64_t> buckets;
+
+    double hit_rate() const { return allocations > 0 ? static_cast<double>(hits) / allocations : 0.0; }
+};
+
+// Module allocator for frame sized buffers. Memory comes from slabs rounded up to
+// 2 MB, backed by hugepages where the OS provides them, and freed slabs are kept
+// for the next buffer of the same size instead of going back to the system.
+// Buffers smaller than a slab are left to the system allocator.
+void init_frame_allocator(size_t max_pool_bytes);
+void uninit_frame_allocator();
+
+// The allocator with a reference owned by the caller, or nullptr for the GStreamer
+// default when the pool is disabled
+GstAllocator* frame_allocator();
+
+// Offers the allocator to the elements upstream of the sink in their ALLOCATION query
+void install_frame_allocator(GstElement* sink);
+
+frame_allocator_stats get_frame_allocator_stats();
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,79 @@
+#include "gst_module_stats.h"
+
+#include "gst_allocator.h"
+#include "gst_task_pool.h"
+#include "gst_thread.h"
+
+#include <common/timer.h>
+
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace caspar { namespace gstreamer {
+
+namespace {
+
+struct module_stats
+{
+    task_pool_stats                          pool;
+    frame_allocator_stats                    frames;
+    std::map<int, std::optional<numa_stats>> numa; // read for the nodes asked for
+};
+
+std::mutex    stats_mutex;
+caspar::timer stats_timer;
+module_stats  stats;
+bool          stats_read = false;
+
+} // namespace
+
+void append_module_stats(core::monitor::state& state, int numa_node)
+{
+    module_stats current;
+    {
+        // Node counters are system wide and only change meaningfully over seconds, the others
+        // are shared by every instance
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        if (!stats_read || stats_timer.elapsed() > 1.0) {
+            stats_timer.restart();
+            stats_read   = true;
+            stats.pool   = get_task_pool_stats();
+            stats.frames = get_frame_allocator_stats();
+            stats.numa.clear();
+        }
+        if (numa_node >= 0 && stats.numa.find(numa_node) == stats.numa.end()) {
+            stats.numa[numa_node] = read_numa_stats(numa_node);
+        }
+        current = stats;
+    }
+
+    state["task-pool/threads"]          = current.pool.threads;
+    state["task-pool/busy"]             = current.pool.busy;
+    state["task-pool/created"]          = current.pool.created;
+    state["task-pool/context-switches"] = current.pool.context_switches;
+
+    const auto& frames                = current.frames;
+    state["allocator/allocations"]    = frames.allocations;
+    state["allocator/hit-rate"]       = frames.hit_rate();
+    state["allocator/hugepage-slabs"] = frames.hugepage_slabs;
+    state["allocator/pooled-mb"]      = frames.pooled_bytes / (1024 * 1024);
+    state["allocator/used-mb"]        = frames.used_bytes / (1024 * 1024);
+    state["allocator/rss-mb"]         = frames.rss_bytes / (1024 * 1024);
+    for (const auto& bucket : frames.buckets) {
+        state["allocator/buckets/" + std::to_string(bucket.first / (1024 * 1024)) + "mb"] = bucket.second;
+    }
+
+    if (numa_node >= 0) {
+        if (const auto& numa = current.numa[numa_node]) {
+            state["numa/node"]       = numa_node;
+            state["numa/hit"]        = numa->hit;
+            state["numa/miss"]       = numa->miss;
+            state["numa/foreign"]    = numa->foreign;
+            state["numa/other-node"] = numa->other_node;
+        }
+    }
+}
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <core/monitor/monitor.h>
+
+namespace caspar { namespace gstreamer {
+
+// Adds the process-wide task-pool/*, allocator/* and, for a node of 0 or more, numa/*
+// state of the module. Every producer and consumer reports them, they are read once a
+// second for all of them.
+void append_module_stats(core::monitor::state& state, int numa_node);
+
+}} // namespace caspar::gstreamer
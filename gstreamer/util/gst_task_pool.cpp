@@ -0,0 +1,380 @@
+#include "gst_task_pool.h"
+
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace caspar { namespace gstreamer {
+
+namespace {
+
+struct pool_job
+{
+    GstTaskPoolFunction     func;
+    gpointer                user_data;
+    std::mutex              mutex;
+    std::condition_variable cond;
+    bool                    done = false;
+};
+
+// Parked worker threads that pick up streaming tasks. A streaming task loops until its pad is
+// stopped, so every running task holds a worker of its own and the pool doesn't bound how many
+// run. What it saves is creating a thread per task: a task that ends, on a seek, restart or
+// removed pipeline, leaves its worker parked for the next one, with the placement reapplied. At
+// most max_parked workers wait, the others exit once their task is done.
+class worker_pool
+{
+  public:
+    worker_pool(int max_parked, thread_placement defaults)
+        : max_parked_(max_parked)
+        , defaults_(std::move(defaults))
+    {
+    }
+
+    ~worker_pool()
+    {
+        // Every worker is joined, the ones still running a task once their pipeline stops it
+        std::vector<std::thread> threads;
+        int                      busy = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            busy      = busy_;
+            cond_.notify_all();
+            for (auto& thread : threads_) {
+                threads.push_back(std::move(thread.second));
+            }
+            threads_.clear();
+            for (auto& thread : exited_) {
+                threads.push_back(std::move(thread));
+            }
+            exited_.clear();
+        }
+        if (busy > 0) {
+            CASPAR_LOG(info) << "[gstreamer] Waiting for " << busy << " streaming tasks to stop.";
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    std::shared_ptr<pool_job> push(GstTaskPoolFunction func, gpointer user_data)
+    {
+        auto job       = std::make_shared<pool_job>();
+        job->func      = func;
+        job->user_data = user_data;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(job);
+
+        if (idle_ < static_cast<int>(queue_.size())) {
+            ++created_;
+            std::thread thread([this] { worker(); });
+            const auto  id = thread.get_id();
+            threads_.emplace(id, std::move(thread));
+        }
+
+        // Workers that exited are done, their join doesn't wait
+        for (auto& thread : exited_) {
+            thread.join();
+        }
+        exited_.clear();
+
+        cond_.notify_one();
+        return job;
+    }
+
+    task_pool_stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        task_pool_stats stats;
+        stats.threads = static_cast<int>(threads_.size());
+        stats.busy    = busy_;
+        stats.created = created_;
+        return stats;
+    }
+
+    const thread_placement& defaults() const { return defaults_; }
+
+  private:
+    void worker()
+    {
+        set_thread_name(L"[gstreamer::task_pool]");
+        apply_thread_placement(defaults_);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            ++idle_;
+            cond_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+            --idle_;
+
+            if (queue_.empty()) {
+                return;
+            }
+
+            auto job = std::move(queue_.front());
+            queue_.pop_front();
+            ++busy_;
+            lock.unlock();
+
+            job->func(job->user_data);
+            {
+                std::lock_guard<std::mutex> job_lock(job->mutex);
+                job->done = true;
+            }
+            job->cond.notify_all();
+
+            // The task's pipeline may have moved this thread, put it back before parking
+            apply_thread_placement(defaults_);
+
+            lock.lock();
+            --busy_;
+
+            if (!stopping_ && idle_ >= max_parked_) {
+                break;
+            }
+        }
+
+        // Joined by the next push, or at shutdown
+        auto self = threads_.find(std::this_thread::get_id());
+        if (self != threads_.end()) {
+            exited_.push_back(std::move(self->second));
+            threads_.erase(self);
+        }
+    }
+
+    const int              max_parked_;
+    const thread_placement defaults_;
+
+    mutable std::mutex                     mutex_;
+    std::condition_variable                cond_;
+    std::deque<std::shared_ptr<pool_job>>  queue_;
+    std::map<std::thread::id, std::thread> threads_;
+    std::vector<std::thread>               exited_;
+    int                                    idle_     = 0;
+    int                                    busy_     = 0;
+    int64_t                                created_  = 0;
+    bool                                   stopping_ = false;
+};
+
+std::mutex                   pool_mutex;
+std::shared_ptr<worker_pool> workers;
+GstTaskPool*                 task_pool = nullptr;
+
+std::shared_ptr<worker_pool> get_workers()
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    return workers;
+}
+
+} // namespace
+
+struct CasparTaskPool
+{
+    GstTaskPool parent;
+};
+
+struct CasparTaskPoolClass
+{
+    GstTaskPoolClass parent_class;
+};
+
+G_DEFINE_TYPE(CasparTaskPool, caspar_task_pool, GST_TYPE_TASK_POOL)
+
+static void caspar_task_pool_prepare(GstTaskPool* pool, GError** error)
+{
+    // The worker threads are owned by the module, nothing to set up per pool
+}
+
+static void caspar_task_pool_cleanup(GstTaskPool* pool) {}
+
+static gpointer caspar_task_pool_push(GstTaskPool* pool, GstTaskPoolFunction func, gpointer user_data, GError** error)
+{
+    auto pool_workers = get_workers();
+    if (!pool_workers) {
+        g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_FAILED, "GStreamer task pool is shut down");
+        return nullptr;
+    }
+
+    return new std::shared_ptr<pool_job>(pool_workers->push(func, user_data));
+}
+
+static void caspar_task_pool_join(GstTaskPool* pool, gpointer id)
+{
+    auto handle = static_cast<std::shared_ptr<pool_job>*>(id);
+    if (!handle) {
+        return;
+    }
+
+    {
+        auto&                        job = **handle;
+        std::unique_lock<std::mutex> lock(job.mutex);
+        job.cond.wait(lock, [&] { return job.done; });
+    }
+
+    delete handle;
+}
+
+#if GST_CHECK_VERSION(1, 20, 0)
+static void caspar_task_pool_dispose_handle(GstTaskPool* pool, gpointer id)
+{
+    delete static_cast<std::shared_ptr<pool_job>*>(id);
+}
+#endif
+
+static void caspar_task_pool_class_init(CasparTaskPoolClass* klass)
+{
+    auto pool_class = GST_TASK_POOL_CLASS(klass);
+
+    pool_class->prepare = caspar_task_pool_prepare;
+    pool_class->cleanup = caspar_task_pool_cleanup;
+    pool_class->push    = caspar_task_pool_push;
+    pool_class->join    = caspar_task_pool_join;
+#if GST_CHECK_VERSION(1, 20, 0)
+    pool_class->dispose_handle = caspar_task_pool_dispose_handle;
+#endif
+}
+
+static void caspar_task_pool_init(CasparTaskPool* pool) {}
+
+static void on_task_enter(GstTask* task, GThread* thread, gpointer user_data)
+{
+    apply_thread_placement(*static_cast<thread_placement*>(user_data));
+}
+
+static void delete_placement(gpointer data) { delete static_cast<thread_placement*>(data); }
+
+// Streaming threads of one pipeline. Background pipelines run their tasks on a pool of
+// their own: a thread lowered to idle priority can't be raised again without CAP_SYS_NICE,
+// so it must never go back to the shared pool. Their threads go away with the pipeline.
+struct pipeline_tasks
+{
+    thread_placement placement;
+    GstTaskPool*     own_pool = nullptr;
+};
+
+static void delete_pipeline_tasks(gpointer data)
+{
+    auto tasks = static_cast<pipeline_tasks*>(data);
+    if (tasks->own_pool) {
+        gst_task_pool_cleanup(tasks->own_pool);
+        gst_object_unref(tasks->own_pool);
+    }
+    delete tasks;
+}
+
+static GstBusSyncReply on_sync_message(GstBus* bus, GstMessage* message, gpointer user_data)
+{
+    if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_STREAM_STATUS) {
+        return GST_BUS_PASS;
+    }
+
+    GstStreamStatusType type;
+    GstElement*         owner = nullptr;
+    gst_message_parse_stream_status(message, &type, &owner);
+    if (type != GST_STREAM_STATUS_TYPE_CREATE) {
+        return GST_BUS_PASS;
+    }
+
+    const GValue* value = gst_message_get_stream_status_object(message);
+    if (!value || G_VALUE_TYPE(value) != GST_TYPE_TASK) {
+        return GST_BUS_PASS;
+    }
+
+    auto tasks = static_cast<pipeline_tasks*>(user_data);
+    auto task  = GST_TASK(g_value_get_object(value));
+    if (tasks->own_pool) {
+        gst_task_set_pool(task, tasks->own_pool);
+    } else {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if (!task_pool) {
+            return GST_BUS_PASS;
+        }
+        gst_task_set_pool(task, task_pool);
+    }
+    gst_task_set_enter_callback(task, on_task_enter, new thread_placement(tasks->placement), delete_placement);
+
+    return GST_BUS_PASS;
+}
+
+void init_task_pool(int max_parked, thread_placement defaults)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+
+    workers   = std::make_shared<worker_pool>(max_parked, std::move(defaults));
+    task_pool = GST_TASK_POOL(g_object_new(caspar_task_pool_get_type(), nullptr));
+    gst_task_pool_prepare(task_pool, nullptr);
+
+    CASPAR_LOG(info) << L"[gstreamer] Streaming task pool ready, keeping up to " << max_parked
+                     << L" threads parked.";
+}
+
+void uninit_task_pool()
+{
+    std::shared_ptr<worker_pool> pool_workers;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if (task_pool) {
+            gst_task_pool_cleanup(task_pool);
+            gst_object_unref(task_pool);
+            task_pool = nullptr;
+        }
+        pool_workers = std::move(workers);
+    }
+}
+
+void install_task_pool(GstElement* pipeline, const thread_placement& placement)
+{
+    auto pool_workers = get_workers();
+    if (!pipeline || (!pool_workers && !placement.background)) {
+        return;
+    }
+
+    auto tasks       = new pipeline_tasks();
+    tasks->placement = placement;
+    if (tasks->placement.cpus.empty() && tasks->placement.numa_node < 0 && pool_workers) {
+        tasks->placement.cpus = pool_workers->defaults().cpus;
+    }
+    if (placement.background) {
+        tasks->own_pool = gst_task_pool_new();
+        gst_task_pool_prepare(tasks->own_pool, nullptr);
+    }
+
+    GstBus* bus = gst_element_get_bus(pipeline);
+    gst_bus_set_sync_handler(bus, on_sync_message, tasks, delete_pipeline_tasks);
+    gst_object_unref(bus);
+}
+
+task_pool_stats get_task_pool_stats()
+{
+    task_pool_stats stats;
+
+    auto pool_workers = get_workers();
+    if (pool_workers) {
+        stats = pool_workers->stats();
+    }
+
+#ifndef _WIN32
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        stats.context_switches = usage.ru_nvcsw + usage.ru_nivcsw;
+    }
+#endif
+
+    return stats;
+}
+
+}} // namespace caspar::gstreamer
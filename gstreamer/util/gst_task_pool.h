@@ -0,0 +1,34 @@
+#pragma once
+
+#include "gst_thread.h"
+
+#include <gst/gst.h>
+
+#include <cstdint>
+
+namespace caspar { namespace gstreamer {
+
+struct task_pool_stats
+{
+    int     threads          = 0;
+    int     busy             = 0;
+    int64_t created          = 0; // threads started in total, flat while tasks reuse parked ones
+    int64_t context_switches = 0;
+};
+
+// Creates the pool that runs the streaming threads of every pipeline in the module.
+// Each running task still has a thread of its own, but threads are reused across
+// pipelines, seeks and restarts instead of being created per task, and always run
+// with their pipeline's placement. Up to max_parked idle threads wait for the next task.
+// Uninit joins every thread, the pipelines must be stopped first.
+void init_task_pool(int max_parked, thread_placement defaults);
+void uninit_task_pool();
+
+// Makes the pipeline run its streaming tasks on the shared pool. A placement
+// without CPUs or NUMA node falls back to the pool's configured CPUs. Background
+// placements get threads of their own instead, released with the pipeline.
+void install_task_pool(GstElement* pipeline, const thread_placement& placement);
+
+task_pool_stats get_task_pool_stats();
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,209 @@
+#include "gst_thread.h"
+
+#include <common/log.h>
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace caspar { namespace gstreamer {
+
+std::vector<int> parse_cpu_list(const std::string& list)
+{
+    std::vector<int> cpus;
+
+    std::vector<std::string> ranges;
+    boost::split(ranges, list, [](char c) { return c == ','; });
+
+    for (auto range : ranges) {
+        boost::trim(range);
+        if (range.empty()) {
+            continue;
+        }
+
+        try {
+            const auto dash = range.find('-');
+            const auto from = std::stoi(range.substr(0, dash));
+            const auto to   = dash == std::string::npos ? from : std::stoi(range.substr(dash + 1));
+            for (int cpu = from; cpu <= to; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        } catch (...) {
+            CASPAR_LOG(warning) << "[gstreamer] Ignoring invalid CPU range: " << range;
+        }
+    }
+
+    return cpus;
+}
+
+std::vector<int> numa_node_cpus(int node)
+{
+    std::vector<int> cpus;
+    if (node < 0) {
+        return cpus;
+    }
+
+#ifdef _WIN32
+    ULONGLONG mask = 0;
+    if (GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask)) {
+        for (int cpu = 0; cpu < 64; ++cpu) {
+            if (mask & (1ULL << cpu)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#else
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string   list;
+    if (std::getline(file, list)) {
+        cpus = parse_cpu_list(list);
+    }
+#endif
+
+    return cpus;
+}
+
+static void set_affinity(const std::vector<int>& cpus)
+{
+#ifdef _WIN32
+    DWORD_PTR mask = 0;
+    for (auto cpu : cpus) {
+        if (cpu < static_cast<int>(sizeof(DWORD_PTR) * 8)) {
+            mask |= static_cast<DWORD_PTR>(1) << cpu;
+        }
+    }
+    if (mask == 0) {
+        DWORD_PTR system_mask = 0;
+        GetProcessAffinityMask(GetCurrentProcess(), &mask, &system_mask);
+    }
+    SetThreadAffinityMask(GetCurrentThread(), mask);
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (cpus.empty()) {
+        for (unsigned cpu = 0; cpu < std::thread::hardware_concurrency() && cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, &set);
+        }
+    } else {
+        for (auto cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+static void set_priority(bool realtime, bool background)
+{
+#ifdef _WIN32
+    SetThreadPriority(GetCurrentThread(),
+                      realtime     ? THREAD_PRIORITY_TIME_CRITICAL
+                      : background ? THREAD_PRIORITY_IDLE
+                                   : THREAD_PRIORITY_NORMAL);
+#else
+    sched_param param{};
+    int         policy = SCHED_OTHER;
+    if (realtime) {
+        policy               = SCHED_FIFO;
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 10;
+    } else if (background) {
+#ifdef SCHED_IDLE
+        // Threads created from here on inherit it, so encoder worker threads are idle priority too
+        policy = SCHED_IDLE;
+#endif
+    }
+    if (pthread_setschedparam(pthread_self(), policy, &param) != 0 && realtime) {
+        static std::atomic<bool> warned{false};
+        if (!warned.exchange(true)) {
+            CASPAR_LOG(warning) << "[gstreamer] Could not raise streaming thread priority, "
+                                   "real-time scheduling needs CAP_SYS_NICE.";
+        }
+    }
+#endif
+}
+
+static void set_memory_node(int node)
+{
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+    // MPOL_DEFAULT and MPOL_PREFERRED from <numaif.h>, called directly to avoid linking libnuma
+    const int     mode = node >= 0 ? 1 : 0;
+    unsigned long mask = node >= 0 && node < 64 ? 1UL << node : 0;
+    if (mode == 0 || mask != 0) {
+        syscall(SYS_set_mempolicy, mode, mode == 0 ? nullptr : &mask, mode == 0 ? 0 : 64 + 1);
+    }
+#else
+    // Windows allocates from the node of the CPU the thread runs on, which the affinity already selects
+#endif
+}
+
+void apply_thread_placement(const thread_placement& placement)
+{
+    set_affinity(placement.cpus.empty() ? numa_node_cpus(placement.numa_node) : placement.cpus);
+    set_memory_node(placement.numa_node);
+    set_priority(placement.realtime, placement.background);
+}
+
+static std::mutex                      placements_mutex;
+static std::map<int, thread_placement> channel_placements;
+
+void set_channel_placements(std::map<int, thread_placement> placements)
+{
+    std::lock_guard<std::mutex> lock(placements_mutex);
+    channel_placements = std::move(placements);
+}
+
+thread_placement channel_placement(int channel_index)
+{
+    std::lock_guard<std::mutex> lock(placements_mutex);
+    auto                        it = channel_placements.find(channel_index);
+    return it != channel_placements.end() ? it->second : thread_placement{};
+}
+
+std::optional<numa_stats> read_numa_stats(int node)
+{
+#ifdef __linux__
+    if (node < 0) {
+        return {};
+    }
+
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/numastat");
+    if (!file) {
+        return {};
+    }
+
+    numa_stats  stats;
+    std::string name;
+    int64_t     value = 0;
+    while (file >> name >> value) {
+        if (name == "numa_hit") {
+            stats.hit = value;
+        } else if (name == "numa_miss") {
+            stats.miss = value;
+        } else if (name == "numa_foreign") {
+            stats.foreign = value;
+        } else if (name == "other_node") {
+            stats.other_node = value;
+        }
+    }
+    return stats;
+#else
+    return {};
+#endif
+}
+
+}} // namespace caspar::gstreamer
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace gstreamer {
+
+// Where a thread should run: the CPUs it may use (empty for any), the NUMA node
+// its memory should come from (-1 for any), whether it serves an output that
+// has to keep up with the channel clock and whether it does background work that
+// should only get the CPU time playout leaves over.
+struct thread_placement
+{
+    std::vector<int> cpus;
+    int              numa_node  = -1;
+    bool             realtime   = false;
+    bool             background = false;
+};
+
+// Parses CPU lists like "0-7,16-23"
+std::vector<int> parse_cpu_list(const std::string& list);
+
+// CPUs of a NUMA node, empty when unknown
+std::vector<int> numa_node_cpus(int node);
+
+// Moves the calling thread to the placement, empty cpus allow any CPU. Memory the
+// thread allocates afterwards prefers the placement's NUMA node.
+void apply_thread_placement(const thread_placement& placement);
+
+// Placement configured for each channel, keyed by channel index
+void             set_channel_placements(std::map<int, thread_placement> placements);
+thread_placement channel_placement(int channel_index);
+
+// Allocation counters of a NUMA node, where the OS provides them
+struct numa_stats
+{
+    int64_t hit        = 0; // allocated on this node as intended
+    int64_t miss       = 0; // intended for another node but allocated here
+    int64_t foreign    = 0; // intended for this node but allocated elsewhere
+    int64_t other_node = 0; // allocated here by a thread running on another node
+};
+
+std::optional<numa_stats> read_numa_stats(int node);
+
+}} // namespace caspar::gstreamer
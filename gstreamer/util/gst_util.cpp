@@ -1,8 +1,25 @@
 #include "gst_util.h"
+#include "gst_allocator.h"
 #include "gst_assert.h"
 
+#include <boost/algorithm/string/case_conv.hpp>
+
+#include <tbb/blocked_range.h>
 #include <tbb/parallel_for.h>
 #include <tbb/parallel_invoke.h>
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <set>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CASPAR_GST_SSE2
+#include <emmintrin.h>
+#endif
 
 // Disable specific warnings for this file
 #ifdef _MSC_VER
@@ -12,6 +29,260 @@
 
 namespace caspar { namespace gstreamer {
 
+namespace {
+
+std::unique_ptr<tbb::task_arena> copy_arena;
+
+// Copies rows in blocks so a frame is a handful of tasks rather than one per line,
+// inside the copy arena when one is configured
+template <typename Func>
+void parallel_rows(int rows, Func&& copy_row)
+{
+    auto copy = [&] {
+        tbb::parallel_for(tbb::blocked_range<int>(0, rows, 64), [&](const tbb::blocked_range<int>& range) {
+            for (int y = range.begin(); y < range.end(); ++y) {
+                copy_row(y);
+            }
+        });
+    };
+
+    if (copy_arena) {
+        copy_arena->execute(copy);
+    } else {
+        copy();
+    }
+}
+
+// x / 255 rounded, exact for x <= 255 * 255
+inline int div255(int x) { return (x + 128 + ((x + 128) >> 8)) >> 8; }
+
+#ifdef CASPAR_GST_SSE2
+inline __m128i div255_epu16(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+#endif
+
+// The mixer blends premultiplied alpha, decoders deliver straight alpha. These convert
+// while copying a row out of the decoded sample, so keyed clips cost no extra pass.
+// Runs of opaque pixels are copied unchanged.
+
+// BGRA or RGBA, alpha in the last byte of each pixel
+void premultiply_row(uint8_t* dst, const uint8_t* src, int pixels)
+{
+    int x = 0;
+#ifdef CASPAR_GST_SSE2
+    const __m128i alpha_mask  = _mm_set1_epi32(static_cast<int>(0xFF000000));
+    const __m128i alpha_lanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    const __m128i alpha_scale = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    const __m128i zero        = _mm_setzero_si128();
+    for (; x + 4 <= pixels; x += 4) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(v, alpha_mask), alpha_mask)) == 0xFFFF) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), v);
+            continue;
+        }
+
+        // Two pixels per register as 16 bit lanes, color times alpha and alpha times 255
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        __m128i lo_alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xFF), 0xFF);
+        __m128i hi_alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xFF), 0xFF);
+        lo_alpha = _mm_or_si128(_mm_andnot_si128(alpha_lanes, lo_alpha), alpha_scale);
+        hi_alpha = _mm_or_si128(_mm_andnot_si128(alpha_lanes, hi_alpha), alpha_scale);
+        lo = div255_epu16(_mm_mullo_epi16(lo, lo_alpha));
+        hi = div255_epu16(_mm_mullo_epi16(hi, hi_alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; x < pixels; ++x) {
+        const int a = src[x * 4 + 3];
+        dst[x * 4 + 0] = static_cast<uint8_t>(div255(src[x * 4 + 0] * a));
+        dst[x * 4 + 1] = static_cast<uint8_t>(div255(src[x * 4 + 1] * a));
+        dst[x * 4 + 2] = static_cast<uint8_t>(div255(src[x * 4 + 2] * a));
+        dst[x * 4 + 3] = static_cast<uint8_t>(a);
+    }
+}
+
+// Codecs that keep alpha store it straight, the channel's frames are premultiplied. Colors are
+// divided by alpha while the frame is copied for recording, runs of opaque pixels are copied
+// unchanged. BGRA or RGBA, alpha in the last byte of each pixel.
+void unpremultiply_row(uint8_t* dst, const uint8_t* src, int pixels)
+{
+    int x = 0;
+#ifdef CASPAR_GST_SSE2
+    const __m128i alpha_mask  = _mm_set1_epi32(static_cast<int>(0xFF000000));
+    const __m128i zero        = _mm_setzero_si128();
+    const __m128  color_lanes = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    const __m128  one         = _mm_set1_ps(1.0f);
+    const __m128  full        = _mm_set1_ps(255.0f);
+    const __m128  half        = _mm_set1_ps(0.5f);
+    for (; x + 4 <= pixels; x += 4) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(v, alpha_mask), alpha_mask)) == 0xFFFF) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), v);
+            continue;
+        }
+
+        // One pixel per register as floats, color * 255 / alpha rounded and clamped. Transparent
+        // pixels have no color left to restore and stay black.
+        const __m128i words[2] = {_mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero)};
+        __m128i       out[4];
+        for (int n = 0; n < 4; ++n) {
+            const __m128i w = n % 2 == 0 ? _mm_unpacklo_epi16(words[n / 2], zero)
+                                         : _mm_unpackhi_epi16(words[n / 2], zero);
+            const __m128 c      = _mm_cvtepi32_ps(w);
+            const __m128 a      = _mm_shuffle_ps(c, c, 0xFF);
+            const __m128 scaled = _mm_min_ps(_mm_add_ps(_mm_div_ps(_mm_mul_ps(c, full), _mm_max_ps(a, one)), half), full);
+            out[n] = _mm_cvttps_epi32(_mm_or_ps(_mm_and_ps(color_lanes, scaled), _mm_andnot_ps(color_lanes, c)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4),
+                         _mm_packus_epi16(_mm_packs_epi32(out[0], out[1]), _mm_packs_epi32(out[2], out[3])));
+    }
+#endif
+    for (; x < pixels; ++x) {
+        const int a = src[x * 4 + 3];
+        for (int c = 0; c < 3; ++c) {
+            dst[x * 4 + c] = a == 255 ? src[x * 4 + c]
+                             : a == 0 ? 0
+                                      : static_cast<uint8_t>(std::min(255, (src[x * 4 + c] * 255 + a / 2) / a));
+        }
+        dst[x * 4 + 3] = static_cast<uint8_t>(a);
+    }
+}
+
+// Limited range luma scaled towards black (16), which premultiplies the RGB it converts to
+void premultiply_luma_row(uint8_t* dst, const uint8_t* src, const uint8_t* alpha, int width)
+{
+    int x = 0;
+#ifdef CASPAR_GST_SSE2
+    const __m128i opaque = _mm_set1_epi8(static_cast<char>(0xFF));
+    const __m128i black  = _mm_set1_epi8(16);
+    const __m128i zero   = _mm_setzero_si128();
+    for (; x + 16 <= width; x += 16) {
+        const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + x));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, opaque)) == 0xFFFF) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), y);
+            continue;
+        }
+
+        const __m128i luma = _mm_subs_epu8(y, black);
+        const __m128i lo   = div255_epu16(_mm_mullo_epi16(_mm_unpacklo_epi8(luma, zero), _mm_unpacklo_epi8(a, zero)));
+        const __m128i hi   = div255_epu16(_mm_mullo_epi16(_mm_unpackhi_epi8(luma, zero), _mm_unpackhi_epi8(a, zero)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_adds_epu8(_mm_packus_epi16(lo, hi), black));
+    }
+#endif
+    for (; x < width; ++x) {
+        const int luma = std::max(src[x] - 16, 0);
+        dst[x]         = static_cast<uint8_t>(16 + div255(luma * alpha[x]));
+    }
+}
+
+// 4:2:0 chroma scaled towards neutral (128) by the mean alpha of the 2x2 luma block it covers.
+// The distance from neutral is divided rounded on its magnitude, so both directions round alike
+// and the vector loop and the tail give the same result.
+void premultiply_chroma_row(uint8_t*       dst,
+                            const uint8_t* src,
+                            const uint8_t* alpha0,
+                            const uint8_t* alpha1,
+                            int            width,
+                            int            alpha_width)
+{
+    int x = 0;
+#ifdef CASPAR_GST_SSE2
+    const __m128i opaque  = _mm_set1_epi8(static_cast<char>(0xFF));
+    const __m128i zero    = _mm_setzero_si128();
+    const __m128i neutral = _mm_set1_epi16(128);
+    const __m128i low     = _mm_set1_epi16(0xFF);
+    const __m128i two     = _mm_set1_epi16(2);
+    for (; x + 8 <= width && (x + 8) * 2 <= alpha_width; x += 8) {
+        const __m128i row0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha0 + x * 2));
+        const __m128i row1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha1 + x * 2));
+        if (_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(row0, opaque), _mm_cmpeq_epi8(row1, opaque))) == 0xFFFF) {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x),
+                             _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x)));
+            continue;
+        }
+
+        // (a0 + a1 + a2 + a3 + 2) / 4 as in the tail
+        const __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(row0, low), _mm_srli_epi16(row0, 8)),
+                                          _mm_add_epi16(_mm_and_si128(row1, low), _mm_srli_epi16(row1, 8)));
+        const __m128i a   = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        const __m128i c   = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x)), zero);
+
+        // |c - 128| * a <= 128 * 255 fits unsigned 16 bits, the sign is put back after dividing
+        const __m128i d      = _mm_sub_epi16(c, neutral);
+        const __m128i sign   = _mm_srai_epi16(d, 15);
+        const __m128i mag    = _mm_sub_epi16(_mm_xor_si128(d, sign), sign);
+        const __m128i q      = div255_epu16(_mm_mullo_epi16(mag, a));
+        const __m128i scaled = _mm_sub_epi16(_mm_xor_si128(q, sign), sign);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(_mm_add_epi16(scaled, neutral), zero));
+    }
+#endif
+    for (; x < width; ++x) {
+        const int left  = std::min(x * 2, alpha_width - 1);
+        const int right = std::min(x * 2 + 1, alpha_width - 1);
+        const int a     = (alpha0[left] + alpha0[right] + alpha1[left] + alpha1[right] + 2) / 4;
+        const int d     = src[x] - 128;
+        if (a == 255) {
+            dst[x] = src[x];
+            continue;
+        }
+        dst[x] = static_cast<uint8_t>(128 + (d < 0 ? -div255(-d * a) : div255(d * a)));
+    }
+}
+
+// Opaque fill and the alpha as 8 bit gray from one read of each BGRA or RGBA pixel,
+// so a separate key output costs no second conversion of the frame
+void split_fill_key_row(uint8_t* fill, uint8_t* key, const uint8_t* src, int pixels)
+{
+    int x = 0;
+#ifdef CASPAR_GST_SSE2
+    const __m128i alpha_mask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+    for (; x + 16 <= pixels; x += 16) {
+        __m128i alpha[4];
+        for (int n = 0; n < 4; ++n) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (x + n * 4) * 4));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(fill + (x + n * 4) * 4), _mm_or_si128(v, alpha_mask));
+            alpha[n] = _mm_srli_epi32(v, 24);
+        }
+        const __m128i lo = _mm_packs_epi32(alpha[0], alpha[1]);
+        const __m128i hi = _mm_packs_epi32(alpha[2], alpha[3]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(key + x), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; x < pixels; ++x) {
+        fill[x * 4 + 0] = src[x * 4 + 0];
+        fill[x * 4 + 1] = src[x * 4 + 1];
+        fill[x * 4 + 2] = src[x * 4 + 2];
+        fill[x * 4 + 3] = 0xFF;
+        key[x]          = src[x * 4 + 3];
+    }
+}
+
+// Buffer for an outgoing frame, recycled through the frame allocator when it is enabled
+GstBuffer* allocate_frame_buffer(gsize size)
+{
+    GstAllocator* allocator = frame_allocator();
+    GstBuffer*    buffer    = gst_buffer_new_allocate(allocator, size, nullptr);
+    if (allocator) {
+        gst_object_unref(allocator);
+    }
+    if (!buffer) {
+        CASPAR_LOG(error) << "Failed to allocate GstBuffer";
+    }
+    return buffer;
+}
+
+} // namespace
+
+void set_copy_threads(int threads)
+{
+    copy_arena = threads > 0 ? std::make_unique<tbb::task_arena>(threads) : nullptr;
+}
+
 GstVideoFormat pixel_format_to_gst(core::pixel_format format, common::bit_depth depth)
 {
     const bool is_16bit = depth != common::bit_depth::bit8;
@@ -192,7 +463,8 @@ core::pixel_format_desc gst_format_to_caspar(GstVideoInfo* video_info)
 core::mutable_frame make_frame(void* tag,
                               core::frame_factory& frame_factory,
                               GstSample* sample,
-                              core::color_space color_space)
+                              core::color_space color_space,
+                              alpha_mode alpha)
 {
     if (!sample) {
         return frame_factory.create_frame(tag, core::pixel_format_desc(core::pixel_format::invalid));
@@ -207,6 +479,12 @@ core::mutable_frame make_frame(void* tag,
     auto format_desc = gst_format_to_caspar((&video_info));
     auto frame = frame_factory.create_frame(tag, format_desc);
     
+    // Decoders that keep alpha (qtrle, ProRes 4444, VP8/VP9 alpha) deliver it straight
+    const bool premultiply =
+        alpha == alpha_mode::straight ||
+        (alpha == alpha_mode::auto_detect &&
+         !GST_VIDEO_INFO_FLAG_IS_SET(&video_info, GST_VIDEO_FLAG_PREMULTIPLIED_ALPHA));
+    
     GstMapInfo map;
     GST_CHECK(gst_buffer_map(buffer, &map, GST_MAP_READ), "Failed to map buffer");
     
@@ -224,7 +502,19 @@ core::mutable_frame make_frame(void* tag,
             
             int plane_height = static_cast<int>(plane.height);
             
-            tbb::parallel_for(0, plane_height, [&](int y) {
+            const bool alpha_last = format_desc.format == core::pixel_format::bgra ||
+                                    format_desc.format == core::pixel_format::rgba;
+            if (premultiply && alpha_last && plane.depth == common::bit_depth::bit8) {
+                parallel_rows(plane_height, [&](int y) {
+                    premultiply_row(
+                        frame.image_data(0).begin() + y * plane.linesize,
+                        map.data + y * line_size,
+                        static_cast<int>(plane.width));
+                });
+                break;
+            }
+            
+            parallel_rows(plane_height, [&](int y) {
                 std::memcpy(
                     frame.image_data(0).begin() + y * plane.linesize,
                     map.data + y * line_size,
@@ -241,7 +531,7 @@ core::mutable_frame make_frame(void* tag,
                 
                 int plane_height = static_cast<int>(plane.height);
                 
-                tbb::parallel_for(0, plane_height, [&](int y) {
+                parallel_rows(plane_height, [&](int y) {
                     std::memcpy(
                         frame.image_data(p).begin() + y * plane.linesize,
                         map.data + offset + y * stride,
@@ -252,6 +542,11 @@ core::mutable_frame make_frame(void* tag,
         }
         case core::pixel_format::ycbcra: {
             // For planar YUV formats with alpha
+            const uint8_t* alpha_data   = map.data + GST_VIDEO_INFO_PLANE_OFFSET(&video_info, 3);
+            const int      alpha_stride = GST_VIDEO_INFO_PLANE_STRIDE(&video_info, 3);
+            const int      alpha_width  = static_cast<int>(format_desc.planes[3].width);
+            const int      alpha_height = static_cast<int>(format_desc.planes[3].height);
+            
             for (int p = 0; p < 4; ++p) {
                 auto plane = format_desc.planes[p];
                 int offset = GST_VIDEO_INFO_PLANE_OFFSET(&video_info, p);
@@ -259,12 +554,32 @@ core::mutable_frame make_frame(void* tag,
                 
                 int plane_height = static_cast<int>(plane.height);
                 
-                tbb::parallel_for(0, plane_height, [&](int y) {
-                    std::memcpy(
-                        frame.image_data(p).begin() + y * plane.linesize,
-                        map.data + offset + y * stride,
-                        plane.linesize);
-                });
+                if (premultiply && p == 0) {
+                    parallel_rows(plane_height, [&](int y) {
+                        premultiply_luma_row(
+                            frame.image_data(p).begin() + y * plane.linesize,
+                            map.data + offset + y * stride,
+                            alpha_data + y * alpha_stride,
+                            static_cast<int>(plane.width));
+                    });
+                } else if (premultiply && p < 3) {
+                    parallel_rows(plane_height, [&](int y) {
+                        premultiply_chroma_row(
+                            frame.image_data(p).begin() + y * plane.linesize,
+                            map.data + offset + y * stride,
+                            alpha_data + std::min(y * 2, alpha_height - 1) * alpha_stride,
+                            alpha_data + std::min(y * 2 + 1, alpha_height - 1) * alpha_stride,
+                            static_cast<int>(plane.width),
+                            alpha_width);
+                    });
+                } else {
+                    parallel_rows(plane_height, [&](int y) {
+                        std::memcpy(
+                            frame.image_data(p).begin() + y * plane.linesize,
+                            map.data + offset + y * stride,
+                            plane.linesize);
+                    });
+                }
             }
             break;
         }
@@ -281,7 +596,44 @@ core::mutable_frame make_frame(void* tag,
     return frame;
 }
 
-GstSample* make_gst_sample(const core::const_frame& frame, const core::video_format_desc& format_desc)
+size_t append_audio_samples(GstSample* sample, int channels, std::vector<int32_t>& fifo)
+{
+    GstAudioInfo info;
+    if (!sample || channels <= 0 || !gst_audio_info_from_caps(&info, gst_sample_get_caps(sample)) ||
+        info.channels <= 0) {
+        return 0;
+    }
+
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    GstMapInfo map;
+    if (!buffer || !gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        return 0;
+    }
+
+    const auto source_channels = static_cast<size_t>(info.channels);
+    const auto target_channels = static_cast<size_t>(channels);
+    const auto data            = reinterpret_cast<const int32_t*>(map.data);
+    const auto count           = map.size / sizeof(int32_t) / source_channels;
+    const auto offset          = fifo.size();
+
+    if (source_channels == target_channels) {
+        fifo.insert(fifo.end(), data, data + count * source_channels);
+    } else {
+        fifo.resize(offset + count * target_channels, 0);
+        for (size_t n = 0; n < count; ++n) {
+            std::copy_n(data + n * source_channels,
+                        std::min(source_channels, target_channels),
+                        fifo.begin() + offset + n * target_channels);
+        }
+    }
+
+    gst_buffer_unmap(buffer, &map);
+    return count;
+}
+
+GstSample* make_gst_sample(const core::const_frame&       frame,
+                           const core::video_format_desc& format_desc,
+                           alpha_mode                     alpha)
 {
     auto pix_desc = frame.pixel_format_desc();
     
@@ -297,10 +649,8 @@ GstSample* make_gst_sample(const core::const_frame& frame, const core::video_for
     
     gst_video_info_set_format(&info, gst_format, format_desc.width, format_desc.height);
     
-    // Create buffer
-    GstBuffer* buffer = gst_buffer_new_allocate(nullptr, info.size, nullptr);
+    GstBuffer* buffer = allocate_frame_buffer(info.size);
     if (!buffer) {
-        CASPAR_LOG(error) << "Failed to allocate GstBuffer";
         return nullptr;
     }
     
@@ -326,7 +676,18 @@ GstSample* make_gst_sample(const core::const_frame& frame, const core::video_for
             
             int plane_height = static_cast<int>(plane.height);
             
-            tbb::parallel_for(0, plane_height, [&](int y) {
+            // Codecs that store straight alpha get the colors divided by alpha on the way
+            const bool unpremultiply = alpha == alpha_mode::straight && plane.depth == common::bit_depth::bit8 &&
+                                       (pix_desc.format == core::pixel_format::bgra ||
+                                        pix_desc.format == core::pixel_format::rgba);
+            
+            parallel_rows(plane_height, [&](int y) {
+                if (unpremultiply) {
+                    unpremultiply_row(map.data + y * line_size,
+                                      frame.image_data(0).begin() + y * plane.linesize,
+                                      static_cast<int>(plane.linesize / 4));
+                    return;
+                }
                 std::memcpy(
                     map.data + y * line_size,
                     frame.image_data(0).begin() + y * plane.linesize,
@@ -343,7 +704,7 @@ GstSample* make_gst_sample(const core::const_frame& frame, const core::video_for
                 
                 int plane_height = static_cast<int>(plane.height);
                 
-                tbb::parallel_for(0, plane_height, [&](int y) {
+                parallel_rows(plane_height, [&](int y) {
                     std::memcpy(
                         map.data + offset + y * stride,
                         frame.image_data(p).begin() + y * plane.linesize,
@@ -361,7 +722,7 @@ GstSample* make_gst_sample(const core::const_frame& frame, const core::video_for
                 
                 int plane_height = static_cast<int>(plane.height);
                 
-                tbb::parallel_for(0, plane_height, [&](int y) {
+                parallel_rows(plane_height, [&](int y) {
                     std::memcpy(
                         map.data + offset + y * stride,
                         frame.image_data(p).begin() + y * plane.linesize,
@@ -395,6 +756,72 @@ GstSample* make_gst_sample(const core::const_frame& frame, const core::video_for
     return sample;
 }
 
+std::pair<GstSample*, GstSample*> make_gst_fill_key_samples(const core::const_frame&       frame,
+                                                            const core::video_format_desc& format_desc)
+{
+    auto pix_desc = frame.pixel_format_desc();
+    if ((pix_desc.format != core::pixel_format::bgra && pix_desc.format != core::pixel_format::rgba) ||
+        pix_desc.planes[0].depth != common::bit_depth::bit8) {
+        // Consumers reject -key on other channels, only logged once should a frame still differ
+        static std::atomic<bool> warned{false};
+        if (!warned.exchange(true)) {
+            CASPAR_LOG(warning) << "Fill and key can only be split from 8 bit BGRA or RGBA frames";
+        }
+        return {nullptr, nullptr};
+    }
+
+    GstVideoInfo fill_info;
+    GstVideoInfo key_info;
+    gst_video_info_set_format(&fill_info,
+                              pix_desc.format == core::pixel_format::bgra ? GST_VIDEO_FORMAT_BGRx
+                                                                           : GST_VIDEO_FORMAT_RGBx,
+                              format_desc.width, format_desc.height);
+    gst_video_info_set_format(&key_info, GST_VIDEO_FORMAT_GRAY8, format_desc.width, format_desc.height);
+
+    GstBuffer* fill = allocate_frame_buffer(fill_info.size);
+    GstBuffer* key  = allocate_frame_buffer(key_info.size);
+    GstMapInfo fill_map;
+    GstMapInfo key_map;
+    if (!fill || !key || !gst_buffer_map(fill, &fill_map, GST_MAP_WRITE)) {
+        if (fill) {
+            gst_buffer_unref(fill);
+        }
+        if (key) {
+            gst_buffer_unref(key);
+        }
+        return {nullptr, nullptr};
+    }
+    if (!gst_buffer_map(key, &key_map, GST_MAP_WRITE)) {
+        gst_buffer_unmap(fill, &fill_map);
+        gst_buffer_unref(fill);
+        gst_buffer_unref(key);
+        return {nullptr, nullptr};
+    }
+
+    const auto& plane  = pix_desc.planes[0];
+    const int   pixels = std::min(static_cast<int>(plane.linesize / 4), format_desc.width);
+    parallel_rows(static_cast<int>(plane.height), [&](int y) {
+        split_fill_key_row(fill_map.data + y * fill_info.stride[0],
+                           key_map.data + y * key_info.stride[0],
+                           frame.image_data(0).begin() + y * plane.linesize,
+                           pixels);
+    });
+
+    gst_buffer_unmap(fill, &fill_map);
+    gst_buffer_unmap(key, &key_map);
+
+    GstCaps* fill_caps = gst_video_info_to_caps(&fill_info);
+    GstCaps* key_caps  = gst_video_info_to_caps(&key_info);
+    std::pair<GstSample*, GstSample*> samples(gst_sample_new(fill, fill_caps, nullptr, nullptr),
+                                              gst_sample_new(key, key_caps, nullptr, nullptr));
+    gst_buffer_unref(fill);
+    gst_buffer_unref(key);
+    gst_caps_unref(fill_caps);
+    gst_caps_unref(key_caps);
+
+    return samples;
+}
+
 gst_ptr<GstElement> create_pipeline(const std::string& pipeline_description)
 {
     CASPAR_LOG(debug) << "Creating GStreamer pipeline with description: " << pipeline_description;
@@ -486,6 +913,36 @@ std::string caps_to_string(GstCaps* caps)
     return result;
 }
 
+bool is_live_uri(const std::string& uri)
+{
+    static const std::set<std::string> live_protocols = {
+        "rtmp", "rtmps", "rtsp", "rtp", "udp", "srt", "mms"
+    };
+
+    auto protocol_separator = uri.find("://");
+    if (protocol_separator == std::string::npos) {
+        return false;
+    }
+
+    return live_protocols.count(boost::to_lower_copy(uri.substr(0, protocol_separator))) > 0;
+}
+
+bool is_audio_only_uri(const std::string& uri)
+{
+    static const std::set<std::string> audio_extensions = {
+        ".mp3", ".wav", ".flac", ".opus", ".ogg", ".wma"
+    };
+
+    // Query strings of network URIs are not part of the extension
+    const auto path = uri.substr(0, uri.find('?'));
+    const auto dot  = path.find_last_of("./\\");
+    if (dot == std::string::npos || path[dot] != '.') {
+        return false;
+    }
+
+    return audio_extensions.count(boost::to_lower_copy(path.substr(dot))) > 0;
+}
+
 }} // namespace caspar::gstreamer
 
 #ifdef _MSC_VER
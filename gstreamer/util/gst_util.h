@@ -13,6 +13,7 @@
 #include <memory>
 #include <string>
 #include <map>
+#include <utility>
 #include <vector>
 
 namespace caspar { namespace gstreamer {
@@ -89,17 +90,50 @@ struct GstDeleter<GstMessage> {
 GstVideoFormat pixel_format_to_gst(core::pixel_format format, common::bit_depth depth);
 core::pixel_format_desc gst_format_to_caspar(GstVideoInfo* video_info);
 
+// How the color of decoded frames relates to their alpha. The mixer blends premultiplied
+// alpha, straight alpha is premultiplied while the frame is copied. Auto treats alpha as
+// straight unless the caps flag it as premultiplied.
+enum class alpha_mode
+{
+    auto_detect,
+    straight,
+    premultiplied
+};
+
 // Frame conversion utilities
 core::mutable_frame make_frame(void* tag,
                               core::frame_factory& frame_factory,
                               GstSample* sample,
-                              core::color_space color_space = core::color_space::bt709);
+                              core::color_space color_space = core::color_space::bt709,
+                              alpha_mode alpha = alpha_mode::auto_detect);
+
+// The frame as a sample for an appsrc. The channel's alpha is premultiplied, with straight alpha
+// the colors are divided by it while copying, for codecs that store straight alpha.
+GstSample* make_gst_sample(const core::const_frame&       frame,
+                           const core::video_format_desc& format_desc,
+                           alpha_mode                     alpha = alpha_mode::premultiplied);
+
+// Splits a BGRA or RGBA frame into an opaque fill (BGRx/RGBx) and its key (the alpha as GRAY8)
+// for separate fill and key outputs, in one pass over the frame. Both are null on failure.
+std::pair<GstSample*, GstSample*> make_gst_fill_key_samples(const core::const_frame&       frame,
+                                                            const core::video_format_desc& format_desc);
 
-GstSample* make_gst_sample(const core::const_frame& frame, const core::video_format_desc& format_desc);
+// Appends the interleaved S32 audio of a sample to a FIFO of the given channel count. Channels
+// the sample lacks are silent, extra ones are dropped. Returns the samples per channel appended.
+size_t append_audio_samples(GstSample* sample, int channels, std::vector<int32_t>& fifo);
+
+// Limits the TBB threads used for frame copies, 0 for no limit
+void set_copy_threads(int threads);
 
 // Pipeline creation utilities
 gst_ptr<GstElement> create_pipeline(const std::string& pipeline_description);
 std::map<std::string, std::string> parse_gst_structure(GstStructure* structure);
 std::string caps_to_string(GstCaps* caps);
 
+// True for network sources that deliver a live, unseekable stream
+bool is_live_uri(const std::string& uri);
+
+// True for files that only carry audio (mp3, wav, flac, ...), decided by their extension
+bool is_audio_only_uri(const std::string& uri);
+
 }} // namespace caspar::gstreamer
\ No newline at end of file